@@ -0,0 +1,184 @@
+// Copyright (c) 2021, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//
+// Per-request cost of the HPS_TRITON_LOG macros, for the log entries that
+// TRITONBACKEND_ModelInstanceExecute writes for every request. The driver
+// stubs the few Triton server calls that the macros use, so it builds without
+// Triton, as part of the backend build with TRITON_ENABLE_BENCHMARKS or on its
+// own:
+//
+//   cmake -S benchmarks -B build-bench && cmake --build build-bench
+//   build-bench/hps_log_benchmark [num_requests] [repetitions]
+//
+// hps_log_benchmark_no_verbose_log measures the same with the verbose entries
+// compiled out, as with -DTRITON_ENABLE_VERBOSE_LOG=OFF. Triton enables INFO, WARN and ERROR by default and VERBOSE
+// only with --log-verbose, which the stubbed TRITONSERVER_LogIsEnabled
+// mirrors. The stub sink writes each entry to /dev/null, so the numbers only
+// cover formatting and handing the message over, not the log I/O itself.
+//
+// "before" logs four of the former per-request entries at INFO. "after" logs
+// the same entries at VERBOSE and the per-execution entry through
+// HPS_TRITON_LOG_EVERY_N, as the backend does now.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Stand-ins for the parts of tritonserver.h and backend_common.h that the
+// macros use.
+struct TRITONSERVER_Error;
+
+enum TRITONSERVER_LogLevel {
+  TRITONSERVER_LOG_INFO,
+  TRITONSERVER_LOG_WARN,
+  TRITONSERVER_LOG_ERROR,
+  TRITONSERVER_LOG_VERBOSE
+};
+
+namespace {
+
+bool log_enabled[] = {true, true, true, false};
+std::FILE* log_sink = nullptr;
+
+}  // namespace
+
+bool
+TRITONSERVER_LogIsEnabled(const TRITONSERVER_LogLevel level)
+{
+  return log_enabled[level];
+}
+
+TRITONSERVER_Error*
+TRITONSERVER_LogMessage(
+    const TRITONSERVER_LogLevel level, const char* const filename,
+    const int line, const char* const msg)
+{
+  std::fprintf(log_sink, "%d %s:%d] %s\n", level, filename, line, msg);
+  return nullptr;
+}
+
+#define LOG_IF_ERROR(X, MSG)             \
+  do {                                   \
+    TRITONSERVER_Error* lie_err__ = (X); \
+    if (lie_err__ != nullptr) {          \
+      std::fprintf(stderr, "%s\n", MSG); \
+    }                                    \
+  } while (false)
+
+#include <triton_common.hpp>
+
+namespace {
+
+using triton::backend::hps::hps_str_concat;
+
+constexpr const char* model_name = "hps_model";
+constexpr const char* instance_name = "hps_model_0_0";
+constexpr const char* request_id = "42";
+
+void
+LogBefore(const uint64_t r)
+{
+  HPS_TRITON_LOG(
+      INFO, "model ", model_name, ", instance ", instance_name, ", executing ",
+      1, " requests");
+  HPS_TRITON_LOG(
+      INFO, "request ", 0, ": id = \"", request_id, "\"",
+      ", correlation_id = ", r, ", input_count = ", 2,
+      ", requested_output_count = ", 1);
+  HPS_TRITON_LOG(
+      INFO, "*****Processing request on device***** ", 0, " for model ",
+      instance_name);
+  HPS_TRITON_LOG(INFO, "Prediction execution time is ", r & 7, " ms");
+}
+
+void
+LogAfter(const uint64_t r)
+{
+  HPS_TRITON_LOG_EVERY_N(
+      INFO, 10000, "model ", model_name, ", instance ", instance_name,
+      ", executing ", 1, " requests");
+  HPS_TRITON_LOG(
+      VERBOSE, "request ", 0, ": id = \"", request_id, "\"",
+      ", correlation_id = ", r, ", input_count = ", 2,
+      ", requested_output_count = ", 1);
+  HPS_TRITON_LOG(
+      VERBOSE, "*****Processing request on device***** ", 0, " for model ",
+      instance_name);
+  HPS_TRITON_LOG(VERBOSE, "Prediction execution time is ", r & 7, " ms");
+}
+
+// Best of 'repetitions' runs, in nanoseconds per request.
+template <typename Function>
+double
+NanosecondsPerRequest(
+    const uint64_t num_requests, const int repetitions, Function log)
+{
+  double best_seconds = 0;
+  for (int rep = 0; rep < repetitions; ++rep) {
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t r = 0; r < num_requests; ++r) {
+      log(r);
+    }
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (rep == 0 || elapsed.count() < best_seconds) {
+      best_seconds = elapsed.count();
+    }
+  }
+  return best_seconds * 1e9 / num_requests;
+}
+
+}  // namespace
+
+int
+main(int argc, char** argv)
+{
+  const uint64_t num_requests =
+      argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+  const int repetitions = argc > 2 ? std::atoi(argv[2]) : 10;
+  if (num_requests == 0 || repetitions <= 0) {
+    std::fprintf(stderr, "usage: %s [num_requests] [repetitions]\n", argv[0]);
+    return 1;
+  }
+  log_sink = std::fopen("/dev/null", "w");
+  if (log_sink == nullptr) {
+    std::fprintf(stderr, "cannot open /dev/null\n");
+    return 1;
+  }
+
+  const double before = NanosecondsPerRequest(
+      num_requests, repetitions, [](const uint64_t r) { LogBefore(r); });
+  const double after = NanosecondsPerRequest(
+      num_requests, repetitions, [](const uint64_t r) { LogAfter(r); });
+  std::printf("%8s %14s\n", "", "ns/request");
+  std::printf("%8s %14.1f\n", "before", before);
+  std::printf("%8s %14.1f\n", "after", after);
+
+  std::fclose(log_sink);
+  return 0;
+}
@@ -0,0 +1,195 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//
+// Decode throughput of the bit-packed CATCOLUMN encoding against the bytes
+// it saves over plain INT64 keys. The driver only depends on key_codec.hpp
+// and builds without Triton or HugeCTR, as part of the backend build with
+// TRITON_ENABLE_BENCHMARKS or on its own:
+//
+//   cmake -S benchmarks -B build-bench && cmake --build build-bench
+//   build-bench/key_codec_benchmark [num_keys] [repetitions]
+//
+// For every delta width it encodes random keys that lie within that many
+// bits of a block base, then reports the encoded size relative to INT64 keys
+// and the decode rate into 64 and 32 bit keys. The INT64 row is a plain
+// copy of the keys, which is what the backend does for unencoded requests.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <key_codec.hpp>
+#include <random>
+#include <vector>
+
+namespace {
+
+using triton::backend::hugectr::DecodeBitpackedKeys;
+using triton::backend::hugectr::kBitpackedBlockHeaderSize;
+using triton::backend::hugectr::kBitpackedMaxBlockKeys;
+
+// Encode keys in blocks of up to 256, with the block minimum as base and the
+// bit length of the largest difference as width.
+std::vector<uint8_t>
+EncodeBitpackedKeys(const std::vector<uint64_t>& keys)
+{
+  std::vector<uint8_t> encoded;
+  for (size_t begin = 0; begin < keys.size();
+       begin += kBitpackedMaxBlockKeys) {
+    const size_t count = std::min(kBitpackedMaxBlockKeys, keys.size() - begin);
+    const auto block_begin = keys.begin() + begin;
+    const uint64_t base = *std::min_element(block_begin, block_begin + count);
+    uint64_t max_delta = 0;
+    for (size_t i = 0; i < count; ++i) {
+      max_delta = std::max(max_delta, keys[begin + i] - base);
+    }
+    size_t width = 0;
+    while (width < 64 && (max_delta >> width) != 0) {
+      ++width;
+    }
+
+    const size_t header = encoded.size();
+    encoded.resize(
+        header + kBitpackedBlockHeaderSize + (count * width + 7) / 8);
+    encoded[header] = static_cast<uint8_t>(count - 1);
+    encoded[header + 1] = static_cast<uint8_t>(width);
+    std::memcpy(&encoded[header + 2], &base, sizeof(base));
+    uint8_t* const packed = &encoded[header + kBitpackedBlockHeaderSize];
+    for (size_t i = 0; i < count; ++i) {
+      const uint64_t delta = keys[begin + i] - base;
+      for (size_t b = 0; b < width; ++b) {
+        if ((delta >> b) & 1) {
+          const size_t bit = i * width + b;
+          packed[bit >> 3] |= static_cast<uint8_t>(1u << (bit & 7));
+        }
+      }
+    }
+  }
+  return encoded;
+}
+
+// Best of 'repetitions' runs, in keys per second.
+template <typename Function>
+double
+KeysPerSecond(const size_t num_keys, const int repetitions, Function run)
+{
+  double best_seconds = 0;
+  for (int r = 0; r < repetitions; ++r) {
+    const auto start = std::chrono::steady_clock::now();
+    run();
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (r == 0 || elapsed.count() < best_seconds) {
+      best_seconds = elapsed.count();
+    }
+  }
+  return num_keys / best_seconds;
+}
+
+}  // namespace
+
+int
+main(int argc, char** argv)
+{
+  const size_t num_keys = argc > 1 ? std::strtoull(argv[1], nullptr, 10)
+                                   : size_t{1} << 22;
+  const int repetitions = argc > 2 ? std::atoi(argv[2]) : 20;
+  if (num_keys == 0 || repetitions <= 0) {
+    std::fprintf(stderr, "usage: %s [num_keys] [repetitions]\n", argv[0]);
+    return 1;
+  }
+
+  std::mt19937_64 rng(42);
+  std::vector<uint64_t> keys(num_keys);
+  std::vector<uint64_t> keys64(num_keys);
+  std::vector<uint32_t> keys32(num_keys);
+  volatile uint64_t sink = 0;
+
+  const double copy_rate = KeysPerSecond(num_keys, repetitions, [&]() {
+    std::memcpy(keys64.data(), keys.data(), num_keys * sizeof(uint64_t));
+    sink = sink + keys64[num_keys - 1];
+  });
+  std::printf(
+      "%6s %12s %10s %16s %16s\n", "width", "bytes/key", "saving",
+      "decode64 Mkey/s", "decode32 Mkey/s");
+  std::printf(
+      "%6s %12.2f %9.2fx %16.0f %16s\n", "INT64", 8.0, 1.0, copy_rate / 1e6,
+      "-");
+
+  for (const size_t width :
+       {1, 4, 8, 12, 16, 20, 24, 28, 32, 40, 48, 57, 60, 64}) {
+    // Keep the keys within 32 bits where possible, so that the 32 bit decode
+    // can be measured as well.
+    const uint64_t mask =
+        width == 64 ? ~uint64_t{0} : (uint64_t{1} << width) - 1;
+    const uint64_t base = width <= 32 ? (UINT32_MAX - mask) / 2
+                                      : uint64_t{1} << 40;
+    for (uint64_t& key : keys) {
+      key = width == 64 ? rng() : base + (rng() & mask);
+    }
+    const std::vector<uint8_t> encoded = EncodeBitpackedKeys(keys);
+
+    size_t decoded = 0;
+    bool valid = true;
+    const double rate64 = KeysPerSecond(num_keys, repetitions, [&]() {
+      valid &= DecodeBitpackedKeys(
+          encoded.data(), encoded.size(), keys64.data(), num_keys, &decoded);
+    });
+    if (!valid || decoded != num_keys || keys64 != keys) {
+      std::fprintf(stderr, "decode of %zu bit keys failed\n", width);
+      return 1;
+    }
+    double rate32 = 0;
+    if (base + mask <= UINT32_MAX) {
+      rate32 = KeysPerSecond(num_keys, repetitions, [&]() {
+        valid &= DecodeBitpackedKeys(
+            encoded.data(), encoded.size(), keys32.data(), num_keys,
+            &decoded);
+      });
+      if (!valid || decoded != num_keys ||
+          !std::equal(keys.begin(), keys.end(), keys32.begin())) {
+        std::fprintf(stderr, "decode of %zu bit keys failed\n", width);
+        return 1;
+      }
+    }
+
+    const double bytes_per_key =
+        static_cast<double>(encoded.size()) / num_keys;
+    std::printf(
+        "%6zu %12.2f %9.2fx %16.0f ", width, bytes_per_key,
+        8.0 / bytes_per_key, rate64 / 1e6);
+    if (rate32 > 0) {
+      std::printf("%16.0f\n", rate32 / 1e6);
+    } else {
+      std::printf("%16s\n", "-");
+    }
+  }
+  return 0;
+}
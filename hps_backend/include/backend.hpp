@@ -98,6 +98,11 @@ class HPSBackend {
   // Initialize Embedding Tables based on deployed models
   TRITONSERVER_Error* HPS_backend();
 
+  // Get the counter family of the given name, which is shared by all models.
+  // Null if metrics are not supported.
+  TRITONSERVER_MetricFamily* CounterFamily(
+      const std::string& name, const std::string& description);
+
  private:
   TRITONBACKEND_Backend* triton_backend_;
   std::string ps_json_config_file_;
@@ -111,6 +116,9 @@ class HPSBackend {
 
   std::mutex version_map_mutex;
 
+  std::map<std::string, TRITONSERVER_MetricFamily*> counter_families_;
+  std::mutex counter_families_mutex_;
+
   common::TritonJson::Value parameter_server_config;
 
   bool support_int64_key_ = true;
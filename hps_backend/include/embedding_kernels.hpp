@@ -0,0 +1,63 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <cuda_runtime_api.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace triton { namespace backend { namespace hps {
+
+// How the embedding vectors of the keys of one sample in an embedding table
+// are combined into the output. Tables without a combiner return one
+// embedding vector per key.
+enum class Combiner { kNone, kSum, kMean, kSqrtN };
+
+//
+// Kernels that post-process looked up embedding vectors on the device of a
+// GPU instance, so that only the final output leaves the device.
+//
+
+// Combine the embedding vectors of each of 'num_samples' samples of one
+// embedding table into 'pooled', which receives one vector of 'ev_size'
+// values per sample. The keys of sample s are those from
+// 'sample_offsets'[s] to 'sample_offsets'[s + 1], and samples without keys
+// yield zero vectors. All pointers are device memory. Returns the launch
+// error, if any.
+cudaError_t PoolEmbeddingVectors(
+    const float* vectors, const int32_t* sample_offsets, size_t num_samples,
+    size_t ev_size, Combiner combiner, float* pooled, cudaStream_t stream);
+
+// Narrow 'count' FP32 values to FP16 or BF16, rounding to nearest even, the
+// same as the host conversions of CPU instances. Both pointers are device
+// memory. Returns the launch error, if any.
+cudaError_t ConvertFloatToHalfOnDevice(
+    const float* src, uint16_t* dst, size_t count, cudaStream_t stream);
+cudaError_t ConvertFloatToBFloat16OnDevice(
+    const float* src, uint16_t* dst, size_t count, cudaStream_t stream);
+
+}}}  // namespace triton::backend::hps
@@ -0,0 +1,243 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace triton { namespace backend { namespace hps {
+
+//
+// HostEmbeddingCache
+//
+// Bounded cache of the embedding vectors of one embedding table in host
+// memory, in front of the database tiers of the parameter server. Keys are
+// spread over independently locked shards by their hash, and each shard
+// evicts with the CLOCK algorithm: a hit marks its entry as referenced, and
+// the hand sweeps over the entries, clearing the marks, until it reaches one
+// that is not marked. Entries expire after a TTL, which bounds how long
+// updates of the database tiers go unnoticed. The capacity accounts for the
+// vectors and entries, but not for the index of each shard.
+//
+// Each shard finds its entries through an open-addressing index with linear
+// probing, which holds twice as many slots as the shard holds entries. The
+// index as well as the room for the entries and vectors are set aside when
+// the cache is created, so that neither lookups nor inserts allocate.
+//
+class HostEmbeddingCache {
+ public:
+  HostEmbeddingCache(
+      const size_t capacity_byte_size, const size_t vector_size,
+      const uint64_t ttl_ns)
+      : vector_size_(vector_size), ttl_ns_(ttl_ns)
+  {
+    const size_t capacity =
+        capacity_byte_size / (vector_size * sizeof(float) + sizeof(Entry));
+    for (Shard& shard : shards_) {
+      shard.capacity = std::max<size_t>(capacity / num_shards, 1);
+      shard.entries.reserve(shard.capacity);
+      shard.vectors.reserve(shard.capacity * vector_size_);
+      size_t num_slots = 2;
+      while (num_slots < 2 * shard.capacity) {
+        num_slots *= 2;
+      }
+      shard.index.resize(num_slots);
+      shard.index_mask = num_slots - 1;
+    }
+  }
+
+  size_t vector_size() const { return vector_size_; }
+
+  // Copy the embedding vector cached for 'key' into 'vector', unless it is
+  // missing or expired.
+  bool find(const long long key, const uint64_t now_ns, float* const vector)
+  {
+    Shard& shard = shards_[ShardOf(key)];
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      const size_t slot = FindEntry(shard, key);
+      if (slot != kNoEntry) {
+        Entry& entry = shard.entries[slot];
+        if (now_ns < entry.expiry_ns) {
+          entry.referenced = true;
+          std::copy_n(
+              &shard.vectors[slot * vector_size_], vector_size_, vector);
+          hits_.fetch_add(1, std::memory_order_relaxed);
+          return true;
+        }
+      }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  // Cache the embedding vector of 'key', evicting an entry that was not
+  // referenced since the hand last passed it if the shard is full.
+  void insert(
+      const long long key, const uint64_t now_ns, const float* const vector)
+  {
+    Shard& shard = shards_[ShardOf(key)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    size_t slot = FindEntry(shard, key);
+    if (slot == kNoEntry && shard.entries.size() < shard.capacity) {
+      slot = shard.entries.size();
+      shard.entries.emplace_back();
+      shard.vectors.resize(shard.vectors.size() + vector_size_);
+      AddEntry(&shard, key, slot);
+    } else if (slot == kNoEntry) {
+      while (shard.entries[shard.hand].referenced) {
+        shard.entries[shard.hand].referenced = false;
+        shard.hand = (shard.hand + 1) % shard.capacity;
+      }
+      slot = shard.hand;
+      shard.hand = (shard.hand + 1) % shard.capacity;
+      RemoveEntry(&shard, shard.entries[slot].key);
+      AddEntry(&shard, key, slot);
+    }
+    shard.entries[slot] = {key, now_ns + ttl_ns_, false};
+    std::copy_n(vector, vector_size_, &shard.vectors[slot * vector_size_]);
+  }
+
+  uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+
+  uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+  std::string to_string() const
+  {
+    const uint64_t h = hits();
+    const uint64_t n = h + misses();
+    std::stringstream ss;
+    ss << "hits = " << h << ", misses = " << n - h;
+    if (n != 0) {
+      ss << ", hit rate = " << 100.0 * h / n << "%";
+    }
+    return ss.str();
+  }
+
+ private:
+  static constexpr size_t num_shards = 64;
+  static constexpr size_t kNoEntry = std::numeric_limits<size_t>::max();
+
+  struct Entry {
+    long long key = 0;
+    uint64_t expiry_ns = 0;
+    bool referenced = false;
+  };
+
+  struct IndexSlot {
+    long long key = 0;
+    size_t entry = kNoEntry;
+  };
+
+  // Shards sit on cache lines of their own, so that threads working on
+  // different shards do not contend.
+  struct alignas(64) Shard {
+    std::mutex mutex;
+    size_t capacity = 0;
+    size_t hand = 0;
+    std::vector<Entry> entries;
+    std::vector<float> vectors;
+    std::vector<IndexSlot> index;
+    size_t index_mask = 0;
+  };
+
+  // Consecutive keys land in different shards.
+  static size_t ShardOf(const long long key)
+  {
+    return (static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL) >> 58;
+  }
+
+  // The home slot of 'key' in the index of a shard. The finalizer of
+  // SplitMix64 spreads the keys of a shard over all bits, independently of
+  // the bits that picked the shard.
+  static size_t HomeSlot(const Shard& shard, const long long key)
+  {
+    uint64_t h = static_cast<uint64_t>(key);
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    return (h ^ (h >> 31)) & shard.index_mask;
+  }
+
+  // The entry of 'key', or kNoEntry. The index is at most half full, so the
+  // probe always reaches an empty slot.
+  static size_t FindEntry(const Shard& shard, const long long key)
+  {
+    for (size_t i = HomeSlot(shard, key);; i = (i + 1) & shard.index_mask) {
+      const IndexSlot& slot = shard.index[i];
+      if (slot.entry == kNoEntry || slot.key == key) {
+        return slot.entry;
+      }
+    }
+  }
+
+  static void AddEntry(
+      Shard* const shard, const long long key, const size_t entry)
+  {
+    size_t i = HomeSlot(*shard, key);
+    while (shard->index[i].entry != kNoEntry) {
+      i = (i + 1) & shard->index_mask;
+    }
+    shard->index[i] = {key, entry};
+  }
+
+  // Remove 'key' from the index, and move the keys probed past it back, so
+  // that no probe ends early at the freed slot.
+  static void RemoveEntry(Shard* const shard, const long long key)
+  {
+    const size_t mask = shard->index_mask;
+    size_t hole = HomeSlot(*shard, key);
+    while (shard->index[hole].key != key ||
+           shard->index[hole].entry == kNoEntry) {
+      hole = (hole + 1) & mask;
+    }
+    for (size_t i = (hole + 1) & mask; shard->index[i].entry != kNoEntry;
+         i = (i + 1) & mask) {
+      // Keys whose home slot lies cyclically in (hole, i] stay where they are.
+      const size_t home = HomeSlot(*shard, shard->index[i].key);
+      if (((i - home) & mask) >= ((i - hole) & mask)) {
+        shard->index[hole] = shard->index[i];
+        hole = i;
+      }
+    }
+    shard->index[hole].entry = kNoEntry;
+  }
+
+  const size_t vector_size_;
+  const uint64_t ttl_ns_;
+  std::array<Shard, num_shards> shards_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+};
+
+}}}  // namespace triton::backend::hps
@@ -0,0 +1,150 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace triton { namespace backend { namespace hps {
+
+//
+// Hot keys for embedding cache warm-up
+//
+// A hot key file lists one key per line as
+//
+//   <table> <key> [<count>]
+//
+// where <table> is the index of the embedding table, and the optional
+// <count> is the number of times the key was seen, as in a key-frequency
+// snapshot. Empty lines and lines starting with '#' are skipped. The keys of
+// each table are warmed up in order of decreasing count, and in file order
+// among equal counts. Keys without a count have a count of 0.
+//
+
+struct HotKey {
+  long long key;
+  uint64_t count;
+};
+
+// Read the hot keys of 'num_tables' embedding tables from 'path', keeping
+// the first 'max_keys_per_table' distinct keys of each table, or all of them
+// if it is 0. Returns false and describes the problem in 'error' if the file
+// cannot be read or is malformed.
+inline bool
+ReadHotKeys(
+    const std::string& path, const size_t num_tables,
+    const size_t max_keys_per_table,
+    std::vector<std::vector<long long>>* hot_keys, std::string* error)
+{
+  std::ifstream file(path);
+  if (!file) {
+    *error = "failed to open hot key file " + path;
+    return false;
+  }
+
+  std::vector<std::vector<HotKey>> entries(num_tables);
+  std::string line;
+  for (size_t line_number = 1; std::getline(file, line); ++line_number) {
+    std::istringstream fields(line);
+    long long table;
+    HotKey entry{0, 0};
+    if (!(fields >> table)) {
+      if (fields.eof() || line[line.find_first_not_of(" \t")] == '#') {
+        continue;
+      }
+    } else if (fields >> entry.key) {
+      if (!(fields >> entry.count)) {
+        entry.count = 0;
+        fields.clear();
+      }
+      std::string rest;
+      if (!(fields >> rest) && table >= 0 &&
+          static_cast<size_t>(table) < num_tables) {
+        entries[table].push_back(entry);
+        continue;
+      }
+    }
+    *error = "malformed entry in line " + std::to_string(line_number) +
+             " of hot key file " + path + ": " + line;
+    return false;
+  }
+
+  hot_keys->assign(num_tables, {});
+  for (size_t t = 0; t < num_tables; ++t) {
+    std::stable_sort(
+        entries[t].begin(), entries[t].end(),
+        [](const HotKey& a, const HotKey& b) { return a.count > b.count; });
+    std::unordered_set<long long> seen;
+    for (const HotKey& entry : entries[t]) {
+      if (max_keys_per_table > 0 && seen.size() == max_keys_per_table) {
+        break;
+      }
+      if (seen.insert(entry.key).second) {
+        (*hot_keys)[t].push_back(entry.key);
+      }
+    }
+  }
+  return true;
+}
+
+// Write the hot keys of each embedding table with their counts to 'path', in
+// the format read by ReadHotKeys. The file is written next to 'path' first
+// and then moved into place, so that readers never see a partial file.
+// Returns false and describes the problem in 'error' if it cannot be written.
+inline bool
+WriteHotKeys(
+    const std::string& path, const std::vector<std::vector<HotKey>>& hot_keys,
+    std::string* error)
+{
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream file(tmp_path);
+    file << "# <table> <key> <count>\n";
+    for (size_t t = 0; t < hot_keys.size(); ++t) {
+      for (const HotKey& entry : hot_keys[t]) {
+        file << t << ' ' << entry.key << ' ' << entry.count << '\n';
+      }
+    }
+    if (!file.flush()) {
+      *error = "failed to write hot key file " + tmp_path;
+      return false;
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    *error = "failed to move hot key file " + tmp_path + " to " + path;
+    return false;
+  }
+  return true;
+}
+
+}}}  // namespace triton::backend::hps
@@ -30,10 +30,12 @@
 
 #include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <new>
 #include <sstream>
 #include <thread>
 #include <triton_helpers.hpp>
@@ -47,7 +49,8 @@ namespace triton { namespace backend { namespace hps {
 // A general backend completes execution of the
 // inference before returning from TRITONBACKED_ModelInstanceExecute.
 
-// Memory type that HugeCTR model support for buffer
+// Memory type that HugeCTR model support for buffer. CPU memory is pageable
+// and allocated without CUDA, so that it can be used on hosts without GPUs.
 enum class MemoryType_t { GPU, CPU, PIN };
 
 
@@ -116,6 +119,11 @@ class CudaAllocator {
     void* ptr;
     if (type_ == MemoryType_t::GPU) {
       CK_CUDA_THROW_(cudaMalloc(&ptr, size));
+    } else if (type_ == MemoryType_t::CPU) {
+      ptr = std::malloc(size);
+      if (ptr == nullptr) {
+        throw std::bad_alloc();
+      }
     } else {
       CK_CUDA_THROW_(cudaMallocHost(&ptr, size));
     }
@@ -126,6 +134,8 @@ class CudaAllocator {
   {
     if (type_ == MemoryType_t::GPU) {
       CK_CUDA_THROW_(cudaFree(ptr));
+    } else if (type_ == MemoryType_t::CPU) {
+      std::free(ptr);
     } else {
       CK_CUDA_THROW_(cudaFreeHost(ptr));
     }
@@ -135,6 +145,20 @@ class CudaAllocator {
   MemoryType_t type_;
 };
 
+// Copy host memory to memory of the given type. Copies between host buffers
+// do not go through CUDA, so that they also work on hosts without GPUs.
+inline void
+CopyFromHost(
+    void* dst, const TRITONSERVER_MemoryType dst_memory_type, const void* src,
+    const size_t byte_size)
+{
+  if (dst_memory_type == TRITONSERVER_MEMORY_GPU) {
+    CK_CUDA_THROW_(cudaMemcpy(dst, src, byte_size, cudaMemcpyHostToDevice));
+  } else {
+    std::memcpy(dst, src, byte_size);
+  }
+}
+
 //
 // HugeCTRBUffer
 //
@@ -0,0 +1,102 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+namespace triton { namespace backend { namespace hps {
+
+//
+// LatencyHistogram
+//
+// Lock-free histogram of durations with power-of-two microsecond buckets.
+// Bucket i counts durations in [2^(i-1), 2^i) us; bucket 0 counts everything
+// below 1 us.
+//
+class LatencyHistogram {
+ public:
+  static constexpr size_t num_buckets = 32;
+
+  void record(const uint64_t duration_ns)
+  {
+    const uint64_t duration_us = duration_ns / 1000;
+    size_t bucket = 0;
+    if (duration_us != 0) {
+      bucket = std::min<size_t>(
+          64 - __builtin_clzll(duration_us), num_buckets - 1);
+    }
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    total_ns_.fetch_add(duration_ns, std::memory_order_relaxed);
+  }
+
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+  uint64_t total_ns() const
+  {
+    return total_ns_.load(std::memory_order_relaxed);
+  }
+
+  // Upper bound (in us) of the bucket that contains the given quantile.
+  uint64_t quantile_us(const double q) const
+  {
+    const uint64_t target = static_cast<uint64_t>(q * count());
+    uint64_t seen = 0;
+    for (size_t i = 0; i < num_buckets; ++i) {
+      seen += buckets_[i].load(std::memory_order_relaxed);
+      if (seen > target) {
+        return uint64_t{1} << i;
+      }
+    }
+    return uint64_t{1} << (num_buckets - 1);
+  }
+
+  std::string to_string() const
+  {
+    const uint64_t n = count();
+    std::stringstream ss;
+    ss << "count = " << n;
+    if (n != 0) {
+      ss << ", mean = " << total_ns() / n / 1000 << " us"
+         << ", p50 < " << quantile_us(0.5) << " us"
+         << ", p90 < " << quantile_us(0.9) << " us"
+         << ", p99 < " << quantile_us(0.99) << " us";
+    }
+    return ss.str();
+  }
+
+ private:
+  std::array<std::atomic<uint64_t>, num_buckets> buckets_{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> total_ns_{0};
+};
+
+}}}  // namespace triton::backend::hps
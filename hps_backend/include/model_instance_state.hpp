@@ -26,16 +26,22 @@
 
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstdlib>
+#include <embedding_kernels.hpp>
+#include <exception>
 #include <fstream>
 #include <hps/embedding_cache_base.hpp>
 #include <hps/inference_utils.hpp>
 #include <hps/lookup_session_base.hpp>
 #include <hps_buffer.hpp>
+#include <latency_histogram.hpp>
 #include <map>
 #include <memory>
 #include <model_state.hpp>
 #include <mutex>
+#include <reduced_precision.hpp>
 #include <sstream>
 #include <thread>
 #include <triton_helpers.hpp>
@@ -51,6 +57,15 @@ namespace triton { namespace backend { namespace hps {
 //
 class ModelInstanceState {
  public:
+  // Output of one embedding table of the request currently being executed.
+  // The name is null if the output was not requested.
+  struct TableOutput {
+    const char* name = nullptr;
+    void* buffer = nullptr;
+    TRITONSERVER_MemoryType memory_type = TRITONSERVER_MEMORY_CPU;
+    int64_t memory_type_id = 0;
+  };
+
   static TRITONSERVER_Error* Create(
       ModelState* model_state,
       TRITONBACKEND_ModelInstance* triton_model_instance,
@@ -73,12 +88,126 @@ class ModelInstanceState {
   // Get the state of the model that corresponds to this instance.
   ModelState* StateForModel() const { return model_state_; }
 
-  // Get the prediction result that corresponds to this instance.
-  TRITONSERVER_Error* ProcessRequest(std::vector<size_t> num_keys_per_table);
+  // Get the prediction result that corresponds to this instance. The
+  // embedding vectors are written to 'output' if given, which must be device
+  // memory of this instance, and to the lookup result buffer otherwise.
+  TRITONSERVER_Error* ProcessRequest(
+      const std::vector<size_t>& num_keys_per_table, float* output = nullptr);
+
+  // Look up each distinct key of a table only once, and expand the embedding
+  // vectors into the output buffer afterwards.
+  TRITONSERVER_Error* ProcessRequestDeduplicated(
+      const std::vector<size_t>& num_keys_per_table, void* output_buffer,
+      TRITONSERVER_MemoryType output_memory_type);
+
+  // Stage the keys of the request in the key buffer. 32 bit keys are widened
+  // to the 64 bit keys of the parameter server.
+  TRITONSERVER_Error* StageKeys(const void* keys, size_t num_keys);
+
+  // Gather all buffers of the KEYS input into the key buffer one after
+  // another, and return the number of keys.
+  TRITONSERVER_Error* GatherKeys(
+      TRITONBACKEND_Input* keys_input, uint32_t buffer_count,
+      size_t* num_keys);
+
+  // Gather all buffers of an INT32 input, such as NUMKEYS or OFFSETS, into
+  // 'values'.
+  static TRITONSERVER_Error* GatherInt32Input(
+      TRITONBACKEND_Input* input, uint32_t buffer_count,
+      std::vector<int32_t>* values);
+
+  // Count the staged keys in the key frequency sketches of their embedding
+  // tables.
+  void RecordKeyFrequencies(const std::vector<size_t>& num_keys_per_table);
+
+  // Queue the staged keys to be prefetched into the embedding caches.
+  void Prefetch(const std::vector<size_t>& num_keys_per_table);
+
+  // Count the staged keys that had been prefetched.
+  void RecordPrefetchHits(const std::vector<size_t>& num_keys_per_table);
+
+  // Validate the NUMKEYS input of the request, which holds the number of keys
+  // of each table for every sample, and stage the number of keys per table
+  // and the per-sample key offsets. A request with one number of keys per
+  // table counts as a single sample.
+  TRITONSERVER_Error* StageNumKeys(
+      const int32_t* num_keys, size_t count, size_t num_request_keys,
+      size_t* num_samples);
+
+  // Validate the per-sample key offsets of the request, which hold
+  // 'num_samples' + 1 offsets into the keys of each table, and stage them in
+  // place of those derived from NUMKEYS.
+  TRITONSERVER_Error* StageSampleOffsets(
+      const int32_t* offsets, size_t num_offsets,
+      const std::vector<size_t>& num_keys_per_table, size_t* num_samples);
+
+  // Offsets of the output rows of each sample in every table, which are the
+  // staged key offsets for tables that are not pooled.
+  const std::vector<int32_t>& RowSplits(size_t num_samples);
+
+  // Number of output rows of an embedding table, which is the number of
+  // samples for pooled tables and the number of keys for the others.
+  size_t OutputRows(
+      size_t table, const std::vector<size_t>& num_keys_per_table,
+      size_t num_samples) const;
+
+  // Number of output values of a request, with one embedding vector per
+  // sample for pooled tables and one per key for the others.
+  size_t PooledOutputSize(
+      const std::vector<size_t>& num_keys_per_table, size_t num_samples) const;
+
+  // Look up the embedding vectors of the request, and combine those of each
+  // sample in the pooled tables into the output buffer. GPU instances pool on
+  // their device, and CPU instances on the host.
+  TRITONSERVER_Error* ProcessRequestPooled(
+      const std::vector<size_t>& num_keys_per_table, size_t num_samples,
+      void* output_buffer, TRITONSERVER_MemoryType output_memory_type,
+      int64_t output_memory_type_id);
+
+  // Look up the embedding vectors of the request, and narrow them to the FP16
+  // or BF16 output buffer, on the device of GPU instances and on the host of
+  // CPU instances.
+  TRITONSERVER_Error* ProcessRequestReduced(
+      const std::vector<size_t>& num_keys_per_table, size_t num_samples,
+      void* output_buffer, TRITONSERVER_MemoryType output_memory_type,
+      int64_t output_memory_type_id);
+
+  // Look up the embedding vectors of the request into the output of each
+  // embedding table. Tables whose output is device memory of this instance
+  // are looked up straight into it.
+  TRITONSERVER_Error* ProcessRequestPerTable(
+      const std::vector<size_t>& num_keys_per_table, size_t num_samples);
+
+  // Whether embedding vectors can be written straight into an output buffer
+  // of the given memory type, instead of being copied from the lookup result
+  // buffer.
+  bool CanLookupInto(
+      TRITONSERVER_MemoryType memory_type, int64_t memory_type_id) const
+  {
+    if (kind_ == TRITONSERVER_INSTANCEGROUPKIND_CPU) {
+      return memory_type != TRITONSERVER_MEMORY_GPU;
+    }
+    return memory_type == TRITONSERVER_MEMORY_GPU &&
+           memory_type_id == device_id_;
+  }
+
+  // Copy part of the lookup result buffer, which is host memory for CPU
+  // instances and device memory otherwise, to memory of the given type.
+  void CopyLookupResult(
+      void* dst, TRITONSERVER_MemoryType dst_memory_type, const void* src,
+      size_t byte_size) const;
 
   // Create Embedding_cache
   TRITONSERVER_Error* LoadHPSInstance();
 
+  // Record the time spent staging keys, looking up and copying outputs.
+  void RecordPhaseLatencies(
+      uint64_t exec_start_ns, uint64_t compute_start_ns,
+      uint64_t compute_end_ns, uint64_t exec_end_ns);
+
+  // Log the latency distribution of each execution phase.
+  void LogPhaseLatencies(TRITONSERVER_LogLevel level) const;
+
 
   std::shared_ptr<HugeCTRBuffer<long long>> GetCatColBuffer_int64()
   {
@@ -92,7 +221,29 @@ class ModelInstanceState {
     return lookup_result_buf;
   }
 
-  HugeCTR::InferenceParams GetModelConfigutation() { return instance_params_; }
+  const HugeCTR::InferenceParams& GetModelConfigutation() const
+  {
+    return instance_params_;
+  }
+
+  const std::vector<size_t>& EmbeddingVecsizePerTable() const
+  {
+    return instance_params_.embedding_vecsize_per_table;
+  }
+
+  // Response objects of the requests currently being executed.
+  std::vector<TRITONBACKEND_Response*>& Responses() { return responses_; }
+
+  // Number of keys per table of the request currently being executed.
+  std::vector<size_t>& NumKeysPerTable() { return num_keys_per_table_; }
+
+  // Outputs of the embedding tables of the request currently being executed.
+  std::vector<TableOutput>& TableOutputs() { return table_outputs_; }
+
+  // Gathered NUMKEYS and OFFSETS inputs of the request currently being
+  // executed.
+  std::vector<int32_t>& NumKeysInput() { return numkeys_input_; }
+  std::vector<int32_t>& OffsetsInput() { return offsets_input_; }
 
  private:
   ModelInstanceState(
@@ -101,6 +252,73 @@ class ModelInstanceState {
       const TRITONSERVER_InstanceGroupKind kind, const int32_t device_id,
       HugeCTR::InferenceParams instance_params);
 
+  // Keys of one table that a thread of a CPU instance looks up at once.
+  struct HostLookupChunk {
+    size_t table;
+    size_t begin;
+    size_t num_keys;
+  };
+
+  // Keys of a chunk that missed the host embedding cache, their positions in
+  // the chunk and their embedding vectors. Each worker thread has its own.
+  struct HostCacheMisses {
+    std::vector<long long> keys;
+    std::vector<size_t> positions;
+    std::vector<float> vectors;
+  };
+
+  // Look up the keys of each table into the lookup buffer offsets, with the
+  // lookup session on GPU instances and from the host-side tiers of the
+  // parameter server on CPU instances.
+  void Lookup(const std::vector<size_t>& num_keys_per_table);
+  void LookupOnHost(const std::vector<size_t>& num_keys_per_table);
+
+  // Start and stop the worker threads that help looking up the keys of a
+  // request on a CPU instance.
+  void StartHostLookupWorkers();
+  void StopHostLookupWorkers();
+
+  // Body of the host lookup worker with the given index, which is at least 1.
+  void RunHostLookupWorker(size_t worker);
+
+  // Take chunks of the current request until all are taken, and look them up
+  // with the cache misses of the given worker. The execute thread is worker 0.
+  void LookupHostChunks(size_t worker);
+
+  // Look up the keys of a chunk in the host embedding cache of their table,
+  // if there is one, and the keys that miss it in the parameter server.
+  void LookupChunkOnHost(
+      const HostLookupChunk& chunk,
+      HugeCTR::HierParameterServerBase* parameter_server,
+      HostCacheMisses* misses);
+
+  // Look up the embedding vectors of the request on a GPU instance, and pool
+  // them on its device into 'pooled', which is device memory of this
+  // instance.
+  TRITONSERVER_Error* PoolOnDevice(
+      const std::vector<size_t>& num_keys_per_table, size_t num_samples,
+      float* pooled);
+
+  // Look up the embedding vectors of all tables of the request, pooled and
+  // deduplicated as configured. 'vectors' points to them in the lookup
+  // memory of the instance, which is device memory for GPU instances and
+  // host memory for CPU instances.
+  TRITONSERVER_Error* LookupVectors(
+      const std::vector<size_t>& num_keys_per_table, size_t num_samples,
+      const float** vectors);
+
+  // Write embedding vectors from the lookup memory of the instance to an
+  // output buffer, narrowed to the output datatype of the model.
+  TRITONSERVER_Error* WriteVectors(
+      void* dst, TRITONSERVER_MemoryType dst_memory_type,
+      int64_t dst_memory_type_id, const float* vectors, size_t num_values);
+
+  // Move the distinct keys to the front of 'keys' in order of appearance, and
+  // record the position of each key among them in 'inverse_index'. Returns
+  // the number of distinct keys.
+  size_t DeduplicateKeys(
+      long long* keys, size_t num_keys, uint32_t* inverse_index);
+
   ModelState* model_state_;
   TRITONBACKEND_ModelInstance* triton_model_instance_;
   const std::string name_;
@@ -113,9 +331,65 @@ class ModelInstanceState {
   std::shared_ptr<HugeCTRBuffer<long long>> cat_column_index_buf_int64;
   std::shared_ptr<HugeCTRBuffer<int>> row_ptr_buf;
   std::shared_ptr<HugeCTRBuffer<float>> lookup_result_buf;
+  // Per-sample key offsets and pooled vectors of GPU instances that pool.
+  std::shared_ptr<HugeCTRBuffer<int>> sample_offsets_buf;
+  std::shared_ptr<HugeCTRBuffer<float>> pooled_result_buf;
+  // Narrowed vectors of GPU instances with FP16 or BF16 outputs.
+  std::shared_ptr<HugeCTRBuffer<uint16_t>> reduced_result_buf;
   std::shared_ptr<HugeCTR::EmbeddingCacheBase> embedding_cache;
   HugeCTR::InferenceParams instance_params_;
   std::shared_ptr<HugeCTR::LookupSessionBase> lookupsession_;
+
+  // Scratch space of the execute path. These only grow, so that requests do
+  // not allocate once the largest request shape has been seen.
+  std::vector<TRITONBACKEND_Response*> responses_;
+  std::vector<size_t> num_keys_per_table_;
+  std::vector<const void*> keys_per_table_;
+  std::vector<float*> lookup_buffer_offset_per_table_;
+  std::vector<TableOutput> table_outputs_;
+  std::vector<int32_t> numkeys_input_;
+  std::vector<int32_t> offsets_input_;
+  std::vector<float> table_vectors_;
+  std::vector<uint16_t> reduced_vectors_;
+
+  // Chunks of the keys of the request being executed on a CPU instance.
+  static constexpr size_t kHostLookupChunkSize = 4096;
+  std::vector<HostLookupChunk> host_lookup_chunks_;
+  std::atomic<size_t> next_host_lookup_chunk_{0};
+
+  // Worker threads of a CPU instance, which live as long as the instance. The
+  // execute thread bumps the generation to hand the chunks of a request to
+  // the first 'host_lookup_helpers_' workers, and waits until all of them are
+  // done. Every worker, and the execute thread, reuses its own cache misses.
+  std::vector<std::thread> host_lookup_workers_;
+  std::vector<HostCacheMisses> host_cache_misses_;
+  std::mutex host_lookup_mutex_;
+  std::condition_variable host_lookup_start_;
+  std::condition_variable host_lookup_done_;
+  uint64_t host_lookup_generation_ = 0;
+  size_t host_lookup_helpers_ = 0;
+  size_t host_lookup_pending_ = 0;
+  bool host_lookup_stop_ = false;
+  std::exception_ptr host_lookup_error_;
+  HugeCTR::HierParameterServerBase* host_parameter_server_ = nullptr;
+
+  // Scratch space of in-batch key deduplication.
+  std::vector<size_t> num_unique_keys_per_table_;
+  std::vector<uint32_t> inverse_index_;
+  std::vector<uint32_t> dedup_slots_;
+  std::vector<float> unique_vectors_;
+  std::vector<float> expanded_vectors_;
+
+  // Scratch space of per-sample pooling.
+  std::vector<int32_t> sample_offsets_;
+  std::vector<float> lookup_vectors_;
+  std::vector<float> pooled_vectors_;
+  std::vector<int32_t> row_splits_;
+
+  // Per-phase latency distributions of the requests served by this instance.
+  LatencyHistogram input_latency_;
+  LatencyHistogram lookup_latency_;
+  LatencyHistogram output_latency_;
 };
 
 }}}  // namespace triton::backend::hps
\ No newline at end of file
@@ -25,14 +25,19 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <algorithm>
+#include <condition_variable>
 #include <cstdlib>
+#include <embedding_kernels.hpp>
 #include <fstream>
 #include <hps/embedding_cache_base.hpp>
 #include <hps/hier_parameter_server_base.hpp>
 #include <hps/inference_utils.hpp>
+#include <host_embedding_cache.hpp>
+#include <key_frequency_sketch.hpp>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <prefetch_tracker.hpp>
 #include <sstream>
 #include <thread>
 #include <triton_helpers.hpp>
@@ -40,6 +45,12 @@
 
 namespace triton { namespace backend { namespace hps {
 
+// Name of the optional output with the offsets of the output rows of each
+// sample in every embedding table.
+inline constexpr char kRowSplitsOutput[] = "ROW_SPLITS";
+
+class HPSBackend;
+
 //
 // ModelState
 //
@@ -83,7 +94,68 @@ class ModelState {
   }
 
   // Get input data entry map
-  std::map<std::string, size_t> GetInputmap() { return input_map_; }
+  const std::map<std::string, size_t, std::less<>>& GetInputmap() const
+  {
+    return input_map_;
+  }
+
+  // Get the embedding table of each output named after an embedding table,
+  // which is empty if all tables share one output.
+  const std::map<std::string, size_t, std::less<>>& GetTableOutputmap() const
+  {
+    return table_output_map_;
+  }
+
+  // Whether each embedding table is returned in its own output.
+  bool PerTableOutputs() const { return !table_output_map_.empty(); }
+
+  // Get the datatype of the keys, which is INT64 or INT32.
+  TRITONSERVER_DataType KeyDataType() const { return key_data_type_; }
+
+  // Get the datatype of the embedding vectors in the outputs, which is FP32,
+  // FP16 or BF16.
+  TRITONSERVER_DataType VectorDataType() const { return vector_data_type_; }
+
+  // Number of threads with which a CPU instance looks up the keys of a
+  // request.
+  size_t CPULookupThreads() const { return cpu_lookup_threads_; }
+
+  // Whether the model accepts prefetch requests.
+  bool Prefetching() const { return prefetch_queue_size_ > 0; }
+
+  // Queue the keys of a prefetch request, which are laid out table by table,
+  // to be loaded into the embedding caches in the background. Prefetches are
+  // dropped while the queue is full.
+  void Prefetch(
+      const long long* keys, const std::vector<size_t>& num_keys_per_table);
+
+  // Count the keys of an embedding table that are looked up after they were
+  // prefetched.
+  void RecordPrefetchHits(size_t table, const long long* keys, size_t num_keys);
+
+  // Create the counters of the enabled features, labeled with the name and
+  // version of the model.
+  void CreateMetrics(HPSBackend* backend);
+
+  // Get the host embedding cache of an embedding table, through which CPU
+  // instances look up the parameter server, or nullptr if there is none.
+  HostEmbeddingCache* GetHostEmbeddingCache(const size_t table) const
+  {
+    return table < host_embedding_caches_.size()
+               ? host_embedding_caches_[table].get()
+               : nullptr;
+  }
+
+  // Whether the frequencies of the keys looked up in each embedding table
+  // are tracked.
+  bool TracksKeyFrequencies() const { return !key_frequency_sketches_.empty(); }
+
+  // Count the keys looked up in an embedding table.
+  void RecordKeyFrequencies(
+      const size_t table, const long long* keys, const size_t num_keys)
+  {
+    key_frequency_sketches_[table]->Add(keys, num_keys);
+  }
 
   // Get the HugeCTR cache size percentage.
   float CacheSizePer() const { return cache_size_per; }
@@ -94,6 +166,23 @@ class ModelState {
   // Support mixed_precision for inference.
   bool MixedPrecision() const { return use_mixed_precision_; }
 
+  // Deduplicate the keys of each table within a request before the lookup.
+  bool KeyDeduplication() const { return key_deduplication_; }
+
+  // Get the combiner of each embedding table, which is empty if no table is
+  // pooled.
+  const std::vector<Combiner>& CombinerPerTable() const
+  {
+    return combiner_per_table_;
+  }
+
+  // Whether the embedding vectors of some table are pooled per sample.
+  bool PoolEmbeddings() const { return !combiner_per_table_.empty(); }
+
+  // Whether requests carry the per-sample key offsets of each table in the
+  // OFFSETS input.
+  bool HasOffsetsInput() const { return has_offsets_input_; }
+
   // Get the current HugeCTR model original json config.
   const std::string& HugeCTRJsonConfig() { return hugectr_config_; }
 
@@ -117,6 +206,11 @@ class ModelState {
   // Create Embedding_cache
   TRITONSERVER_Error* Create_EmbeddingCache();
 
+  // Insert the embeddings of the hot keys into the embedding cache of a
+  // device, so that the first requests do not pay for the cache misses.
+  TRITONSERVER_Error* WarmUpEmbeddingCache(
+      int64_t device_id, const std::vector<std::vector<long long>>& hot_keys);
+
   // Refresh embedding cache periodically
   void Refresh_Embedding_Cache();
 
@@ -131,6 +225,20 @@ class ModelState {
   HugeCTR::InferenceParams ModelInferencePara() { return Model_Inference_Para; }
 
  private:
+  // Keys of a prefetch request, laid out table by table.
+  struct PrefetchBatch {
+    std::vector<long long> keys;
+    std::vector<size_t> num_keys_per_table;
+  };
+
+  // Number of keys of each embedding table that are looked up in the
+  // embedding cache at once, which is as many as a request can have.
+  std::vector<size_t> CacheLookupBatchSizes() const;
+
+  // Load the queued prefetches into the embedding caches until the model is
+  // unloaded.
+  void PrefetchLoop();
+
   ModelState(
       TRITONSERVER_Server* triton_server, TRITONBACKEND_Model* triton_model,
       const char* name, const uint64_t version, uint64_t version_ps,
@@ -162,6 +270,38 @@ class ModelState {
   bool support_int64_key_ = true;
   bool support_gpu_cache_ = true;
   bool use_mixed_precision_ = false;
+  bool key_deduplication_ = false;
+  bool has_offsets_input_ = false;
+  bool has_cpu_instances_ = false;
+  size_t cpu_lookup_threads_ = 4;
+  size_t host_cache_size_ = 0;
+  int64_t host_cache_ttl_ms_ = 60000;
+  std::vector<std::unique_ptr<HostEmbeddingCache>> host_embedding_caches_;
+  size_t prefetch_queue_size_ = 0;
+  // Ring of queued prefetches. Queued batches are swapped with the one the
+  // prefetch loop is done with, so that their buffers are reused.
+  std::vector<PrefetchBatch> prefetch_queue_;
+  size_t prefetch_queue_head_ = 0;
+  size_t num_queued_prefetches_ = 0;
+  size_t num_queued_prefetch_keys_ = 0;
+  bool stop_prefetching_ = false;
+  std::mutex prefetch_mutex_;
+  std::condition_variable prefetch_cv_;
+  std::thread prefetch_thread_;
+  std::unique_ptr<PrefetchTracker> prefetch_tracker_;
+  TRITONSERVER_Metric* prefetch_requests_metric_ = nullptr;
+  TRITONSERVER_Metric* prefetch_dropped_metric_ = nullptr;
+  TRITONSERVER_Metric* prefetched_keys_metric_ = nullptr;
+  TRITONSERVER_Metric* prefetch_hits_metric_ = nullptr;
+  std::string hot_key_file_;
+  size_t max_hot_keys_per_table_ = 0;
+  size_t key_frequency_sketch_size_ = 0;
+  size_t tracked_hot_keys_per_table_ = 1024;
+  std::string key_frequency_snapshot_;
+  std::vector<std::unique_ptr<KeyFrequencySketch>> key_frequency_sketches_;
+  TRITONSERVER_DataType key_data_type_ = TRITONSERVER_TYPE_INT64;
+  TRITONSERVER_DataType vector_data_type_ = TRITONSERVER_TYPE_FP32;
+  std::vector<Combiner> combiner_per_table_;
 
   std::shared_ptr<HugeCTR::HierParameterServerBase> EmbeddingTable_int64;
   HugeCTR::InferenceParams Model_Inference_Para;
@@ -169,7 +309,9 @@ class ModelState {
   std::map<int64_t, std::shared_ptr<HugeCTR::EmbeddingCacheBase>>
       embedding_cache_map;
 
-  std::map<std::string, size_t> input_map_{{"KEYS", 0}, {"NUMKEYS", 1}};
+  std::map<std::string, size_t, std::less<>> input_map_{
+      {"KEYS", 0}, {"NUMKEYS", 1}, {"OFFSETS", 2}};
+  std::map<std::string, size_t, std::less<>> table_output_map_;
 };
 
 
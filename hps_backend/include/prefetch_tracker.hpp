@@ -0,0 +1,101 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace triton { namespace backend { namespace hps {
+
+//
+// PrefetchTracker
+//
+// Remembers which keys were prefetched, to tell how many of them are looked
+// up afterwards. A key is tracked by a 64-bit fingerprint of its table and
+// value in a direct-mapped table, where a newer prefetch replaces whatever
+// occupied its slot. Lookups consume the fingerprints they find, so that
+// each prefetch counts at most once. All operations are lock-free.
+//
+class PrefetchTracker {
+ public:
+  // A tracker of at least 'capacity' slots.
+  explicit PrefetchTracker(const size_t capacity)
+  {
+    size_t num_slots = 1;
+    while (num_slots < capacity) {
+      num_slots *= 2;
+    }
+    slot_mask_ = num_slots - 1;
+    slots_.reset(new std::atomic<uint64_t>[num_slots]);
+    for (size_t s = 0; s < num_slots; ++s) {
+      slots_[s].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // Remember that 'key' of embedding table 'table' was prefetched.
+  void mark(const size_t table, const long long key)
+  {
+    const uint64_t fingerprint = Fingerprint(table, key);
+    slots_[fingerprint & slot_mask_].store(
+        fingerprint, std::memory_order_relaxed);
+  }
+
+  // Count the keys of embedding table 'table' that were prefetched since
+  // they were last looked up.
+  size_t consume(
+      const size_t table, const long long* const keys, const size_t num_keys)
+  {
+    size_t num_prefetched = 0;
+    for (size_t i = 0; i < num_keys; ++i) {
+      uint64_t fingerprint = Fingerprint(table, keys[i]);
+      std::atomic<uint64_t>& slot = slots_[fingerprint & slot_mask_];
+      if (slot.load(std::memory_order_relaxed) == fingerprint &&
+          slot.compare_exchange_strong(
+              fingerprint, 0, std::memory_order_relaxed)) {
+        ++num_prefetched;
+      }
+    }
+    return num_prefetched;
+  }
+
+ private:
+  // Mixes table and key with the finalizer of SplitMix64. Fingerprints are
+  // never 0, which marks empty slots.
+  static uint64_t Fingerprint(const size_t table, const long long key)
+  {
+    uint64_t h = static_cast<uint64_t>(key) + table * 0x9E3779B97F4A7C15ULL;
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    return (h ^ (h >> 31)) | 1;
+  }
+
+  size_t slot_mask_;
+  std::unique_ptr<std::atomic<uint64_t>[]> slots_;
+};
+
+}}}  // namespace triton::backend::hps
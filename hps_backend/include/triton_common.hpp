@@ -25,6 +25,7 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
 
+#include <cstdint>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -32,9 +33,22 @@
 namespace triton { namespace backend { namespace hps {
 
 /**
- * CPP style concats arguments to Triton log entry.
+ * Log levels compiled into the backend. Verbose log entries are compiled out
+ * if HPS_TRITON_DISABLE_VERBOSE_LOG is defined.
  */
-#define HPS_TRITON_LOG(LEVEL, ...)                                      \
+#define HPS_TRITON_LOG_COMPILED_INFO true
+#define HPS_TRITON_LOG_COMPILED_WARN true
+#define HPS_TRITON_LOG_COMPILED_ERROR true
+#ifdef HPS_TRITON_DISABLE_VERBOSE_LOG
+#define HPS_TRITON_LOG_COMPILED_VERBOSE false
+#else
+#define HPS_TRITON_LOG_COMPILED_VERBOSE true
+#endif
+
+/**
+ * Pass a message built by concatenating the arguments to the Triton log.
+ */
+#define HPS_TRITON_LOG_MESSAGE(LEVEL, ...)                              \
   do {                                                                  \
     const std::string& msg = hps_str_concat(__VA_ARGS__);               \
     LOG_IF_ERROR(                                                       \
@@ -43,6 +57,33 @@ namespace triton { namespace backend { namespace hps {
         ("failed to log message: "));                                   \
   } while (0)
 
+/**
+ * CPP style concats arguments to Triton log entry. The message is only built
+ * if the log level is compiled in and enabled.
+ */
+#define HPS_TRITON_LOG(LEVEL, ...)                             \
+  do {                                                         \
+    if (HPS_TRITON_LOG_COMPILED_##LEVEL &&                     \
+        TRITONSERVER_LogIsEnabled(TRITONSERVER_LOG_##LEVEL)) { \
+      HPS_TRITON_LOG_MESSAGE(LEVEL, __VA_ARGS__);              \
+    }                                                          \
+  } while (0)
+
+/**
+ * Like HPS_TRITON_LOG, but only logs the first and then every N-th time that
+ * a thread gets here. Meant for log entries on the request path.
+ */
+#define HPS_TRITON_LOG_EVERY_N(LEVEL, N, ...)                  \
+  do {                                                         \
+    if (HPS_TRITON_LOG_COMPILED_##LEVEL &&                     \
+        TRITONSERVER_LogIsEnabled(TRITONSERVER_LOG_##LEVEL)) { \
+      static thread_local uint64_t hps_log_occurrences = 0;    \
+      if (hps_log_occurrences++ % (N) == 0) {                  \
+        HPS_TRITON_LOG_MESSAGE(LEVEL, __VA_ARGS__);            \
+      }                                                        \
+    }                                                          \
+  } while (0)
+
 /**
  * CPP style concats arguments to create a Triton error object.
  */
@@ -268,4 +309,4 @@ hps_str_split(const std::string& string, const char separator)
   return parts;
 }
 
-}}}  // namespace triton::backend::hps
\ No newline at end of file
+}}}  // namespace triton::backend::hps
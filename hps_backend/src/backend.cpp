@@ -511,6 +511,39 @@ HPSBackend::ParseParameterServer(const std::string& path)
   return nullptr;
 }
 
-HPSBackend::~HPSBackend() {}
+HPSBackend::~HPSBackend()
+{
+  for (const auto& family : counter_families_) {
+    if (family.second != nullptr) {
+      LOG_IF_ERROR(
+          TRITONSERVER_MetricFamilyDelete(family.second),
+          "failed to delete metric family");
+    }
+  }
+}
+
+TRITONSERVER_MetricFamily*
+HPSBackend::CounterFamily(
+    const std::string& name, const std::string& description)
+{
+  std::lock_guard<std::mutex> lock(counter_families_mutex_);
+  const auto it = counter_families_.find(name);
+  if (it != counter_families_.end()) {
+    return it->second;
+  }
+  TRITONSERVER_MetricFamily* family = nullptr;
+  TRITONSERVER_Error* err = TRITONSERVER_MetricFamilyNew(
+      &family, TRITONSERVER_METRIC_KIND_COUNTER, name.c_str(),
+      description.c_str());
+  if (err != nullptr) {
+    HPS_TRITON_LOG(
+        WARN, "Metric ", name,
+        " is not available: ", TRITONSERVER_ErrorMessage(err));
+    TRITONSERVER_ErrorDelete(err);
+    family = nullptr;
+  }
+  counter_families_.emplace(name, family);
+  return family;
+}
 
 }}}  // namespace triton::backend::hps
\ No newline at end of file
@@ -0,0 +1,142 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cuda_bf16.h>
+#include <cuda_fp16.h>
+
+#include <algorithm>
+#include <embedding_kernels.hpp>
+
+namespace triton { namespace backend { namespace hps {
+
+namespace {
+
+// One block per sample, whose threads stride over the elements of the
+// embedding vectors, so that the reads of each key are coalesced.
+__global__ void
+PoolEmbeddingVectorsKernel(
+    const float* vectors, const int32_t* sample_offsets, const size_t ev_size,
+    const Combiner combiner, float* pooled)
+{
+  const int32_t begin = sample_offsets[blockIdx.x];
+  const int32_t end = sample_offsets[blockIdx.x + 1];
+  const int32_t num_sample_keys = end - begin;
+  // Scale the same way as the host pooling of CPU instances.
+  float scale = 1.0f;
+  if (num_sample_keys > 0 && combiner == Combiner::kMean) {
+    scale = 1.0f / num_sample_keys;
+  } else if (num_sample_keys > 0 && combiner == Combiner::kSqrtN) {
+    scale = 1.0f / sqrtf(static_cast<float>(num_sample_keys));
+  }
+
+  float* const output = pooled + blockIdx.x * ev_size;
+  for (size_t i = threadIdx.x; i < ev_size; i += blockDim.x) {
+    float sum = 0.0f;
+    for (int32_t k = begin; k < end; ++k) {
+      sum += vectors[k * ev_size + i];
+    }
+    output[i] = sum * scale;
+  }
+}
+
+struct ToHalf {
+  __device__ uint16_t operator()(const float value) const
+  {
+    return __half_as_ushort(__float2half_rn(value));
+  }
+};
+
+struct ToBFloat16 {
+  __device__ uint16_t operator()(const float value) const
+  {
+    return __bfloat16_as_ushort(__float2bfloat16_rn(value));
+  }
+};
+
+template <typename Convert>
+__global__ void
+NarrowKernel(
+    const float* src, uint16_t* dst, const size_t count, const Convert convert)
+{
+  for (size_t i = blockIdx.x * size_t{blockDim.x} + threadIdx.x; i < count;
+       i += gridDim.x * size_t{blockDim.x}) {
+    dst[i] = convert(src[i]);
+  }
+}
+
+template <typename Convert>
+cudaError_t
+Narrow(
+    const float* src, uint16_t* dst, const size_t count, cudaStream_t stream)
+{
+  if (count == 0) {
+    return cudaSuccess;
+  }
+  // Grid-stride loop with enough blocks to fill the device.
+  constexpr size_t kBlockSize = 256;
+  const size_t num_blocks =
+      std::min((count + kBlockSize - 1) / kBlockSize, size_t{4096});
+  NarrowKernel<<<
+      static_cast<unsigned int>(num_blocks), kBlockSize, 0, stream>>>(
+      src, dst, count, Convert());
+  return cudaGetLastError();
+}
+
+}  // namespace
+
+cudaError_t
+PoolEmbeddingVectors(
+    const float* vectors, const int32_t* sample_offsets,
+    const size_t num_samples, const size_t ev_size, const Combiner combiner,
+    float* pooled, cudaStream_t stream)
+{
+  if (num_samples == 0 || ev_size == 0) {
+    return cudaSuccess;
+  }
+  // Round the block up to whole warps, up to 256 threads.
+  const unsigned int block_size =
+      static_cast<unsigned int>(ev_size < 256 ? (ev_size + 31) / 32 * 32 : 256);
+  PoolEmbeddingVectorsKernel<<<
+      static_cast<unsigned int>(num_samples), block_size, 0, stream>>>(
+      vectors, sample_offsets, ev_size, combiner, pooled);
+  return cudaGetLastError();
+}
+
+cudaError_t
+ConvertFloatToHalfOnDevice(
+    const float* src, uint16_t* dst, const size_t count, cudaStream_t stream)
+{
+  return Narrow<ToHalf>(src, dst, count, stream);
+}
+
+cudaError_t
+ConvertFloatToBFloat16OnDevice(
+    const float* src, uint16_t* dst, const size_t count, cudaStream_t stream)
+{
+  return Narrow<ToBFloat16>(src, dst, count, stream);
+}
+
+}}}  // namespace triton::backend::hps
@@ -33,6 +33,7 @@
 #include <algorithm>
 #include <backend.hpp>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <hps/embedding_cache_base.hpp>
 #include <hps/inference_utils.hpp>
@@ -48,6 +49,114 @@
 
 namespace triton { namespace backend { namespace hps {
 
+// Whether the request sets the "prefetch" request parameter.
+static TRITONSERVER_Error*
+IsPrefetchRequest(TRITONBACKEND_Request* request, bool* prefetch)
+{
+  *prefetch = false;
+  uint32_t parameter_count = 0;
+  RETURN_IF_ERROR(
+      TRITONBACKEND_RequestParameterCount(request, &parameter_count));
+  for (uint32_t p = 0; p < parameter_count; ++p) {
+    const char* key = nullptr;
+    TRITONSERVER_ParameterType type;
+    const void* value = nullptr;
+    RETURN_IF_ERROR(
+        TRITONBACKEND_RequestParameter(request, p, &key, &type, &value));
+    if (std::strcmp(key, "prefetch") == 0) {
+      HPS_RETURN_TRITION_ERROR_IF_TRUE(
+          type != TRITONSERVER_PARAMETER_BOOL, INVALID_ARG,
+          "The prefetch request parameter must be a bool.");
+      *prefetch = *reinterpret_cast<const bool*>(value);
+    }
+  }
+  return nullptr;
+}
+
+// Queue the keys of a prefetch request to be loaded into the embedding
+// caches. NUMKEYS may be left out for models with a single embedding table.
+static TRITONSERVER_Error*
+QueuePrefetch(
+    TRITONBACKEND_Request* request, const uint32_t input_count,
+    ModelInstanceState* instance_state)
+{
+  ModelState* model_state = instance_state->StateForModel();
+  HPS_RETURN_TRITION_ERROR_IF_TRUE(
+      !model_state->Prefetching(), UNSUPPORTED, "Model ", model_state->Name(),
+      " does not accept prefetch requests, set prefetch_queue_size to enable "
+      "them.");
+
+  bool has_numkeys = false;
+  for (uint32_t i = 0; i < input_count; ++i) {
+    const char* input_name = nullptr;
+    RETURN_IF_ERROR(TRITONBACKEND_RequestInputName(request, i, &input_name));
+    if (std::strcmp(input_name, "NUMKEYS") == 0) {
+      has_numkeys = true;
+    } else {
+      HPS_RETURN_TRITION_ERROR_IF_TRUE(
+          std::strcmp(input_name, "KEYS") != 0, INVALID_ARG,
+          "Prefetch requests take the KEYS and NUMKEYS inputs only, got ",
+          input_name, ".");
+    }
+  }
+
+  TRITONBACKEND_Input* keys_input = nullptr;
+  RETURN_IF_ERROR(TRITONBACKEND_RequestInput(request, "KEYS", &keys_input));
+  uint64_t keys_byte_size = 0;
+  uint32_t keys_buffer_count = 0;
+  RETURN_IF_ERROR(TRITONBACKEND_InputProperties(
+      keys_input, nullptr /* input_name */, nullptr /* datatype */,
+      nullptr /* shape */, nullptr /* dims_count */, &keys_byte_size,
+      &keys_buffer_count));
+  HPS_RETURN_TRITION_ERROR_IF_TRUE(
+      keys_buffer_count != 1, UNSUPPORTED,
+      "Expected the keys of a prefetch request in a single buffer, got ",
+      keys_buffer_count, " buffers.");
+  const size_t num_keys =
+      keys_byte_size /
+      TRITONSERVER_DataTypeByteSize(model_state->KeyDataType());
+  const void* keys = nullptr;
+  TRITONSERVER_MemoryType memory_type = TRITONSERVER_MEMORY_CPU;
+  int64_t memory_type_id = 0;
+  RETURN_IF_ERROR(TRITONBACKEND_InputBuffer(
+      keys_input, 0, &keys, &keys_byte_size, &memory_type, &memory_type_id));
+  RETURN_IF_ERROR(instance_state->StageKeys(keys, num_keys));
+
+  std::vector<size_t>& num_keys_per_table = instance_state->NumKeysPerTable();
+  if (has_numkeys) {
+    TRITONBACKEND_Input* numkeys_input = nullptr;
+    RETURN_IF_ERROR(
+        TRITONBACKEND_RequestInput(request, "NUMKEYS", &numkeys_input));
+    uint64_t numkeys_byte_size = 0;
+    uint32_t numkeys_buffer_count = 0;
+    RETURN_IF_ERROR(TRITONBACKEND_InputProperties(
+        numkeys_input, nullptr /* input_name */, nullptr /* datatype */,
+        nullptr /* shape */, nullptr /* dims_count */, &numkeys_byte_size,
+        &numkeys_buffer_count));
+    HPS_RETURN_TRITION_ERROR_IF_TRUE(
+        numkeys_buffer_count != 1, UNSUPPORTED,
+        "Expected NUMKEYS of a prefetch request in a single buffer, got ",
+        numkeys_buffer_count, " buffers.");
+    const void* numkeys = nullptr;
+    uint64_t numkeys_buffer_byte_size = 0;
+    RETURN_IF_ERROR(TRITONBACKEND_InputBuffer(
+        numkeys_input, 0, &numkeys, &numkeys_buffer_byte_size, &memory_type,
+        &memory_type_id));
+    size_t num_samples = 0;
+    RETURN_IF_ERROR(instance_state->StageNumKeys(
+        reinterpret_cast<const int32_t*>(numkeys),
+        numkeys_byte_size / sizeof(int32_t), num_keys, &num_samples));
+  } else {
+    HPS_RETURN_TRITION_ERROR_IF_TRUE(
+        instance_state->EmbeddingVecsizePerTable().size() != 1, INVALID_ARG,
+        "Prefetch requests for models with several embedding tables need "
+        "NUMKEYS.");
+    num_keys_per_table.assign(1, num_keys);
+  }
+  instance_state->Prefetch(num_keys_per_table);
+  return nullptr;
+}
+
 extern "C" {
 
 // Implementing TRITONBACKEND_Initialize is optional. The backend
@@ -241,6 +350,7 @@ TRITONBACKEND_ModelInitialize(TRITONBACKEND_Model* model)
   // look_up. If not, returning an error from this function will prevent the
   // model from loading.
   RETURN_IF_ERROR(model_state->Create_EmbeddingCache());
+  model_state->CreateMetrics(backend_state);
 
   return nullptr;  // success
 }
@@ -367,15 +477,20 @@ TRITONBACKEND_ModelInstanceExecute(
   // from this function so that it is again available to be used for
   // another call to TRITONBACKEND_ModelInstanceExecute.
 
-  HPS_TRITON_LOG(
-      INFO, "model ", model_state->Name(), ", instance ",
+  // Per-request log entries are verbose, the execution of the instance is
+  // logged only now and then.
+  HPS_TRITON_LOG_EVERY_N(
+      INFO, 10000, "model ", model_state->Name(), ", instance ",
       instance_state->Name(), ", executing ", request_count, " requests");
 
   // 'responses' is initialized with the response objects below and
   // if/when an error response is sent the corresponding entry in
   // 'responses' is set to nullptr to indicate that that response has
   // already been sent.
-  std::vector<TRITONBACKEND_Response*> responses;
+  // The vector is owned by the instance so that it is only reallocated when
+  // a larger batch of requests comes in.
+  std::vector<TRITONBACKEND_Response*>& responses = instance_state->Responses();
+  responses.clear();
   responses.reserve(request_count);
   // Create a single response object for each request. If something
   // goes wrong when attempting to create the response objects just
@@ -388,10 +503,13 @@ TRITONBACKEND_ModelInstanceExecute(
 
   // HugeCTR model can't support concurrent prediction for all the requests,
   // which means you would execute all the requests at the same time,
-  // So here we execute each request separately so there is no single range.
-  // As a result we just show the entire execution time as being the compute
-  // time as well.
+  // So here we execute each request separately. For each request we record
+  // when execution starts, when the keys have been staged and the lookup
+  // starts, when the lookup ends and output copy starts, and when the
+  // response has been sent. The batch statistics span all requests.
   uint64_t min_exec_start_ns = std::numeric_limits<uint64_t>::max();
+  uint64_t min_compute_start_ns = std::numeric_limits<uint64_t>::max();
+  uint64_t max_compute_end_ns = 0;
   uint64_t max_exec_end_ns = 0;
   uint64_t total_batch_size = 0;
 
@@ -402,6 +520,10 @@ TRITONBACKEND_ModelInstanceExecute(
 
   for (uint32_t r = 0; r < request_count; ++r) {
     uint64_t exec_start_ns = 0;
+    SET_TIMESTAMP(exec_start_ns);
+    min_exec_start_ns = std::min(min_exec_start_ns, exec_start_ns);
+    uint64_t compute_start_ns = 0;
+    uint64_t compute_end_ns = 0;
 
     TRITONBACKEND_Request* request = requests[r];
     const char* request_id = "";
@@ -436,10 +558,45 @@ TRITONBACKEND_ModelInstanceExecute(
     }
 
     HPS_TRITON_LOG(
-        INFO, "request ", r, ": id = \"", request_id, "\"",
+        VERBOSE, "request ", r, ": id = \"", request_id, "\"",
         ", correlation_id = ", correlation_id, ", input_count = ", input_count,
         ", requested_output_count = ", requested_output_count);
 
+    // Prefetch requests are answered as soon as their keys are queued, without
+    // any output.
+    bool prefetch = false;
+    GUARDED_RESPOND_IF_ERROR(
+        responses, r, IsPrefetchRequest(request, &prefetch));
+    if (responses[r] != nullptr && prefetch) {
+      GUARDED_RESPOND_IF_ERROR(
+          responses, r, QueuePrefetch(request, input_count, instance_state));
+    }
+    if (responses[r] == nullptr) {
+      HPS_TRITON_LOG(
+          ERROR, "request ", r,
+          ": failed to queue prefetch request, error response sent");
+      continue;
+    }
+    if (prefetch) {
+      LOG_IF_ERROR(
+          TRITONBACKEND_ResponseSend(
+              responses[r], TRITONSERVER_RESPONSE_COMPLETE_FINAL,
+              nullptr /* success */),
+          "failed sending response");
+      uint64_t exec_end_ns = 0;
+      SET_TIMESTAMP(exec_end_ns);
+      max_exec_end_ns = std::max(max_exec_end_ns, exec_end_ns);
+      min_compute_start_ns = std::min(min_compute_start_ns, exec_start_ns);
+      max_compute_end_ns = std::max(max_compute_end_ns, exec_start_ns);
+      LOG_IF_ERROR(
+          TRITONBACKEND_ModelInstanceReportStatistics(
+              instance_state->TritonModelInstance(), request,
+              true /* success */, exec_start_ns, exec_start_ns, exec_start_ns,
+              exec_end_ns),
+          "failed reporting request statistics");
+      continue;
+    }
+
     const char* input_name;
     GUARDED_RESPOND_IF_ERROR(
         responses, r,
@@ -474,15 +631,47 @@ TRITONBACKEND_ModelInstanceExecute(
         TRITONBACKEND_RequestInput(
             request, numkeys_input_name, &numkeys_input));
 
+    // Requests may also carry the per-sample key offsets of each table.
+    const bool pool_embeddings = model_state->PoolEmbeddings();
+    const char offsets_input_name[] = "OFFSETS";
+    TRITONBACKEND_Input* offsets_input = nullptr;
+    if (model_state->HasOffsetsInput()) {
+      GUARDED_RESPOND_IF_ERROR(
+          responses, r,
+          TRITONBACKEND_RequestInput(
+              request, offsets_input_name, &offsets_input));
+    }
+
     // We also validated that the model configuration specifies only a
-    // single output, but the request is not required to request any
-    // output at all so we only produce an output if requested.
+    // single output of embedding vectors, or one per embedding table, besides
+    // the row splits, but the request is not required to request any output
+    // at all so we only produce an output if requested.
     const char* requested_output_name = nullptr;
-    if (requested_output_count > 0) {
+    bool row_splits_requested = false;
+    bool table_outputs_requested = false;
+    std::vector<ModelInstanceState::TableOutput>& table_outputs =
+        instance_state->TableOutputs();
+    table_outputs.assign(
+        instance_state->EmbeddingVecsizePerTable().size(),
+        ModelInstanceState::TableOutput());
+    const auto& table_output_map = model_state->GetTableOutputmap();
+    for (uint32_t o = 0; o < requested_output_count; ++o) {
+      const char* output_name = nullptr;
       GUARDED_RESPOND_IF_ERROR(
           responses, r,
-          TRITONBACKEND_RequestOutputName(
-              request, 0 /* index */, &requested_output_name));
+          TRITONBACKEND_RequestOutputName(request, o, &output_name));
+      if (output_name == nullptr) {
+        continue;
+      }
+      const auto table_output = table_output_map.find(output_name);
+      if (std::strcmp(output_name, kRowSplitsOutput) == 0) {
+        row_splits_requested = true;
+      } else if (table_output != table_output_map.end()) {
+        table_outputs[table_output->second].name = output_name;
+        table_outputs_requested = true;
+      } else {
+        requested_output_name = output_name;
+      }
     }
 
     // If an error response was sent while getting the input or
@@ -509,7 +698,7 @@ TRITONBACKEND_ModelInstanceExecute(
     uint32_t numkeys_input_buffer_count;
     int64_t num_of_samples = 0;
     int64_t numofcat;
-    std::vector<size_t> num_keys_per_table;
+    std::vector<size_t>& num_keys_per_table = instance_state->NumKeysPerTable();
 
     GUARDED_RESPOND_IF_ERROR(
         responses, r,
@@ -518,7 +707,7 @@ TRITONBACKEND_ModelInstanceExecute(
             &cat_input_shape, &cat_dims_count, &cat_byte_size,
             &cat_input_buffer_count));
     HPS_TRITON_LOG(
-        INFO, "\tinput ", catcol_input_name,
+        VERBOSE, "\tinput ", catcol_input_name,
         ": datatype = ", TRITONSERVER_DataTypeString(cat_datatype),
         ", shape = ", backend::ShapeToString(cat_input_shape, cat_dims_count),
         ", byte_size = ", cat_byte_size,
@@ -531,7 +720,7 @@ TRITONBACKEND_ModelInstanceExecute(
             &num_keys_shape, &numkeys_dims_count, &numkeys_byte_size,
             &numkeys_input_buffer_count));
     HPS_TRITON_LOG(
-        INFO, "\tinput ", numkeys_input_name,
+        VERBOSE, "\tinput ", numkeys_input_name,
         ": datatype = ", TRITONSERVER_DataTypeString(numkeys_datatype),
         ", shape = ",
         backend::ShapeToString(num_keys_shape, numkeys_dims_count),
@@ -546,7 +735,9 @@ TRITONBACKEND_ModelInstanceExecute(
       continue;
     }
 
-    HPS_TRITON_LOG(INFO, "\trequested_output ", requested_output_name);
+    if (requested_output_name != nullptr) {
+      HPS_TRITON_LOG(VERBOSE, "\trequested_output ", requested_output_name);
+    }
 
     // We only need to produce an output if it was requested.
     if (requested_output_count > 0) {
@@ -567,8 +758,14 @@ TRITONBACKEND_ModelInstanceExecute(
       // Step 1. Input should have correct size...
       TRITONBACKEND_Output* output;
 
-      numofcat = cat_byte_size / sizeof(long long);
-
+      // Step 2. Gather all buffers of the keys into the key buffer, and
+      // those of NUMKEYS and OFFSETS on the host.
+      size_t num_request_keys = 0;
+      GUARDED_RESPOND_IF_ERROR(
+          responses, r,
+          instance_state->GatherKeys(
+              catcol_input, cat_input_buffer_count, &num_request_keys));
+      numofcat = num_request_keys;
       num_of_samples = numofcat / instance_state->StateForModel()->CatNum();
       if (num_of_samples > instance_state->StateForModel()->BatchSize()) {
         GUARDED_RESPOND_IF_ERROR(
@@ -577,106 +774,251 @@ TRITONBACKEND_ModelInstanceExecute(
                 TRITONSERVER_ERROR_UNSUPPORTED,
                 "The number of Input samples greater than max batch size"));
       }
-
-
-      // Step 2. Copy all input data -> Device Buffer.
-      for (uint32_t b = 0; b < cat_input_buffer_count; ++b) {
-        TRITONSERVER_MemoryType input_memory_type = TRITONSERVER_MEMORY_GPU;
-        int64_t input_memory_type_id = 0;
-        const void* cat_buffer = nullptr;
+      std::vector<int32_t>& numkeys = instance_state->NumKeysInput();
+      GUARDED_RESPOND_IF_ERROR(
+          responses, r,
+          ModelInstanceState::GatherInt32Input(
+              numkeys_input, numkeys_input_buffer_count, &numkeys));
+      std::vector<int32_t>& offsets = instance_state->OffsetsInput();
+      if (offsets_input != nullptr) {
+        uint32_t offsets_input_buffer_count = 0;
         GUARDED_RESPOND_IF_ERROR(
             responses, r,
-            TRITONBACKEND_InputBuffer(
-                catcol_input, b, &cat_buffer, &cat_byte_size,
-                &input_memory_type, &input_memory_type_id));
-        CK_CUDA_THROW_(cudaMemcpy(
-            instance_state->GetCatColBuffer_int64()->get_raw_ptr(), cat_buffer,
-            cat_byte_size, cudaMemcpyHostToHost));
-
-        const void* numkeys_buffer = nullptr;
+            TRITONBACKEND_InputProperties(
+                offsets_input, nullptr /* input_name */, nullptr /* datatype */,
+                nullptr /* shape */, nullptr /* dims_count */,
+                nullptr /* byte_size */, &offsets_input_buffer_count));
         GUARDED_RESPOND_IF_ERROR(
             responses, r,
-            TRITONBACKEND_InputBuffer(
-                numkeys_input, b, &numkeys_buffer, &numkeys_byte_size,
-                &input_memory_type, &input_memory_type_id));
-
+            ModelInstanceState::GatherInt32Input(
+                offsets_input, offsets_input_buffer_count, &offsets));
+      }
 
-        if (responses[r] == nullptr) {
+      // Errors break out to the response check below.
+      do {
+        // Step 3. Initialize the output tensor. NUMKEYS holds the number of
+        // keys of each table either for the whole request or for every
+        // sample, and OFFSETS, if given, delimits the keys of each sample.
+        size_t num_samples = 0;
+        GUARDED_RESPOND_IF_ERROR(
+            responses, r,
+            instance_state->StageNumKeys(
+                numkeys.data(), numkeys.size(), numofcat, &num_samples));
+        if (offsets_input != nullptr) {
           GUARDED_RESPOND_IF_ERROR(
               responses, r,
-              TRITONSERVER_ErrorNew(
-                  TRITONSERVER_ERROR_UNSUPPORTED,
-                  "failed to get input buffer in GPU memory"));
+              instance_state->StageSampleOffsets(
+                  offsets.data(), offsets.size(), num_keys_per_table,
+                  &num_samples));
+        }
+        if (responses[r] == nullptr) {
+          HPS_TRITON_LOG(
+              ERROR, "request ", r,
+              ": invalid number of keys or key offsets, error response sent");
+          break;
+        }
+        if (instance_state->StateForModel()->TracksKeyFrequencies()) {
+          instance_state->RecordKeyFrequencies(num_keys_per_table);
+        }
+        if (model_state->Prefetching()) {
+          instance_state->RecordPrefetchHits(num_keys_per_table);
+        }
+        if (num_samples > 1 || offsets_input != nullptr) {
+          num_of_samples = num_samples;
         }
 
-        // Step 3. Initialize the output tensor.
-        num_keys_per_table.assign(
-            reinterpret_cast<const int*>(numkeys_buffer),
-            reinterpret_cast<const int*>(numkeys_buffer) + num_keys_shape[1]);
+        // The row splits let clients split the output back into samples.
+        if (row_splits_requested) {
+          const std::vector<int32_t>& row_splits =
+              instance_state->RowSplits(num_samples);
+          const int64_t row_splits_size = row_splits.size();
+          TRITONBACKEND_Output* row_splits_output = nullptr;
+          GUARDED_RESPOND_IF_ERROR(
+              responses, r,
+              TRITONBACKEND_ResponseOutput(
+                  response, &row_splits_output, kRowSplitsOutput,
+                  TRITONSERVER_TYPE_INT32, &row_splits_size, 1));
+          void* row_splits_buffer = nullptr;
+          TRITONSERVER_MemoryType row_splits_memory_type =
+              TRITONSERVER_MEMORY_CPU;
+          int64_t row_splits_memory_type_id = 0;
+          if (responses[r] != nullptr) {
+            GUARDED_RESPOND_IF_ERROR(
+                responses, r,
+                TRITONBACKEND_OutputBuffer(
+                    row_splits_output, &row_splits_buffer,
+                    row_splits_size * sizeof(int32_t), &row_splits_memory_type,
+                    &row_splits_memory_type_id));
+          }
+          if (responses[r] == nullptr) {
+            HPS_TRITON_LOG(
+                ERROR, "request ", r,
+                ": failed to create row splits output, error response sent");
+            break;
+          }
+          CopyFromHost(
+              row_splits_buffer, row_splits_memory_type, row_splits.data(),
+              row_splits_size * sizeof(int32_t));
+        }
+        if (requested_output_name == nullptr && !table_outputs_requested) {
+          break;
+        }
 
-        std::vector<size_t> ev_size_list{instance_state->GetModelConfigutation()
-                                             .embedding_vecsize_per_table};
+        // Pooled tables return one embedding vector per sample.
+        const std::vector<size_t>& ev_size_list =
+            instance_state->EmbeddingVecsizePerTable();
         int64_t output_buffer_size = std::inner_product(
             ev_size_list.begin(), ev_size_list.end(),
             num_keys_per_table.begin(), 0);
-        int64_t* out_putshape = &output_buffer_size;
-        GUARDED_RESPOND_IF_ERROR(
-            responses, r,
-            TRITONBACKEND_ResponseOutput(
-                response, &output, requested_output_name,
-                TRITONSERVER_TYPE_FP32, out_putshape, 1));
-        if (responses[r] == nullptr) {
-          HPS_TRITON_LOG(
-              ERROR, "request ", r,
-              ": failed to create response output, error response sent");
-          continue;
+        if (pool_embeddings) {
+          output_buffer_size =
+              instance_state->PooledOutputSize(num_keys_per_table, num_samples);
         }
-
-        void* output_buffer;
-        TRITONSERVER_MemoryType output_memory_type = TRITONSERVER_MEMORY_GPU;
+        // CPU instances prefer outputs in host memory, which they can look up
+        // into directly.
+        const TRITONSERVER_MemoryType preferred_memory_type =
+            instance_state->Kind() == TRITONSERVER_INSTANCEGROUPKIND_CPU
+                ? TRITONSERVER_MEMORY_CPU
+                : TRITONSERVER_MEMORY_GPU;
+        const TRITONSERVER_DataType vector_data_type =
+            model_state->VectorDataType();
+        const size_t vector_byte_size =
+            TRITONSERVER_DataTypeByteSize(vector_data_type);
+        void* output_buffer = nullptr;
+        TRITONSERVER_MemoryType output_memory_type = preferred_memory_type;
         int64_t output_memory_type_id = 0;
-        GUARDED_RESPOND_IF_ERROR(
-            responses, r,
-            TRITONBACKEND_OutputBuffer(
-                output, &output_buffer, output_buffer_size * sizeof(float),
-                &output_memory_type, &output_memory_type_id));
-        if (responses[r] == nullptr) {
+        if (model_state->PerTableOutputs()) {
+          // One output per requested embedding table.
+          for (size_t t = 0; t < table_outputs.size(); ++t) {
+            ModelInstanceState::TableOutput& table_output = table_outputs[t];
+            if (table_output.name == nullptr || responses[r] == nullptr) {
+              continue;
+            }
+            int64_t table_output_size =
+                instance_state->OutputRows(t, num_keys_per_table, num_samples) *
+                ev_size_list[t];
+            TRITONBACKEND_Output* table_output_handle = nullptr;
+            GUARDED_RESPOND_IF_ERROR(
+                responses, r,
+                TRITONBACKEND_ResponseOutput(
+                    response, &table_output_handle, table_output.name,
+                    vector_data_type, &table_output_size, 1));
+            table_output.memory_type = preferred_memory_type;
+            if (responses[r] != nullptr) {
+              GUARDED_RESPOND_IF_ERROR(
+                  responses, r,
+                  TRITONBACKEND_OutputBuffer(
+                      table_output_handle, &table_output.buffer,
+                      table_output_size * vector_byte_size,
+                      &table_output.memory_type,
+                      &table_output.memory_type_id));
+            }
+          }
+          if (responses[r] == nullptr) {
+            HPS_TRITON_LOG(
+                ERROR, "request ", r,
+                ": failed to create table outputs, error response sent");
+            break;
+          }
+        } else {
+          int64_t* out_putshape = &output_buffer_size;
           GUARDED_RESPOND_IF_ERROR(
               responses, r,
-              TRITONSERVER_ErrorNew(
-                  TRITONSERVER_ERROR_UNSUPPORTED,
-                  "failed to create output buffer in GPU memory"));
-          HPS_TRITON_LOG(
-              ERROR, "request ", r,
-              ": failed to create output buffer in CPU memory, error response "
-              "sent");
-          continue;
+              TRITONBACKEND_ResponseOutput(
+                  response, &output, requested_output_name,
+                  vector_data_type, out_putshape, 1));
+          if (responses[r] == nullptr) {
+            HPS_TRITON_LOG(
+                ERROR, "request ", r,
+                ": failed to create response output, error response sent");
+            break;
+          }
+
+          GUARDED_RESPOND_IF_ERROR(
+              responses, r,
+              TRITONBACKEND_OutputBuffer(
+                  output, &output_buffer, output_buffer_size * vector_byte_size,
+                  &output_memory_type, &output_memory_type_id));
+          if (responses[r] == nullptr) {
+            GUARDED_RESPOND_IF_ERROR(
+                responses, r,
+                TRITONSERVER_ErrorNew(
+                    TRITONSERVER_ERROR_UNSUPPORTED,
+                    "failed to create output buffer in GPU memory"));
+            HPS_TRITON_LOG(
+                ERROR, "request ", r,
+                ": failed to create output buffer in CPU memory, error "
+                "response sent");
+            break;
+          }
         }
 
         // Step 4. Perform prediction in device and copy result to cpu output
         // buffer
         HPS_TRITON_LOG(
-            INFO, "*****Processing request on device***** ",
+            VERBOSE, "*****Processing request on device***** ",
             instance_state->DeviceId(), " for model ", instance_state->Name());
         // Set Timestamp here to compute the prediction execution time for each
         // request
-        SET_TIMESTAMP(exec_start_ns);
-        min_exec_start_ns = std::min(min_exec_start_ns, exec_start_ns);
-        // Model prediction
-        RETURN_IF_ERROR(instance_state->ProcessRequest(num_keys_per_table));
-        HPS_TRITON_LOG(INFO, "******Processing request completed!******");
-        CK_CUDA_THROW_(cudaMemcpy(
-            output_buffer,
-            instance_state->GetLookupResultBuffer()->get_raw_ptr(),
-            output_buffer_size * sizeof(float), cudaMemcpyDeviceToHost));
-
-        uint64_t exec_end_ns = 0;
-        SET_TIMESTAMP(exec_end_ns);
-        max_exec_end_ns = std::max(max_exec_end_ns, exec_end_ns);
+        uint64_t lookup_start_ns = 0;
+        SET_TIMESTAMP(lookup_start_ns);
+        if (compute_start_ns == 0) {
+          compute_start_ns = lookup_start_ns;
+        }
+        // Model prediction. If Triton handed out device memory of this
+        // instance, look up straight into it and skip the copy.
+        if (model_state->PerTableOutputs()) {
+          GUARDED_RESPOND_IF_ERROR(
+              responses, r,
+              instance_state->ProcessRequestPerTable(
+                  num_keys_per_table, num_samples));
+          SET_TIMESTAMP(compute_end_ns);
+        } else if (vector_data_type != TRITONSERVER_TYPE_FP32) {
+          GUARDED_RESPOND_IF_ERROR(
+              responses, r,
+              instance_state->ProcessRequestReduced(
+                  num_keys_per_table, num_samples, output_buffer,
+                  output_memory_type, output_memory_type_id));
+          SET_TIMESTAMP(compute_end_ns);
+        } else if (pool_embeddings) {
+          GUARDED_RESPOND_IF_ERROR(
+              responses, r,
+              instance_state->ProcessRequestPooled(
+                  num_keys_per_table, num_samples, output_buffer,
+                  output_memory_type, output_memory_type_id));
+          SET_TIMESTAMP(compute_end_ns);
+        } else if (instance_state->StateForModel()->KeyDeduplication()) {
+          GUARDED_RESPOND_IF_ERROR(
+              responses, r,
+              instance_state->ProcessRequestDeduplicated(
+                  num_keys_per_table, output_buffer, output_memory_type));
+          SET_TIMESTAMP(compute_end_ns);
+        } else if (instance_state->CanLookupInto(
+                       output_memory_type, output_memory_type_id)) {
+          GUARDED_RESPOND_IF_ERROR(
+              responses, r,
+              instance_state->ProcessRequest(
+                  num_keys_per_table, reinterpret_cast<float*>(output_buffer)));
+          SET_TIMESTAMP(compute_end_ns);
+        } else {
+          GUARDED_RESPOND_IF_ERROR(
+              responses, r,
+              instance_state->ProcessRequest(num_keys_per_table));
+          SET_TIMESTAMP(compute_end_ns);
+          if (responses[r] != nullptr) {
+            instance_state->CopyLookupResult(
+                output_buffer, output_memory_type,
+                instance_state->GetLookupResultBuffer()->get_raw_ptr(),
+                output_buffer_size * sizeof(float));
+          }
+        }
+        HPS_TRITON_LOG(VERBOSE, "******Processing request completed!******");
+
         // Get the prediction execution time (ms)
-        int64_t exe_time = (max_exec_end_ns - min_exec_start_ns) / 1000000;
-        HPS_TRITON_LOG(INFO, "Prediction execution time is ", exe_time, " ms");
-      }
+        int64_t exe_time = (compute_end_ns - lookup_start_ns) / 1000000;
+        HPS_TRITON_LOG(
+            VERBOSE, "Prediction execution time is ", exe_time, " ms");
+      } while (false);
 
       if (responses[r] == nullptr) {
         HPS_TRITON_LOG(
@@ -714,13 +1056,22 @@ TRITONBACKEND_ModelInstanceExecute(
     SET_TIMESTAMP(exec_end_ns);
     max_exec_end_ns = std::max(max_exec_end_ns, exec_end_ns);
 
+    // Requests without requested output skip the compute phases.
+    if (compute_start_ns == 0) {
+      compute_start_ns = compute_end_ns = exec_start_ns;
+    }
+    min_compute_start_ns = std::min(min_compute_start_ns, compute_start_ns);
+    max_compute_end_ns = std::max(max_compute_end_ns, compute_end_ns);
+    instance_state->RecordPhaseLatencies(
+        exec_start_ns, compute_start_ns, compute_end_ns, exec_end_ns);
+
     // Report statistics for the successful request. For an instance
     // using the CPU we don't associate any device with the
     // statistics, otherwise we associate the instance's device.
     LOG_IF_ERROR(
         TRITONBACKEND_ModelInstanceReportStatistics(
             instance_state->TritonModelInstance(), request, true /* success */,
-            exec_start_ns, exec_start_ns, exec_end_ns, exec_end_ns),
+            exec_start_ns, compute_start_ns, compute_end_ns, exec_end_ns),
         "failed reporting request statistics");
   }
 
@@ -736,7 +1087,7 @@ TRITONBACKEND_ModelInstanceExecute(
   LOG_IF_ERROR(
       TRITONBACKEND_ModelInstanceReportBatchStatistics(
           instance_state->TritonModelInstance(), total_batch_size,
-          min_exec_start_ns, min_exec_start_ns, max_exec_end_ns,
+          min_exec_start_ns, min_compute_start_ns, max_compute_end_ns,
           max_exec_end_ns),
       "failed reporting batch request statistics");
 
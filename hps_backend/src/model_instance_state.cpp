@@ -26,7 +26,11 @@
 
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <exception>
 #include <fstream>
 #include <map>
 #include <memory>
@@ -78,36 +82,46 @@ ModelInstanceState::ModelInstanceState(
       name_(model_state->Name()), kind_(kind), device_id_(device_id),
       instance_params_(instance_params)
 {
-  HPS_TRITON_LOG(
-      INFO, "Triton Model Instance Initialization on device ", device_id);
-  cudaError_t cuerr = cudaSetDevice(device_id);
-  if (cuerr != cudaSuccess) {
-    std::cerr << "failed to set CUDA device to " << device_id << ": "
-              << cudaGetErrorString(cuerr);
+  // CPU instances keep all their buffers in pageable host memory and never
+  // touch CUDA.
+  const bool on_cpu = kind_ == TRITONSERVER_INSTANCEGROUPKIND_CPU;
+  if (on_cpu) {
+    HPS_TRITON_LOG(INFO, "Triton Model Instance Initialization on CPU");
+  } else {
+    HPS_TRITON_LOG(
+        INFO, "Triton Model Instance Initialization on device ", device_id);
+    cudaError_t cuerr = cudaSetDevice(device_id);
+    if (cuerr != cudaSuccess) {
+      std::cerr << "failed to set CUDA device to " << device_id << ": "
+                << cudaGetErrorString(cuerr);
+    }
   }
   // Set current model instance device id as triton provided
   instance_params_.device_id = device_id;
   // Alloc the cuda memory
   HPS_TRITON_LOG(INFO, "Categorical Feature buffer allocation: ");
-  cat_column_index_buf_int64 =
-      HugeCTRBuffer<long long>::create(MemoryType_t::PIN);
+  cat_column_index_buf_int64 = HugeCTRBuffer<long long>::create(
+      on_cpu ? MemoryType_t::CPU : MemoryType_t::PIN);
   std::vector<size_t> cat_column_index_dims = {
       static_cast<size_t>(model_state_->BatchSize() * model_state_->CatNum())};
   cat_column_index_buf_int64->reserve(cat_column_index_dims);
   cat_column_index_buf_int64->allocate();
 
-  HPS_TRITON_LOG(
-      INFO, "Number of Categorical Feature per Table buffer allocation: ");
-  row_ptr_buf = HugeCTRBuffer<int>::create();
-  std::vector<size_t> row_ptrs_dims = {
-      static_cast<size_t>(model_state_->GetEmbeddingCache(device_id_)
-                              ->get_cache_config()
-                              .num_emb_table_)};
-  row_ptr_buf->reserve(row_ptrs_dims);
-  row_ptr_buf->allocate();
+  if (!on_cpu) {
+    HPS_TRITON_LOG(
+        INFO, "Number of Categorical Feature per Table buffer allocation: ");
+    row_ptr_buf = HugeCTRBuffer<int>::create();
+    std::vector<size_t> row_ptrs_dims = {
+        static_cast<size_t>(model_state_->GetEmbeddingCache(device_id_)
+                                ->get_cache_config()
+                                .num_emb_table_)};
+    row_ptr_buf->reserve(row_ptrs_dims);
+    row_ptr_buf->allocate();
+  }
 
   HPS_TRITON_LOG(INFO, "Look_up result buffer allocation: ");
-  lookup_result_buf = HugeCTRBuffer<float>::create();
+  lookup_result_buf = HugeCTRBuffer<float>::create(
+      on_cpu ? MemoryType_t::CPU : MemoryType_t::GPU);
   size_t lookup_buffer_length = model_state_->BatchSize() *
                                 model_state_->CatNum() *
                                 model_state_->EmbeddingSize();
@@ -125,10 +139,47 @@ ModelInstanceState::ModelInstanceState(
   std::vector<size_t> prediction_dims = {lookup_buffer_length};
   lookup_result_buf->reserve(prediction_dims);
   lookup_result_buf->allocate();
+
+  // GPU instances pool and narrow on the device. Pooling needs the
+  // per-sample key offsets and room for the pooled vectors there, where
+  // tables without a combiner keep one vector per key and pooled ones have
+  // one per sample. Narrowing needs room for the narrowed vectors of outputs
+  // that are not device memory of this instance.
+  if (!on_cpu) {
+    const std::vector<size_t>& ev_sizes =
+        instance_params_.embedding_vecsize_per_table;
+    size_t output_buffer_length = lookup_buffer_length;
+    if (model_state_->PoolEmbeddings()) {
+      HPS_TRITON_LOG(INFO, "Pooling buffer allocation: ");
+      sample_offsets_buf = HugeCTRBuffer<int>::create();
+      std::vector<size_t> sample_offsets_dims = {
+          ev_sizes.size() * (model_state_->BatchSize() + 1)};
+      sample_offsets_buf->reserve(sample_offsets_dims);
+      sample_offsets_buf->allocate();
+
+      output_buffer_length +=
+          model_state_->BatchSize() *
+          std::accumulate(ev_sizes.begin(), ev_sizes.end(), size_t{0});
+      pooled_result_buf = HugeCTRBuffer<float>::create();
+      std::vector<size_t> pooled_dims = {output_buffer_length};
+      pooled_result_buf->reserve(pooled_dims);
+      pooled_result_buf->allocate();
+    }
+    if (model_state_->VectorDataType() != TRITONSERVER_TYPE_FP32) {
+      HPS_TRITON_LOG(INFO, "Reduced precision buffer allocation: ");
+      reduced_result_buf = HugeCTRBuffer<uint16_t>::create();
+      std::vector<size_t> reduced_dims = {output_buffer_length};
+      reduced_result_buf->reserve(reduced_dims);
+      reduced_result_buf->allocate();
+    }
+  }
 }
 
 ModelInstanceState::~ModelInstanceState()
 {
+  StopHostLookupWorkers();
+  LogPhaseLatencies(TRITONSERVER_LOG_INFO);
+
   // release all the buffers
   embedding_cache.reset();
   model_state_->GetEmbeddingCache(device_id_).reset();
@@ -140,6 +191,17 @@ ModelInstanceState::LoadHPSInstance()
   HPS_TRITON_LOG(
       INFO, "The model origin json configuration file path is: ",
       model_state_->HugeCTRJsonConfig());
+  // CPU instances look up the host-side tiers of the parameter server
+  // directly.
+  if (kind_ == TRITONSERVER_INSTANCEGROUPKIND_CPU) {
+    num_embedding_tables = instance_params_.embedding_vecsize_per_table.size();
+    HPS_TRITON_LOG(
+        INFO, "******Looking up ", num_embedding_tables,
+        " embedding tables on CPU with ", model_state_->CPULookupThreads(),
+        " threads");
+    StartHostLookupWorkers();
+    return nullptr;
+  }
   embedding_cache = model_state_->GetEmbeddingCache(device_id_);
   num_embedding_tables = embedding_cache->get_cache_config().num_emb_table_;
   lookupsession_ =
@@ -149,26 +211,923 @@ ModelInstanceState::LoadHPSInstance()
 }
 
 TRITONSERVER_Error*
-ModelInstanceState::ProcessRequest(std::vector<size_t> num_keys_per_table)
-{
-  std::vector<const void*> keys_per_table{
-      cat_column_index_buf_int64->get_raw_ptr()};
-  std::vector<float*> lookup_buffer_offset_per_table{
-      lookup_result_buf->get_ptr()};
-
-  for (size_t index = 0; index < num_keys_per_table.size() - 1; ++index) {
-    const void* current_key_ptr = keys_per_table.back();
-    keys_per_table.push_back(reinterpret_cast<const void*>(
-        (long long*)current_key_ptr + num_keys_per_table[index]));
-    float* current_out_ptr = lookup_buffer_offset_per_table.back();
-    lookup_buffer_offset_per_table.push_back(
-        current_out_ptr + instance_params_.embedding_vecsize_per_table[index] *
-                              num_keys_per_table[index]);
-  }
-  lookupsession_->lookup(
-      keys_per_table, lookup_buffer_offset_per_table, num_keys_per_table);
+ModelInstanceState::ProcessRequest(
+    const std::vector<size_t>& num_keys_per_table, float* output)
+{
+  HPS_RETURN_TRITION_ERROR_IF_TRUE(
+      num_keys_per_table.empty(), INVALID_ARG,
+      "The request does not contain keys of any embedding table.");
+
+  const size_t num_tables = num_keys_per_table.size();
+  keys_per_table_.resize(num_tables);
+  lookup_buffer_offset_per_table_.resize(num_tables);
+
+  const long long* keys = cat_column_index_buf_int64->get_ptr();
+  float* lookup_output =
+      output != nullptr ? output : lookup_result_buf->get_ptr();
+  keys_per_table_[0] = keys;
+  lookup_buffer_offset_per_table_[0] = lookup_output;
+  for (size_t index = 1; index < num_tables; ++index) {
+    keys += num_keys_per_table[index - 1];
+    lookup_output += instance_params_.embedding_vecsize_per_table[index - 1] *
+                     num_keys_per_table[index - 1];
+    keys_per_table_[index] = keys;
+    lookup_buffer_offset_per_table_[index] = lookup_output;
+  }
+  Lookup(num_keys_per_table);
+  return nullptr;
+}
+
+void
+ModelInstanceState::Lookup(const std::vector<size_t>& num_keys_per_table)
+{
+  if (kind_ == TRITONSERVER_INSTANCEGROUPKIND_CPU) {
+    LookupOnHost(num_keys_per_table);
+  } else {
+    lookupsession_->lookup(
+        keys_per_table_, lookup_buffer_offset_per_table_, num_keys_per_table);
+  }
+}
+
+void
+ModelInstanceState::StartHostLookupWorkers()
+{
+  host_parameter_server_ = model_state_->HugeCTRParameterServerInt64().get();
+  const size_t num_threads = model_state_->CPULookupThreads();
+  host_cache_misses_.resize(num_threads);
+  for (size_t worker = 1; worker < num_threads; ++worker) {
+    host_lookup_workers_.emplace_back(
+        &ModelInstanceState::RunHostLookupWorker, this, worker);
+  }
+}
+
+void
+ModelInstanceState::StopHostLookupWorkers()
+{
+  {
+    std::lock_guard<std::mutex> lock(host_lookup_mutex_);
+    host_lookup_stop_ = true;
+  }
+  host_lookup_start_.notify_all();
+  for (std::thread& worker : host_lookup_workers_) {
+    worker.join();
+  }
+  host_lookup_workers_.clear();
+}
+
+void
+ModelInstanceState::RunHostLookupWorker(const size_t worker)
+{
+  uint64_t generation = 0;
+  std::unique_lock<std::mutex> lock(host_lookup_mutex_);
+  while (true) {
+    host_lookup_start_.wait(lock, [&]() {
+      return host_lookup_stop_ || host_lookup_generation_ != generation;
+    });
+    if (host_lookup_stop_) {
+      return;
+    }
+    generation = host_lookup_generation_;
+    // Requests with few chunks leave the higher workers idle.
+    if (worker > host_lookup_helpers_) {
+      continue;
+    }
+    lock.unlock();
+    LookupHostChunks(worker);
+    lock.lock();
+    if (--host_lookup_pending_ == 0) {
+      host_lookup_done_.notify_one();
+    }
+  }
+}
+
+void
+ModelInstanceState::LookupHostChunks(const size_t worker)
+{
+  HostCacheMisses* const misses = &host_cache_misses_[worker];
+  try {
+    for (size_t c = next_host_lookup_chunk_++; c < host_lookup_chunks_.size();
+         c = next_host_lookup_chunk_++) {
+      LookupChunkOnHost(host_lookup_chunks_[c], host_parameter_server_, misses);
+    }
+  }
+  catch (...) {
+    std::lock_guard<std::mutex> lock(host_lookup_mutex_);
+    host_lookup_error_ = std::current_exception();
+    next_host_lookup_chunk_ = host_lookup_chunks_.size();
+  }
+}
+
+void
+ModelInstanceState::LookupOnHost(const std::vector<size_t>& num_keys_per_table)
+{
+  // Split the keys of every table into chunks, which the execute thread and
+  // the worker threads take in turn and look up in the host-side tiers of the
+  // parameter server.
+  host_lookup_chunks_.clear();
+  for (size_t t = 0; t < num_keys_per_table.size(); ++t) {
+    for (size_t begin = 0; begin < num_keys_per_table[t];
+         begin += kHostLookupChunkSize) {
+      host_lookup_chunks_.push_back(
+          {t, begin,
+           std::min(kHostLookupChunkSize, num_keys_per_table[t] - begin)});
+    }
+  }
+  next_host_lookup_chunk_ = 0;
+  host_lookup_error_ = nullptr;
+
+  const size_t num_helpers =
+      host_lookup_chunks_.empty()
+          ? 0
+          : std::min(
+                host_lookup_workers_.size(), host_lookup_chunks_.size() - 1);
+  if (num_helpers > 0) {
+    {
+      std::lock_guard<std::mutex> lock(host_lookup_mutex_);
+      host_lookup_helpers_ = num_helpers;
+      host_lookup_pending_ = num_helpers;
+      ++host_lookup_generation_;
+    }
+    host_lookup_start_.notify_all();
+  }
+  LookupHostChunks(0);
+  if (num_helpers > 0) {
+    std::unique_lock<std::mutex> lock(host_lookup_mutex_);
+    host_lookup_done_.wait(lock, [&]() { return host_lookup_pending_ == 0; });
+  }
+  if (host_lookup_error_) {
+    std::rethrow_exception(host_lookup_error_);
+  }
+}
+
+void
+ModelInstanceState::LookupChunkOnHost(
+    const HostLookupChunk& chunk,
+    HugeCTR::HierParameterServerBase* const parameter_server,
+    HostCacheMisses* const misses)
+{
+  const size_t ev_size =
+      instance_params_.embedding_vecsize_per_table[chunk.table];
+  const long long* const keys =
+      reinterpret_cast<const long long*>(keys_per_table_[chunk.table]) +
+      chunk.begin;
+  float* const vectors =
+      lookup_buffer_offset_per_table_[chunk.table] + chunk.begin * ev_size;
+  HostEmbeddingCache* const host_cache =
+      model_state_->GetHostEmbeddingCache(chunk.table);
+  if (host_cache == nullptr) {
+    parameter_server->lookup(keys, chunk.num_keys, vectors, name_, chunk.table);
+    return;
+  }
+
+  uint64_t now_ns = 0;
+  SET_TIMESTAMP(now_ns);
+  misses->keys.clear();
+  misses->positions.clear();
+  for (size_t i = 0; i < chunk.num_keys; ++i) {
+    if (!host_cache->find(keys[i], now_ns, vectors + i * ev_size)) {
+      misses->keys.push_back(keys[i]);
+      misses->positions.push_back(i);
+    }
+  }
+  if (misses->keys.empty()) {
+    return;
+  }
+  misses->vectors.resize(misses->keys.size() * ev_size);
+  parameter_server->lookup(
+      misses->keys.data(), misses->keys.size(), misses->vectors.data(), name_,
+      chunk.table);
+  for (size_t m = 0; m < misses->keys.size(); ++m) {
+    const float* const vector = &misses->vectors[m * ev_size];
+    std::copy_n(vector, ev_size, vectors + misses->positions[m] * ev_size);
+    host_cache->insert(misses->keys[m], now_ns, vector);
+  }
+}
+
+void
+ModelInstanceState::CopyLookupResult(
+    void* dst, const TRITONSERVER_MemoryType dst_memory_type, const void* src,
+    const size_t byte_size) const
+{
+  if (kind_ == TRITONSERVER_INSTANCEGROUPKIND_CPU) {
+    CopyFromHost(dst, dst_memory_type, src, byte_size);
+  } else {
+    CK_CUDA_THROW_(cudaMemcpy(
+        dst, src, byte_size,
+        dst_memory_type == TRITONSERVER_MEMORY_GPU ? cudaMemcpyDeviceToDevice
+                                                   : cudaMemcpyDeviceToHost));
+  }
+}
+
+size_t
+ModelInstanceState::DeduplicateKeys(
+    long long* keys, const size_t num_keys, uint32_t* inverse_index)
+{
+  // Open addressing with linear probing in a table that is at most half
+  // full. A slot holds the position of its key among the distinct keys plus
+  // one, and zero if it is empty.
+  size_t log2_capacity = 4;
+  while ((size_t{1} << log2_capacity) < 2 * num_keys) {
+    ++log2_capacity;
+  }
+  const size_t mask = (size_t{1} << log2_capacity) - 1;
+  dedup_slots_.assign(mask + 1, 0);
+
+  size_t num_unique = 0;
+  for (size_t i = 0; i < num_keys; ++i) {
+    const long long key = keys[i];
+    size_t slot = (static_cast<uint64_t>(key) * 0x9e3779b97f4a7c15ull) >>
+                  (64 - log2_capacity);
+    while (true) {
+      const uint32_t entry = dedup_slots_[slot];
+      if (entry == 0) {
+        keys[num_unique] = key;
+        inverse_index[i] = num_unique;
+        dedup_slots_[slot] = ++num_unique;
+        break;
+      }
+      if (keys[entry - 1] == key) {
+        inverse_index[i] = entry - 1;
+        break;
+      }
+      slot = (slot + 1) & mask;
+    }
+  }
+  return num_unique;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::ProcessRequestDeduplicated(
+    const std::vector<size_t>& num_keys_per_table, void* output_buffer,
+    const TRITONSERVER_MemoryType output_memory_type)
+{
+  const size_t num_tables = num_keys_per_table.size();
+  const std::vector<size_t>& ev_sizes =
+      instance_params_.embedding_vecsize_per_table;
+  HPS_RETURN_TRITION_ERROR_IF_TRUE(
+      num_tables == 0 || num_tables > ev_sizes.size(), INVALID_ARG,
+      "The request contains keys of ", num_tables, " embedding tables, but "
+      "the model has ", ev_sizes.size(), ".");
+
+  // Keys are staged in pinned host memory. Compact the distinct keys of each
+  // table at the front of its keys, and look these up.
+  long long* const keys = cat_column_index_buf_int64->get_ptr();
+  const size_t num_keys = std::accumulate(
+      num_keys_per_table.begin(), num_keys_per_table.end(), size_t{0});
+  inverse_index_.resize(num_keys);
+  num_unique_keys_per_table_.resize(num_tables);
+  keys_per_table_.resize(num_tables);
+  lookup_buffer_offset_per_table_.resize(num_tables);
+
+  size_t key_offset = 0;
+  size_t num_unique_values = 0;
+  for (size_t t = 0; t < num_tables; ++t) {
+    num_unique_keys_per_table_[t] = DeduplicateKeys(
+        keys + key_offset, num_keys_per_table[t],
+        inverse_index_.data() + key_offset);
+    keys_per_table_[t] = keys + key_offset;
+    lookup_buffer_offset_per_table_[t] =
+        lookup_result_buf->get_ptr() + num_unique_values;
+    key_offset += num_keys_per_table[t];
+    num_unique_values += num_unique_keys_per_table_[t] * ev_sizes[t];
+  }
+  HPS_TRITON_LOG(
+      VERBOSE, "Deduplicated ", num_keys, " keys to ",
+      std::accumulate(
+          num_unique_keys_per_table_.begin(), num_unique_keys_per_table_.end(),
+          size_t{0}),
+      " distinct keys");
+  Lookup(num_unique_keys_per_table_);
+
+  // Expand the embedding vectors of the distinct keys on the host.
+  unique_vectors_.resize(num_unique_values);
+  CopyLookupResult(
+      unique_vectors_.data(), TRITONSERVER_MEMORY_CPU,
+      lookup_result_buf->get_raw_ptr(), num_unique_values * sizeof(float));
+
+  const bool output_on_device = output_memory_type == TRITONSERVER_MEMORY_GPU;
+  size_t num_values = 0;
+  for (size_t t = 0; t < num_tables; ++t) {
+    num_values += num_keys_per_table[t] * ev_sizes[t];
+  }
+  float* expanded = reinterpret_cast<float*>(output_buffer);
+  if (output_on_device) {
+    expanded_vectors_.resize(num_values);
+    expanded = expanded_vectors_.data();
+  }
+
+  const float* unique = unique_vectors_.data();
+  const uint32_t* inverse_index = inverse_index_.data();
+  for (size_t t = 0; t < num_tables; ++t) {
+    const size_t ev_size = ev_sizes[t];
+    for (size_t i = 0; i < num_keys_per_table[t]; ++i) {
+      std::memcpy(
+          expanded, unique + inverse_index[i] * ev_size,
+          ev_size * sizeof(float));
+      expanded += ev_size;
+    }
+    unique += num_unique_keys_per_table_[t] * ev_size;
+    inverse_index += num_keys_per_table[t];
+  }
+
+  if (output_on_device) {
+    CopyFromHost(
+        output_buffer, output_memory_type, expanded_vectors_.data(),
+        num_values * sizeof(float));
+  }
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::StageNumKeys(
+    const int32_t* num_keys, const size_t count, const size_t num_request_keys,
+    size_t* num_samples)
+{
+  const size_t num_tables = instance_params_.embedding_vecsize_per_table.size();
+  HPS_RETURN_TRITION_ERROR_IF_TRUE(
+      num_tables == 0 || count == 0 || count % num_tables != 0, INVALID_ARG,
+      "Expected NUMKEYS to hold the number of keys of each of the ",
+      num_tables, " embedding tables for every sample, got ", count,
+      " values.");
+  *num_samples = count / num_tables;
+  HPS_RETURN_TRITION_ERROR_IF_TRUE(
+      *num_samples > static_cast<size_t>(model_state_->BatchSize()),
+      INVALID_ARG, "The number of input samples (", *num_samples,
+      ") is greater than the max batch size.");
+
+  // NUMKEYS is laid out sample by sample, while the keys are laid out table
+  // by table.
+  num_keys_per_table_.assign(num_tables, 0);
+  for (size_t s = 0; s < *num_samples; ++s) {
+    for (size_t t = 0; t < num_tables; ++t) {
+      const int32_t n = num_keys[s * num_tables + t];
+      HPS_RETURN_TRITION_ERROR_IF_TRUE(
+          n < 0, INVALID_ARG, "NUMKEYS of sample ", s, " and embedding table ",
+          t, " is negative.");
+      num_keys_per_table_[t] += n;
+    }
+  }
+  const size_t total_num_keys = std::accumulate(
+      num_keys_per_table_.begin(), num_keys_per_table_.end(), size_t{0});
+  HPS_RETURN_TRITION_ERROR_IF_TRUE(
+      total_num_keys != num_request_keys, INVALID_ARG, "NUMKEYS adds up to ",
+      total_num_keys, " keys, but the request contains ", num_request_keys,
+      " keys.");
+
+  sample_offsets_.resize(num_tables * (*num_samples + 1));
+  int32_t* offsets = sample_offsets_.data();
+  for (size_t t = 0; t < num_tables; ++t) {
+    offsets[0] = 0;
+    for (size_t s = 0; s < *num_samples; ++s) {
+      offsets[s + 1] = offsets[s] + num_keys[s * num_tables + t];
+    }
+    offsets += *num_samples + 1;
+  }
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::StageSampleOffsets(
+    const int32_t* offsets, const size_t num_offsets,
+    const std::vector<size_t>& num_keys_per_table, size_t* num_samples)
+{
+  const size_t num_tables = num_keys_per_table.size();
+  HPS_RETURN_TRITION_ERROR_IF_TRUE(
+      num_offsets < num_tables || num_offsets % num_tables != 0, INVALID_ARG,
+      "Expected the same number of key offsets for each of the ", num_tables,
+      " embedding tables, got ", num_offsets, " offsets.");
+  *num_samples = num_offsets / num_tables - 1;
+  HPS_RETURN_TRITION_ERROR_IF_TRUE(
+      *num_samples > static_cast<size_t>(model_state_->BatchSize()),
+      INVALID_ARG, "The number of input samples (", *num_samples,
+      ") is greater than the max batch size.");
+
+  // The offsets of each table must run from zero to its number of keys.
+  for (size_t t = 0; t < num_tables; ++t) {
+    const int32_t* table_offsets = offsets + t * (*num_samples + 1);
+    HPS_RETURN_TRITION_ERROR_IF_TRUE(
+        table_offsets[0] != 0 ||
+            static_cast<size_t>(table_offsets[*num_samples]) !=
+                num_keys_per_table[t],
+        INVALID_ARG, "The key offsets of embedding table ", t,
+        " must run from 0 to ", num_keys_per_table[t], ".");
+    for (size_t s = 0; s < *num_samples; ++s) {
+      HPS_RETURN_TRITION_ERROR_IF_TRUE(
+          table_offsets[s + 1] < table_offsets[s], INVALID_ARG,
+          "The key offsets of embedding table ", t,
+          " are decreasing at sample ", s, ".");
+    }
+  }
+  sample_offsets_.assign(offsets, offsets + num_offsets);
+  return nullptr;
+}
+
+const std::vector<int32_t>&
+ModelInstanceState::RowSplits(const size_t num_samples)
+{
+  if (!model_state_->PoolEmbeddings()) {
+    return sample_offsets_;
+  }
+  // Pooled tables have one output row per sample.
+  const std::vector<Combiner>& combiners = model_state_->CombinerPerTable();
+  row_splits_.resize(sample_offsets_.size());
+  for (size_t t = 0; t < combiners.size(); ++t) {
+    const size_t begin = t * (num_samples + 1);
+    if (combiners[t] == Combiner::kNone) {
+      std::copy_n(
+          sample_offsets_.begin() + begin, num_samples + 1,
+          row_splits_.begin() + begin);
+    } else {
+      std::iota(
+          row_splits_.begin() + begin,
+          row_splits_.begin() + begin + num_samples + 1, 0);
+    }
+  }
+  return row_splits_;
+}
+
+size_t
+ModelInstanceState::OutputRows(
+    const size_t table, const std::vector<size_t>& num_keys_per_table,
+    const size_t num_samples) const
+{
+  const std::vector<Combiner>& combiners = model_state_->CombinerPerTable();
+  return combiners.empty() || combiners[table] == Combiner::kNone
+             ? num_keys_per_table[table]
+             : num_samples;
+}
+
+size_t
+ModelInstanceState::PooledOutputSize(
+    const std::vector<size_t>& num_keys_per_table,
+    const size_t num_samples) const
+{
+  const std::vector<size_t>& ev_sizes =
+      instance_params_.embedding_vecsize_per_table;
+  size_t size = 0;
+  for (size_t t = 0; t < num_keys_per_table.size(); ++t) {
+    size += OutputRows(t, num_keys_per_table, num_samples) * ev_sizes[t];
+  }
+  return size;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::ProcessRequestPooled(
+    const std::vector<size_t>& num_keys_per_table, const size_t num_samples,
+    void* output_buffer, const TRITONSERVER_MemoryType output_memory_type,
+    const int64_t output_memory_type_id)
+{
+  const size_t output_size = PooledOutputSize(num_keys_per_table, num_samples);
+  if (kind_ != TRITONSERVER_INSTANCEGROUPKIND_CPU) {
+    // Pool straight into device outputs of this instance, and copy the pooled
+    // vectors once otherwise.
+    const bool pool_into_output =
+        CanLookupInto(output_memory_type, output_memory_type_id);
+    float* const pooled = pool_into_output
+                              ? reinterpret_cast<float*>(output_buffer)
+                              : pooled_result_buf->get_ptr();
+    RETURN_IF_ERROR(PoolOnDevice(num_keys_per_table, num_samples, pooled));
+    if (!pool_into_output) {
+      CopyLookupResult(
+          output_buffer, output_memory_type, pooled,
+          output_size * sizeof(float));
+    }
+    return nullptr;
+  }
+
+  const std::vector<size_t>& ev_sizes =
+      instance_params_.embedding_vecsize_per_table;
+  size_t num_values = 0;
+  for (size_t t = 0; t < num_keys_per_table.size(); ++t) {
+    num_values += num_keys_per_table[t] * ev_sizes[t];
+  }
+
+  // Gather the embedding vector of every key on the host.
+  lookup_vectors_.resize(num_values);
+  if (model_state_->KeyDeduplication()) {
+    RETURN_IF_ERROR(ProcessRequestDeduplicated(
+        num_keys_per_table, lookup_vectors_.data(), TRITONSERVER_MEMORY_CPU));
+  } else {
+    RETURN_IF_ERROR(ProcessRequest(num_keys_per_table));
+    CopyLookupResult(
+        lookup_vectors_.data(), TRITONSERVER_MEMORY_CPU,
+        lookup_result_buf->get_raw_ptr(), num_values * sizeof(float));
+  }
+
+  const bool output_on_device = output_memory_type == TRITONSERVER_MEMORY_GPU;
+  float* pooled = reinterpret_cast<float*>(output_buffer);
+  if (output_on_device) {
+    pooled_vectors_.resize(output_size);
+    pooled = pooled_vectors_.data();
+  }
+
+  // Combine the embedding vectors of each sample. Samples without keys yield
+  // zero vectors.
+  const std::vector<Combiner>& combiners = model_state_->CombinerPerTable();
+  const float* vectors = lookup_vectors_.data();
+  const int32_t* offsets = sample_offsets_.data();
+  for (size_t t = 0; t < num_keys_per_table.size(); ++t) {
+    const size_t ev_size = ev_sizes[t];
+    const size_t table_size = num_keys_per_table[t] * ev_size;
+    if (combiners[t] == Combiner::kNone) {
+      std::memcpy(pooled, vectors, table_size * sizeof(float));
+      pooled += table_size;
+    } else {
+      for (size_t s = 0; s < num_samples; ++s) {
+        const size_t num_sample_keys = offsets[s + 1] - offsets[s];
+        const float* vector = vectors + offsets[s] * ev_size;
+        std::fill_n(pooled, ev_size, 0.0f);
+        for (size_t k = 0; k < num_sample_keys; ++k, vector += ev_size) {
+          for (size_t i = 0; i < ev_size; ++i) {
+            pooled[i] += vector[i];
+          }
+        }
+        float scale = 1.0f;
+        if (num_sample_keys > 0 && combiners[t] == Combiner::kMean) {
+          scale = 1.0f / num_sample_keys;
+        } else if (num_sample_keys > 0 && combiners[t] == Combiner::kSqrtN) {
+          scale = 1.0f / std::sqrt(static_cast<float>(num_sample_keys));
+        }
+        if (scale != 1.0f) {
+          for (size_t i = 0; i < ev_size; ++i) {
+            pooled[i] *= scale;
+          }
+        }
+        pooled += ev_size;
+      }
+    }
+    vectors += table_size;
+    offsets += num_samples + 1;
+  }
+
+  if (output_on_device) {
+    CopyFromHost(
+        output_buffer, output_memory_type, pooled_vectors_.data(),
+        output_size * sizeof(float));
+  }
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::PoolOnDevice(
+    const std::vector<size_t>& num_keys_per_table, const size_t num_samples,
+    float* pooled)
+{
+  // Look up the embedding vector of every key into the lookup result buffer.
+  // Deduplicated lookups expand the vectors of the distinct keys back into
+  // it, after these have been copied out.
+  if (model_state_->KeyDeduplication()) {
+    RETURN_IF_ERROR(ProcessRequestDeduplicated(
+        num_keys_per_table, lookup_result_buf->get_ptr(),
+        TRITONSERVER_MEMORY_GPU));
+  } else {
+    RETURN_IF_ERROR(ProcessRequest(num_keys_per_table));
+  }
+  CopyFromHost(
+      sample_offsets_buf->get_ptr(), TRITONSERVER_MEMORY_GPU,
+      sample_offsets_.data(), sample_offsets_.size() * sizeof(int32_t));
+
+  const std::vector<size_t>& ev_sizes =
+      instance_params_.embedding_vecsize_per_table;
+  const std::vector<Combiner>& combiners = model_state_->CombinerPerTable();
+  const float* vectors = lookup_result_buf->get_ptr();
+  const int32_t* offsets = sample_offsets_buf->get_ptr();
+  for (size_t t = 0; t < num_keys_per_table.size(); ++t) {
+    const size_t ev_size = ev_sizes[t];
+    const size_t table_size = num_keys_per_table[t] * ev_size;
+    if (combiners[t] == Combiner::kNone) {
+      CK_CUDA_THROW_(cudaMemcpyAsync(
+          pooled, vectors, table_size * sizeof(float),
+          cudaMemcpyDeviceToDevice, 0));
+      pooled += table_size;
+    } else {
+      const cudaError_t err = PoolEmbeddingVectors(
+          vectors, offsets, num_samples, ev_size, combiners[t], pooled, 0);
+      HPS_RETURN_TRITION_ERROR_IF_TRUE(
+          err != cudaSuccess, INTERNAL,
+          "Failed to pool the embedding vectors of table ", t, ": ",
+          cudaGetErrorString(err));
+      pooled += num_samples * ev_size;
+    }
+    vectors += table_size;
+    offsets += num_samples + 1;
+  }
+  CK_CUDA_THROW_(cudaStreamSynchronize(0));
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::LookupVectors(
+    const std::vector<size_t>& num_keys_per_table, const size_t num_samples,
+    const float** vectors)
+{
+  if (kind_ != TRITONSERVER_INSTANCEGROUPKIND_CPU) {
+    // The vectors stay on the device.
+    if (model_state_->PoolEmbeddings()) {
+      RETURN_IF_ERROR(PoolOnDevice(
+          num_keys_per_table, num_samples, pooled_result_buf->get_ptr()));
+      *vectors = pooled_result_buf->get_ptr();
+      return nullptr;
+    }
+    if (model_state_->KeyDeduplication()) {
+      RETURN_IF_ERROR(ProcessRequestDeduplicated(
+          num_keys_per_table, lookup_result_buf->get_ptr(),
+          TRITONSERVER_MEMORY_GPU));
+    } else {
+      RETURN_IF_ERROR(ProcessRequest(num_keys_per_table));
+    }
+    *vectors = lookup_result_buf->get_ptr();
+    return nullptr;
+  }
+
+  table_vectors_.resize(PooledOutputSize(num_keys_per_table, num_samples));
+  *vectors = table_vectors_.data();
+  if (model_state_->PoolEmbeddings()) {
+    return ProcessRequestPooled(
+        num_keys_per_table, num_samples, table_vectors_.data(),
+        TRITONSERVER_MEMORY_CPU, 0);
+  }
+  if (model_state_->KeyDeduplication()) {
+    return ProcessRequestDeduplicated(
+        num_keys_per_table, table_vectors_.data(), TRITONSERVER_MEMORY_CPU);
+  }
+  RETURN_IF_ERROR(ProcessRequest(num_keys_per_table));
+  CopyLookupResult(
+      table_vectors_.data(), TRITONSERVER_MEMORY_CPU,
+      lookup_result_buf->get_raw_ptr(), table_vectors_.size() * sizeof(float));
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::WriteVectors(
+    void* dst, const TRITONSERVER_MemoryType dst_memory_type,
+    const int64_t dst_memory_type_id, const float* vectors,
+    const size_t num_values)
+{
+  const TRITONSERVER_DataType data_type = model_state_->VectorDataType();
+  if (data_type == TRITONSERVER_TYPE_FP32) {
+    CopyLookupResult(dst, dst_memory_type, vectors, num_values * sizeof(float));
+    return nullptr;
+  }
+
+  if (kind_ != TRITONSERVER_INSTANCEGROUPKIND_CPU) {
+    // Narrow on the device, straight into device outputs of this instance,
+    // and copy the narrowed vectors once otherwise.
+    const bool narrow_into_output =
+        CanLookupInto(dst_memory_type, dst_memory_type_id);
+    uint16_t* const reduced = narrow_into_output
+                                  ? reinterpret_cast<uint16_t*>(dst)
+                                  : reduced_result_buf->get_ptr();
+    const cudaError_t err =
+        data_type == TRITONSERVER_TYPE_FP16
+            ? ConvertFloatToHalfOnDevice(vectors, reduced, num_values, 0)
+            : ConvertFloatToBFloat16OnDevice(vectors, reduced, num_values, 0);
+    HPS_RETURN_TRITION_ERROR_IF_TRUE(
+        err != cudaSuccess, INTERNAL,
+        "Failed to narrow the embedding vectors: ", cudaGetErrorString(err));
+    if (narrow_into_output) {
+      CK_CUDA_THROW_(cudaStreamSynchronize(0));
+    } else {
+      CopyLookupResult(
+          dst, dst_memory_type, reduced, num_values * sizeof(uint16_t));
+    }
+    return nullptr;
+  }
+
+  // Narrow on the host, straight into host outputs.
+  uint16_t* reduced = reinterpret_cast<uint16_t*>(dst);
+  if (dst_memory_type == TRITONSERVER_MEMORY_GPU) {
+    reduced_vectors_.resize(num_values);
+    reduced = reduced_vectors_.data();
+  }
+  if (data_type == TRITONSERVER_TYPE_FP16) {
+    ConvertFloatToHalf(vectors, reduced, num_values);
+  } else {
+    ConvertFloatToBFloat16(vectors, reduced, num_values);
+  }
+  if (dst_memory_type == TRITONSERVER_MEMORY_GPU) {
+    CopyFromHost(dst, dst_memory_type, reduced, num_values * sizeof(uint16_t));
+  }
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::ProcessRequestReduced(
+    const std::vector<size_t>& num_keys_per_table, const size_t num_samples,
+    void* output_buffer, const TRITONSERVER_MemoryType output_memory_type,
+    const int64_t output_memory_type_id)
+{
+  const float* vectors = nullptr;
+  RETURN_IF_ERROR(LookupVectors(num_keys_per_table, num_samples, &vectors));
+  return WriteVectors(
+      output_buffer, output_memory_type, output_memory_type_id, vectors,
+      PooledOutputSize(num_keys_per_table, num_samples));
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::StageKeys(const void* keys, const size_t num_keys)
+{
+  HPS_RETURN_TRITION_ERROR_IF_TRUE(
+      num_keys > static_cast<size_t>(
+                     model_state_->BatchSize() * model_state_->CatNum()),
+      INVALID_ARG, "The request contains ", num_keys,
+      " keys, which is more than the max batch size allows.");
+  long long* const staged = cat_column_index_buf_int64->get_ptr();
+  if (model_state_->KeyDataType() == TRITONSERVER_TYPE_INT32) {
+    const int32_t* narrow_keys = reinterpret_cast<const int32_t*>(keys);
+    std::copy_n(narrow_keys, num_keys, staged);
+  } else {
+    std::memcpy(staged, keys, num_keys * sizeof(long long));
+  }
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::GatherKeys(
+    TRITONBACKEND_Input* keys_input, const uint32_t buffer_count,
+    size_t* num_keys)
+{
+  const size_t key_byte_size =
+      TRITONSERVER_DataTypeByteSize(model_state_->KeyDataType());
+  const size_t capacity = model_state_->BatchSize() * model_state_->CatNum();
+  long long* const staged = cat_column_index_buf_int64->get_ptr();
+  size_t offset = 0;
+  for (uint32_t b = 0; b < buffer_count; ++b) {
+    const void* keys = nullptr;
+    uint64_t byte_size = 0;
+    TRITONSERVER_MemoryType memory_type = TRITONSERVER_MEMORY_CPU;
+    int64_t memory_type_id = 0;
+    RETURN_IF_ERROR(TRITONBACKEND_InputBuffer(
+        keys_input, b, &keys, &byte_size, &memory_type, &memory_type_id));
+    HPS_RETURN_TRITION_ERROR_IF_TRUE(
+        byte_size % key_byte_size != 0, INVALID_ARG, "Buffer ", b,
+        " of the keys holds ", byte_size, " bytes, which is not a whole "
+        "number of keys.");
+    const size_t count = byte_size / key_byte_size;
+    HPS_RETURN_TRITION_ERROR_IF_TRUE(
+        count > capacity - offset, INVALID_ARG,
+        "The request contains more keys than the max batch size allows (",
+        capacity, ").");
+    if (model_state_->KeyDataType() == TRITONSERVER_TYPE_INT32) {
+      std::copy_n(
+          reinterpret_cast<const int32_t*>(keys), count, staged + offset);
+    } else {
+      std::memcpy(staged + offset, keys, byte_size);
+    }
+    offset += count;
+  }
+  *num_keys = offset;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::GatherInt32Input(
+    TRITONBACKEND_Input* input, const uint32_t buffer_count,
+    std::vector<int32_t>* values)
+{
+  values->clear();
+  for (uint32_t b = 0; b < buffer_count; ++b) {
+    const void* buffer = nullptr;
+    uint64_t byte_size = 0;
+    TRITONSERVER_MemoryType memory_type = TRITONSERVER_MEMORY_CPU;
+    int64_t memory_type_id = 0;
+    RETURN_IF_ERROR(TRITONBACKEND_InputBuffer(
+        input, b, &buffer, &byte_size, &memory_type, &memory_type_id));
+    HPS_RETURN_TRITION_ERROR_IF_TRUE(
+        byte_size % sizeof(int32_t) != 0, INVALID_ARG, "Buffer ", b,
+        " of an INT32 input holds ", byte_size, " bytes, which is not a "
+        "whole number of values.");
+    const size_t offset = values->size();
+    values->resize(offset + byte_size / sizeof(int32_t));
+    std::memcpy(values->data() + offset, buffer, byte_size);
+  }
   return nullptr;
 }
 
+void
+ModelInstanceState::RecordKeyFrequencies(
+    const std::vector<size_t>& num_keys_per_table)
+{
+  const long long* keys = cat_column_index_buf_int64->get_ptr();
+  for (size_t t = 0; t < num_keys_per_table.size(); ++t) {
+    model_state_->RecordKeyFrequencies(t, keys, num_keys_per_table[t]);
+    keys += num_keys_per_table[t];
+  }
+}
+
+void
+ModelInstanceState::Prefetch(const std::vector<size_t>& num_keys_per_table)
+{
+  model_state_->Prefetch(
+      cat_column_index_buf_int64->get_ptr(), num_keys_per_table);
+}
+
+void
+ModelInstanceState::RecordPrefetchHits(
+    const std::vector<size_t>& num_keys_per_table)
+{
+  const long long* keys = cat_column_index_buf_int64->get_ptr();
+  for (size_t t = 0; t < num_keys_per_table.size(); ++t) {
+    model_state_->RecordPrefetchHits(t, keys, num_keys_per_table[t]);
+    keys += num_keys_per_table[t];
+  }
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::ProcessRequestPerTable(
+    const std::vector<size_t>& num_keys_per_table, const size_t num_samples)
+{
+  const size_t num_tables = num_keys_per_table.size();
+  const std::vector<size_t>& ev_sizes =
+      instance_params_.embedding_vecsize_per_table;
+
+  // Pooled, deduplicated and reduced precision lookups produce the embedding
+  // vectors of all tables first, on the device of GPU instances and on the
+  // host of CPU instances, which are then written into the table outputs.
+  if (model_state_->PoolEmbeddings() || model_state_->KeyDeduplication() ||
+      model_state_->VectorDataType() != TRITONSERVER_TYPE_FP32) {
+    const float* vectors = nullptr;
+    RETURN_IF_ERROR(LookupVectors(num_keys_per_table, num_samples, &vectors));
+    for (size_t t = 0; t < num_tables; ++t) {
+      const size_t table_size =
+          OutputRows(t, num_keys_per_table, num_samples) * ev_sizes[t];
+      const TableOutput& output = table_outputs_[t];
+      if (output.name != nullptr) {
+        RETURN_IF_ERROR(WriteVectors(
+            output.buffer, output.memory_type, output.memory_type_id, vectors,
+            table_size));
+      }
+      vectors += table_size;
+    }
+    return nullptr;
+  }
+
+  HPS_RETURN_TRITION_ERROR_IF_TRUE(
+      num_tables == 0, INVALID_ARG,
+      "The request does not contain keys of any embedding table.");
+  keys_per_table_.resize(num_tables);
+  lookup_buffer_offset_per_table_.resize(num_tables);
+
+  // Every table gets its own part of the lookup result buffer, unless its
+  // output can be written to directly.
+  const long long* keys = cat_column_index_buf_int64->get_ptr();
+  float* lookup_output = lookup_result_buf->get_ptr();
+  for (size_t t = 0; t < num_tables; ++t) {
+    const TableOutput& output = table_outputs_[t];
+    keys_per_table_[t] = keys;
+    lookup_buffer_offset_per_table_[t] =
+        output.name != nullptr &&
+                CanLookupInto(output.memory_type, output.memory_type_id)
+            ? reinterpret_cast<float*>(output.buffer)
+            : lookup_output;
+    keys += num_keys_per_table[t];
+    lookup_output += ev_sizes[t] * num_keys_per_table[t];
+  }
+  Lookup(num_keys_per_table);
+
+  for (size_t t = 0; t < num_tables; ++t) {
+    const TableOutput& output = table_outputs_[t];
+    if (output.name == nullptr ||
+        lookup_buffer_offset_per_table_[t] == output.buffer) {
+      continue;
+    }
+    CopyLookupResult(
+        output.buffer, output.memory_type, lookup_buffer_offset_per_table_[t],
+        ev_sizes[t] * num_keys_per_table[t] * sizeof(float));
+  }
+  return nullptr;
+}
+
+void
+ModelInstanceState::RecordPhaseLatencies(
+    const uint64_t exec_start_ns, const uint64_t compute_start_ns,
+    const uint64_t compute_end_ns, const uint64_t exec_end_ns)
+{
+  input_latency_.record(compute_start_ns - exec_start_ns);
+  lookup_latency_.record(compute_end_ns - compute_start_ns);
+  output_latency_.record(exec_end_ns - compute_end_ns);
+
+  // Periodically summarize where the time goes.
+  if (lookup_latency_.count() % 1000 == 0) {
+    LogPhaseLatencies(TRITONSERVER_LOG_VERBOSE);
+  }
+}
+
+void
+ModelInstanceState::LogPhaseLatencies(const TRITONSERVER_LogLevel level) const
+{
+  if (!TRITONSERVER_LogIsEnabled(level)) {
+    return;
+  }
+  const std::string msg = hps_str_concat(
+      "Model ", name_, " on device ", device_id_,
+      " phase latencies:\n\tkey staging: ", input_latency_.to_string(),
+      "\n\tlookup: ", lookup_latency_.to_string(),
+      "\n\toutput copy: ", output_latency_.to_string());
+  LOG_IF_ERROR(
+      TRITONSERVER_LogMessage(level, __FILE__, __LINE__, msg.c_str()),
+      "failed to log message: ");
+}
+
 
 }}}  // namespace triton::backend::hps
\ No newline at end of file
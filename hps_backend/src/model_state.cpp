@@ -26,8 +26,12 @@
 
 
 #include <algorithm>
+#include <array>
+#include <backend.hpp>
 #include <cstdlib>
 #include <fstream>
+#include <hot_keys.hpp>
+#include <hps_buffer.hpp>
 #include <map>
 #include <memory>
 #include <model_state.hpp>
@@ -36,6 +40,7 @@
 #include <sstream>
 #include <thread>
 #include <triton_helpers.hpp>
+#include <utility>
 #include <vector>
 
 namespace triton { namespace backend { namespace hps {
@@ -107,7 +112,43 @@ ModelState::Create(
 
 ModelState::~ModelState()
 {
-  if (support_gpu_cache_ && version_ps_ == version_) {
+  if (prefetch_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(prefetch_mutex_);
+      stop_prefetching_ = true;
+    }
+    prefetch_cv_.notify_one();
+    prefetch_thread_.join();
+  }
+  for (TRITONSERVER_Metric* metric :
+       {prefetch_requests_metric_, prefetch_dropped_metric_,
+        prefetched_keys_metric_, prefetch_hits_metric_}) {
+    if (metric != nullptr) {
+      LOG_IF_ERROR(
+          TRITONSERVER_MetricDelete(metric), "failed to delete metric");
+    }
+  }
+  for (size_t t = 0; t < host_embedding_caches_.size(); ++t) {
+    HPS_TRITON_LOG(
+        INFO, "Model ", name_, " host embedding cache of table ", t, ": ",
+        host_embedding_caches_[t]->to_string());
+  }
+  if (!key_frequency_snapshot_.empty() && TracksKeyFrequencies()) {
+    std::vector<std::vector<HotKey>> hot_keys;
+    for (const std::unique_ptr<KeyFrequencySketch>& sketch :
+         key_frequency_sketches_) {
+      hot_keys.emplace_back(sketch->HotKeys());
+    }
+    std::string error;
+    if (WriteHotKeys(key_frequency_snapshot_, hot_keys, &error)) {
+      HPS_TRITON_LOG(
+          INFO, "Wrote the key frequency snapshot of model ", name_, " to ",
+          key_frequency_snapshot_);
+    } else {
+      HPS_TRITON_LOG(ERROR, error);
+    }
+  }
+  if (support_gpu_cache_ && !gpu_shape.empty() && version_ps_ == version_) {
     EmbeddingTable_int64->destory_embedding_cache_per_model(name_);
     HPS_TRITON_LOG(
         INFO, "******Destorying Embedding Cache for model ", name_,
@@ -129,15 +170,15 @@ ModelState::ValidateModelConfig()
     HPS_TRITON_LOG(INFO, "Verifying model configuration: ", tmp.Contents());
   }
 
-  // There must be 3 inputs.
+  // There must be 2 inputs, and optionally the per-sample key offsets.
   {
     common::TritonJson::Value inputs;
     RETURN_IF_ERROR(model_config_.MemberAsArray("input", &inputs));
     HPS_RETURN_TRITON_ERROR_IF_FALSE(
-        inputs.ArraySize() == 2, INVALID_ARG, "expect 2 input, got ",
-        inputs.ArraySize());
+        inputs.ArraySize() == 2 || inputs.ArraySize() == 3, INVALID_ARG,
+        "expect 2 or 3 inputs, got ", inputs.ArraySize());
 
-    for (size_t i = 0; i < 2; i++) {
+    for (size_t i = 0; i < inputs.ArraySize(); i++) {
       common::TritonJson::Value input;
       RETURN_IF_ERROR(inputs.IndexAsObject(i, &input));
 
@@ -146,7 +187,7 @@ ModelState::ValidateModelConfig()
       RETURN_IF_ERROR(TritonJsonHelper::parse(name, input, "name", true));
       HPS_RETURN_TRITON_ERROR_IF_FALSE(
           GetInputmap().count(name) > 0, INVALID_ARG,
-          "expected input name as KEYS and NUMKEYS, but got ", name);
+          "expected input name as KEYS, NUMKEYS or OFFSETS, but got ", name);
 
       // Datatype.
       std::string data_type;
@@ -154,14 +195,21 @@ ModelState::ValidateModelConfig()
           TritonJsonHelper::parse(data_type, input, "data_type", true));
       if (name == "KEYS") {
         HPS_RETURN_TRITON_ERROR_IF_FALSE(
-            data_type == "TYPE_INT64", INVALID_ARG,
-            "expected KEYS input datatype as TYPE_INT64, "
-            "got ",
+            data_type == "TYPE_INT64" || data_type == "TYPE_INT32",
+            INVALID_ARG,
+            "expected KEYS input datatype as TYPE_INT64 or TYPE_INT32, got ",
             data_type);
+        key_data_type_ =
+            backend::ModelConfigDataTypeToTritonServerDataType(data_type);
       } else if (name == "NUMKEYS") {
         HPS_RETURN_TRITON_ERROR_IF_FALSE(
             data_type == "TYPE_INT32", INVALID_ARG,
             "expected NUMKEYS input datatype as TYPE_FP32, got ", data_type);
+      } else if (name == "OFFSETS") {
+        HPS_RETURN_TRITON_ERROR_IF_FALSE(
+            data_type == "TYPE_INT32", INVALID_ARG,
+            "expected OFFSETS input datatype as TYPE_INT32, got ", data_type);
+        has_offsets_input_ = true;
       }
 
       // Input shape.
@@ -173,30 +221,76 @@ ModelState::ValidateModelConfig()
     }
   }
 
-  // And there must be 1 output.
+  // And there must be 1 output, or 1 output named after each embedding
+  // table, and optionally the row splits.
   {
+    const std::vector<std::string>& table_names =
+        Model_Inference_Para.embedding_table_names;
     common::TritonJson::Value outputs;
     RETURN_IF_ERROR(model_config_.MemberAsArray("output", &outputs));
-    HPS_RETURN_TRITON_ERROR_IF_FALSE(
-        outputs.ArraySize() == 1, INVALID_ARG, "expect 1 output, got ",
-        outputs.ArraySize());
 
-    common::TritonJson::Value output;
-    RETURN_IF_ERROR(outputs.IndexAsObject(0, &output));
+    size_t num_row_splits_outputs = 0;
+    size_t num_vector_outputs = 0;
+    for (size_t i = 0; i < outputs.ArraySize(); i++) {
+      common::TritonJson::Value output;
+      RETURN_IF_ERROR(outputs.IndexAsObject(i, &output));
 
-    std::string data_type;
-    RETURN_IF_ERROR(
-        TritonJsonHelper::parse(data_type, output, "data_type", true));
-    HPS_RETURN_TRITON_ERROR_IF_FALSE(
-        data_type == "TYPE_FP32", INVALID_ARG,
-        "expected  output datatype as TYPE_FP32, got ", data_type);
+      std::string name;
+      RETURN_IF_ERROR(TritonJsonHelper::parse(name, output, "name", true));
+      num_row_splits_outputs += name == kRowSplitsOutput;
+      const auto table_name =
+          std::find(table_names.begin(), table_names.end(), name);
+      if (table_name != table_names.end()) {
+        table_output_map_.emplace(name, table_name - table_names.begin());
+      }
 
-    // output must have -1 shape
-    std::vector<int64_t> shape;
-    RETURN_IF_ERROR(backend::ParseShape(output, "dims", &shape));
+      // All outputs of embedding vectors share one datatype.
+      std::string data_type;
+      RETURN_IF_ERROR(
+          TritonJsonHelper::parse(data_type, output, "data_type", true));
+      if (name == kRowSplitsOutput) {
+        HPS_RETURN_TRITON_ERROR_IF_FALSE(
+            data_type == "TYPE_INT32", INVALID_ARG, "expected ", name,
+            " output datatype as TYPE_INT32, got ", data_type);
+      } else {
+        HPS_RETURN_TRITON_ERROR_IF_FALSE(
+            data_type == "TYPE_FP32" || data_type == "TYPE_FP16" ||
+                data_type == "TYPE_BF16",
+            INVALID_ARG, "expected ", name,
+            " output datatype as TYPE_FP32, TYPE_FP16 or TYPE_BF16, got ",
+            data_type);
+        const TRITONSERVER_DataType vector_data_type =
+            backend::ModelConfigDataTypeToTritonServerDataType(data_type);
+        HPS_RETURN_TRITION_ERROR_IF_TRUE(
+            num_vector_outputs++ > 0 && vector_data_type != vector_data_type_,
+            INVALID_ARG, "expected all outputs of embedding vectors to have ",
+            "the same datatype, got ", data_type, " for ", name);
+        vector_data_type_ = vector_data_type;
+      }
+
+      // output must have -1 shape
+      std::vector<int64_t> shape;
+      RETURN_IF_ERROR(backend::ParseShape(output, "dims", &shape));
+      HPS_RETURN_TRITON_ERROR_IF_FALSE(
+          shape[0] == -1, INVALID_ARG, "expected  output shape equal -1, got ",
+          backend::ShapeToString(shape));
+    }
+
+    const size_t num_embedding_outputs =
+        outputs.ArraySize() - num_row_splits_outputs;
     HPS_RETURN_TRITON_ERROR_IF_FALSE(
-        shape[0] == -1, INVALID_ARG, "expected  output shape equal -1, got ",
-        backend::ShapeToString(shape));
+        num_row_splits_outputs <= 1 &&
+            (num_embedding_outputs == 1 ||
+             (num_embedding_outputs == table_names.size() &&
+              table_output_map_.size() == table_names.size())),
+        INVALID_ARG,
+        "expected 1 output of embedding vectors or 1 output named after each "
+        "embedding table [",
+        hps_str_join(", ", table_names), "] besides ", kRowSplitsOutput,
+        ", got ", outputs.ArraySize(), " outputs");
+    if (num_embedding_outputs == 1 && table_names.size() > 1) {
+      table_output_map_.clear();
+    }
   }
 
   return nullptr;  // success
@@ -225,8 +319,14 @@ ModelState::ParseModelConfig()
     std::string kind;
     RETURN_IF_ERROR(instance.MemberAsString("kind", &kind));
     HPS_RETURN_TRITON_ERROR_IF_FALSE(
-        kind == "KIND_GPU", INVALID_ARG,
-        "expect GPU kind instance in instance group , got ", kind);
+        kind == "KIND_GPU" || kind == "KIND_CPU", INVALID_ARG,
+        "expect GPU or CPU kind instance in instance group , got ", kind);
+    // CPU instances look up the host-side tiers of the parameter server and
+    // need neither GPUs nor worker buffers.
+    if (kind == "KIND_CPU") {
+      has_cpu_instances_ = true;
+      continue;
+    }
 
     int64_t count;
     RETURN_IF_ERROR(instance.MemberAsInt("count", &count));
@@ -245,7 +345,138 @@ ModelState::ParseModelConfig()
   }
 
   // Parse HugeCTR model customized configuration.
+  common::TritonJson::Value parameters;
+  if (model_config_.Find("parameters", &parameters)) {
+    common::TritonJson::Value value;
+
+    if (parameters.Find("deduplicate_keys", &value)) {
+      RETURN_IF_ERROR(TritonJsonHelper::parse(
+          key_deduplication_, value, "string_value", false));
+    }
+
+    // Keys of tables with a combiner are pooled into one embedding vector per
+    // sample.
+    if (parameters.Find("combiner_per_table", &value)) {
+      std::string tmp;
+      RETURN_IF_ERROR(
+          TritonJsonHelper::parse(tmp, value, "string_value", false));
+      bool pooled = false;
+      for (const std::string& combiner : hps_str_split(tmp, ',')) {
+        if (combiner == "none") {
+          combiner_per_table_.push_back(Combiner::kNone);
+        } else if (combiner == "sum") {
+          combiner_per_table_.push_back(Combiner::kSum);
+        } else if (combiner == "mean") {
+          combiner_per_table_.push_back(Combiner::kMean);
+        } else if (combiner == "sqrtn") {
+          combiner_per_table_.push_back(Combiner::kSqrtN);
+        } else {
+          return HPS_TRITON_ERROR(
+              INVALID_ARG, "expected combiner as none, sum, mean or sqrtn, ",
+              "got ", combiner);
+        }
+        pooled |= combiner_per_table_.back() != Combiner::kNone;
+      }
+      HPS_RETURN_TRITON_ERROR_IF_FALSE(
+          combiner_per_table_.size() ==
+              Model_Inference_Para.embedding_vecsize_per_table.size(),
+          INVALID_ARG, "expected one combiner per embedding table (",
+          Model_Inference_Para.embedding_vecsize_per_table.size(), "), got ",
+          combiner_per_table_.size());
+      HPS_TRITON_LOG(INFO, "combiner per table = [", tmp, "]");
+      if (!pooled) {
+        combiner_per_table_.clear();
+      }
+    }
+
+    if (parameters.Find("cpu_lookup_threads", &value)) {
+      RETURN_IF_ERROR(TritonJsonHelper::parse(
+          cpu_lookup_threads_, value, "string_value", false));
+      HPS_RETURN_TRITON_ERROR_IF_FALSE(
+          cpu_lookup_threads_ > 0, INVALID_ARG,
+          "expected cpu_lookup_threads greater than 0, got ",
+          cpu_lookup_threads_);
+    }
+
+    if (parameters.Find("prefetch_queue_size", &value)) {
+      RETURN_IF_ERROR(TritonJsonHelper::parse(
+          prefetch_queue_size_, value, "string_value", false));
+      HPS_TRITON_LOG(INFO, "prefetch queue size = ", prefetch_queue_size_);
+    }
+
+    if (parameters.Find("host_cache_size", &value)) {
+      RETURN_IF_ERROR(TritonJsonHelper::parse(
+          host_cache_size_, value, "string_value", false));
+    }
 
+    if (parameters.Find("host_cache_ttl_ms", &value)) {
+      RETURN_IF_ERROR(TritonJsonHelper::parse(
+          host_cache_ttl_ms_, value, "string_value", false));
+      HPS_RETURN_TRITON_ERROR_IF_FALSE(
+          host_cache_ttl_ms_ > 0, INVALID_ARG,
+          "expected host_cache_ttl_ms greater than 0, got ",
+          host_cache_ttl_ms_);
+    }
+
+    if (parameters.Find("hot_key_file", &value)) {
+      RETURN_IF_ERROR(TritonJsonHelper::parse(
+          hot_key_file_, value, "string_value", false));
+      HPS_TRITON_LOG(INFO, "hot key file = ", hot_key_file_);
+    }
+
+    if (parameters.Find("max_hot_keys_per_table", &value)) {
+      RETURN_IF_ERROR(TritonJsonHelper::parse(
+          max_hot_keys_per_table_, value, "string_value", false));
+      HPS_TRITON_LOG(
+          INFO, "max hot keys per table = ", max_hot_keys_per_table_);
+    }
+
+    if (parameters.Find("key_frequency_sketch_size", &value)) {
+      RETURN_IF_ERROR(TritonJsonHelper::parse(
+          key_frequency_sketch_size_, value, "string_value", false));
+      HPS_TRITON_LOG(
+          INFO, "key frequency sketch size = ", key_frequency_sketch_size_);
+    }
+
+    if (parameters.Find("tracked_hot_keys_per_table", &value)) {
+      RETURN_IF_ERROR(TritonJsonHelper::parse(
+          tracked_hot_keys_per_table_, value, "string_value", false));
+      HPS_TRITON_LOG(
+          INFO, "tracked hot keys per table = ", tracked_hot_keys_per_table_);
+    }
+
+    if (parameters.Find("key_frequency_snapshot", &value)) {
+      RETURN_IF_ERROR(TritonJsonHelper::parse(
+          key_frequency_snapshot_, value, "string_value", false));
+      HPS_TRITON_LOG(
+          INFO, "key frequency snapshot = ", key_frequency_snapshot_);
+    }
+  }
+  HPS_TRITON_LOG(INFO, "deduplicate keys = ", key_deduplication_);
+  if (has_cpu_instances_) {
+    HPS_TRITON_LOG(INFO, "cpu lookup threads = ", cpu_lookup_threads_);
+  }
+  // The host embedding caches split their capacity evenly between the
+  // embedding tables.
+  const std::vector<size_t>& ev_sizes =
+      Model_Inference_Para.embedding_vecsize_per_table;
+  if (has_cpu_instances_ && host_cache_size_ > 0 && !ev_sizes.empty()) {
+    for (const size_t ev_size : ev_sizes) {
+      host_embedding_caches_.emplace_back(new HostEmbeddingCache(
+          host_cache_size_ / ev_sizes.size(), ev_size,
+          host_cache_ttl_ms_ * 1000000));
+    }
+    HPS_TRITON_LOG(
+        INFO, "host cache size = ", host_cache_size_, " bytes, ttl = ",
+        host_cache_ttl_ms_, " ms");
+  }
+  if (key_frequency_sketch_size_ > 0) {
+    for (size_t t = 0;
+         t < Model_Inference_Para.embedding_vecsize_per_table.size(); ++t) {
+      key_frequency_sketches_.emplace_back(new KeyFrequencySketch(
+          key_frequency_sketch_size_, tracked_hot_keys_per_table_));
+    }
+  }
 
   if (Model_Inference_Para.maxnum_catfeature_query_per_table_per_sample.size() >
       0) {
@@ -287,6 +518,7 @@ TRITONSERVER_Error*
 ModelState::Create_EmbeddingCache()
 {
   int64_t count = gpu_shape.size();
+  std::vector<std::vector<long long>> hot_keys;
   if (count > 0 && support_gpu_cache_) {
     if (support_int64_key_ && EmbeddingTable_int64->get_embedding_cache(
                                   name_, gpu_shape[0]) == nullptr) {
@@ -304,6 +536,21 @@ ModelState::Create_EmbeddingCache()
       EmbeddingTable_int64->create_embedding_cache_per_model(
           Model_Inference_Para);
     }
+    if (!hot_key_file_.empty()) {
+      std::string error;
+      HPS_RETURN_TRITON_ERROR_IF_FALSE(
+          ReadHotKeys(
+              hot_key_file_,
+              Model_Inference_Para.embedding_vecsize_per_table.size(),
+              max_hot_keys_per_table_, &hot_keys, &error),
+          INVALID_ARG, error);
+    }
+  } else if (has_cpu_instances_ && support_int64_key_) {
+    // Models with only CPU instances have no embedding cache, but are served
+    // from the databases of the parameter server.
+    HPS_TRITON_LOG(
+        INFO, "Update Database of Parameter Server for model ", name_);
+    EmbeddingTable_int64->update_database_per_model(Model_Inference_Para);
   }
   for (int i = 0; i < count; i++) {
     std::vector<int>::iterator iter = find(
@@ -323,13 +570,335 @@ ModelState::Create_EmbeddingCache()
         Model_Inference_Para.device_id = gpu_shape[i];
         embedding_cache_map[gpu_shape[i]] =
             EmbeddingTable_int64->get_embedding_cache(name_, gpu_shape[i]);
+        if (!hot_keys.empty()) {
+          RETURN_IF_ERROR(WarmUpEmbeddingCache(gpu_shape[i], hot_keys));
+        }
       }
     }
   }
   HPS_TRITON_LOG(
       INFO, "******Creating Embedding Cache for model ", name_,
       " successfully");
+
+  if (Prefetching()) {
+    HPS_RETURN_TRITION_ERROR_IF_TRUE(
+        embedding_cache_map.empty() && host_embedding_caches_.empty(),
+        UNSUPPORTED, "Model ", name_,
+        " has neither an embedding cache nor a host embedding cache to "
+        "prefetch into.");
+    prefetch_tracker_.reset(new PrefetchTracker(2 * prefetch_queue_size_));
+    prefetch_thread_ = std::thread(&ModelState::PrefetchLoop, this);
+  }
   return nullptr;
 }
 
-}}}  // namespace triton::backend::hps
\ No newline at end of file
+std::vector<size_t>
+ModelState::CacheLookupBatchSizes() const
+{
+  const std::vector<size_t>& max_keys_per_sample =
+      Model_Inference_Para.maxnum_catfeature_query_per_table_per_sample;
+  std::vector<size_t> batch_sizes(
+      Model_Inference_Para.embedding_vecsize_per_table.size());
+  for (size_t t = 0; t < batch_sizes.size(); ++t) {
+    batch_sizes[t] = Model_Inference_Para.max_batchsize;
+    if (t < max_keys_per_sample.size() && max_keys_per_sample[t] > 0) {
+      batch_sizes[t] *= max_keys_per_sample[t];
+    }
+  }
+  return batch_sizes;
+}
+
+TRITONSERVER_Error*
+ModelState::WarmUpEmbeddingCache(
+    const int64_t device_id,
+    const std::vector<std::vector<long long>>& hot_keys)
+{
+  // Not operator[], which would insert a null cache for an unknown device
+  // while other threads may read the map.
+  const auto it = embedding_cache_map.find(device_id);
+  HugeCTR::EmbeddingCacheBase* const embedding_cache =
+      it != embedding_cache_map.end() ? it->second.get() : nullptr;
+  HPS_RETURN_TRITON_ERROR_IF_FALSE(
+      embedding_cache != nullptr, INTERNAL,
+      "missing embedding cache of model ", name_, " in device ", device_id);
+
+  // Look up the hot keys in batches as large as a request can be. With a hit
+  // rate threshold of 1, the missing embeddings are fetched from the
+  // parameter server and inserted into the cache before the lookup returns.
+  const std::vector<size_t>& vector_sizes =
+      Model_Inference_Para.embedding_vecsize_per_table;
+  const std::vector<size_t> batch_sizes = CacheLookupBatchSizes();
+  size_t max_num_elements = 0;
+  for (size_t t = 0; t < hot_keys.size(); ++t) {
+    max_num_elements =
+        std::max(max_num_elements, batch_sizes[t] * vector_sizes[t]);
+  }
+
+  uint64_t exec_start_ns = 0;
+  SET_TIMESTAMP(exec_start_ns);
+  size_t num_hot_keys = 0;
+  cudaStream_t stream = nullptr;
+  try {
+    CK_CUDA_THROW_(cudaSetDevice(device_id));
+    auto vectors_buf = HugeCTRBuffer<float>::create();
+    vectors_buf->reserve({max_num_elements});
+    vectors_buf->allocate();
+    CK_CUDA_THROW_(cudaStreamCreate(&stream));
+    for (size_t t = 0; t < hot_keys.size(); ++t) {
+      const std::vector<long long>& keys = hot_keys[t];
+      for (size_t i = 0; i < keys.size(); i += batch_sizes[t]) {
+        const size_t num_keys = std::min(batch_sizes[t], keys.size() - i);
+        embedding_cache->lookup(
+            t, vectors_buf->get_ptr(), &keys[i], num_keys, 1.0f, stream);
+        CK_CUDA_THROW_(cudaStreamSynchronize(stream));
+      }
+      num_hot_keys += keys.size();
+    }
+    CK_CUDA_THROW_(cudaStreamDestroy(std::exchange(stream, nullptr)));
+  }
+  catch (const std::exception& e) {
+    // Do not leak the stream if a lookup failed.
+    if (stream != nullptr) {
+      cudaStreamDestroy(stream);
+    }
+    return HPS_TRITON_ERROR(
+        INTERNAL, "failed to warm up the embedding cache of model ", name_,
+        " in device ", device_id, ": ", e.what());
+  }
+
+  uint64_t exec_end_ns = 0;
+  SET_TIMESTAMP(exec_end_ns);
+  HPS_TRITON_LOG(
+      INFO, "Warmed up the embedding cache of model ", name_, " in device ",
+      device_id, " with ", num_hot_keys, " hot keys in ",
+      (exec_end_ns - exec_start_ns) / 1000000, " ms");
+  return nullptr;
+}
+
+// Create a counter of the given family, labeled with the name and version of
+// the model. Null if the family is not available.
+static TRITONSERVER_Metric*
+NewModelCounter(
+    TRITONSERVER_MetricFamily* family, const std::string& model_name,
+    const uint64_t model_version)
+{
+  if (family == nullptr) {
+    return nullptr;
+  }
+  const std::string version = std::to_string(model_version);
+  std::array<const TRITONSERVER_Parameter*, 2> labels = {
+      TRITONSERVER_ParameterNew(
+          "model", TRITONSERVER_PARAMETER_STRING, model_name.c_str()),
+      TRITONSERVER_ParameterNew(
+          "version", TRITONSERVER_PARAMETER_STRING, version.c_str())};
+  TRITONSERVER_Metric* metric = nullptr;
+  LOG_IF_ERROR(
+      TRITONSERVER_MetricNew(&metric, family, labels.data(), labels.size()),
+      "failed to create metric");
+  for (const TRITONSERVER_Parameter* label : labels) {
+    TRITONSERVER_ParameterDelete(const_cast<TRITONSERVER_Parameter*>(label));
+  }
+  return metric;
+}
+
+static void
+IncrementCounter(TRITONSERVER_Metric* metric, const double value)
+{
+  if (metric != nullptr) {
+    LOG_IF_ERROR(
+        TRITONSERVER_MetricIncrement(metric, value),
+        "failed to update metric");
+  }
+}
+
+void
+ModelState::Prefetch(
+    const long long* const keys, const std::vector<size_t>& num_keys_per_table)
+{
+  const size_t num_keys = std::accumulate(
+      num_keys_per_table.begin(), num_keys_per_table.end(), size_t{0});
+  bool queued = false;
+  {
+    std::lock_guard<std::mutex> lock(prefetch_mutex_);
+    if (num_queued_prefetch_keys_ + num_keys <= prefetch_queue_size_) {
+      // Grow the ring once all of its batches are queued.
+      if (num_queued_prefetches_ == prefetch_queue_.size()) {
+        std::rotate(
+            prefetch_queue_.begin(),
+            prefetch_queue_.begin() + prefetch_queue_head_,
+            prefetch_queue_.end());
+        prefetch_queue_head_ = 0;
+        prefetch_queue_.emplace_back();
+      }
+      PrefetchBatch& batch =
+          prefetch_queue_[(prefetch_queue_head_ + num_queued_prefetches_) %
+                          prefetch_queue_.size()];
+      batch.keys.assign(keys, keys + num_keys);
+      batch.num_keys_per_table.assign(
+          num_keys_per_table.begin(), num_keys_per_table.end());
+      ++num_queued_prefetches_;
+      num_queued_prefetch_keys_ += num_keys;
+      queued = true;
+    }
+  }
+  if (queued) {
+    prefetch_cv_.notify_one();
+    IncrementCounter(prefetch_requests_metric_, 1);
+  } else {
+    IncrementCounter(prefetch_dropped_metric_, 1);
+  }
+}
+
+void
+ModelState::RecordPrefetchHits(
+    const size_t table, const long long* const keys, const size_t num_keys)
+{
+  const size_t num_hits = prefetch_tracker_->consume(table, keys, num_keys);
+  if (num_hits > 0) {
+    IncrementCounter(prefetch_hits_metric_, num_hits);
+  }
+}
+
+void
+ModelState::PrefetchLoop()
+{
+  // Each device cache is loaded through a stream and a vector buffer of its
+  // own, which last as long as the loop.
+  struct DeviceCache {
+    int64_t device_id;
+    HugeCTR::EmbeddingCacheBase* cache;
+    cudaStream_t stream;
+    std::shared_ptr<HugeCTRBuffer<float>> vectors_buf;
+  };
+  const std::vector<size_t>& vector_sizes =
+      Model_Inference_Para.embedding_vecsize_per_table;
+  const std::vector<size_t> batch_sizes = CacheLookupBatchSizes();
+  size_t max_num_elements = 0;
+  for (size_t t = 0; t < batch_sizes.size(); ++t) {
+    max_num_elements =
+        std::max(max_num_elements, batch_sizes[t] * vector_sizes[t]);
+  }
+  std::vector<DeviceCache> device_caches;
+  try {
+    for (const auto& device_cache : embedding_cache_map) {
+      CK_CUDA_THROW_(cudaSetDevice(device_cache.first));
+      DeviceCache loader{
+          device_cache.first, device_cache.second.get(), nullptr,
+          HugeCTRBuffer<float>::create()};
+      CK_CUDA_THROW_(cudaStreamCreate(&loader.stream));
+      loader.vectors_buf->reserve({max_num_elements});
+      loader.vectors_buf->allocate();
+      device_caches.push_back(loader);
+    }
+  }
+  catch (const std::exception& e) {
+    HPS_TRITON_LOG(
+        ERROR, "Failed to set up prefetching for model ", name_, ": ",
+        e.what());
+  }
+
+  std::vector<long long> missed_keys;
+  std::vector<float> vectors;
+  PrefetchBatch batch;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(prefetch_mutex_);
+      prefetch_cv_.wait(lock, [this] {
+        return stop_prefetching_ || num_queued_prefetches_ > 0;
+      });
+      if (stop_prefetching_) {
+        break;
+      }
+      std::swap(batch, prefetch_queue_[prefetch_queue_head_]);
+      prefetch_queue_head_ =
+          (prefetch_queue_head_ + 1) % prefetch_queue_.size();
+      --num_queued_prefetches_;
+      num_queued_prefetch_keys_ -= batch.keys.size();
+    }
+
+    // With a hit rate threshold of 1, the missing embeddings are inserted
+    // into the device caches before the lookup returns. Host caches are
+    // filled from the parameter server.
+    try {
+      const long long* keys = batch.keys.data();
+      for (size_t t = 0; t < batch.num_keys_per_table.size(); ++t) {
+        const size_t num_keys = batch.num_keys_per_table[t];
+        for (DeviceCache& loader : device_caches) {
+          CK_CUDA_THROW_(cudaSetDevice(loader.device_id));
+          for (size_t i = 0; i < num_keys; i += batch_sizes[t]) {
+            loader.cache->lookup(
+                t, loader.vectors_buf->get_ptr(), &keys[i],
+                std::min(batch_sizes[t], num_keys - i), 1.0f, loader.stream);
+          }
+          CK_CUDA_THROW_(cudaStreamSynchronize(loader.stream));
+        }
+        HostEmbeddingCache* const host_cache = GetHostEmbeddingCache(t);
+        if (host_cache != nullptr) {
+          uint64_t now_ns = 0;
+          SET_TIMESTAMP(now_ns);
+          vectors.resize(vector_sizes[t]);
+          missed_keys.clear();
+          for (size_t i = 0; i < num_keys; ++i) {
+            if (!host_cache->find(keys[i], now_ns, vectors.data())) {
+              missed_keys.push_back(keys[i]);
+            }
+          }
+          vectors.resize(missed_keys.size() * vector_sizes[t]);
+          EmbeddingTable_int64->lookup(
+              missed_keys.data(), missed_keys.size(), vectors.data(), name_,
+              t);
+          for (size_t m = 0; m < missed_keys.size(); ++m) {
+            host_cache->insert(
+                missed_keys[m], now_ns, &vectors[m * vector_sizes[t]]);
+          }
+        }
+        for (size_t i = 0; i < num_keys; ++i) {
+          prefetch_tracker_->mark(t, keys[i]);
+        }
+        keys += num_keys;
+      }
+      IncrementCounter(prefetched_keys_metric_, batch.keys.size());
+    }
+    catch (const std::exception& e) {
+      HPS_TRITON_LOG(
+          ERROR, "Failed to prefetch keys of model ", name_, ": ", e.what());
+    }
+  }
+
+  for (DeviceCache& loader : device_caches) {
+    cudaSetDevice(loader.device_id);
+    cudaStreamDestroy(loader.stream);
+  }
+}
+
+void
+ModelState::CreateMetrics(HPSBackend* backend)
+{
+  if (Prefetching()) {
+    prefetch_requests_metric_ = NewModelCounter(
+        backend->CounterFamily(
+            "nv_hps_prefetch_requests",
+            "Number of prefetch requests queued for loading"),
+        name_, version_);
+    prefetch_dropped_metric_ = NewModelCounter(
+        backend->CounterFamily(
+            "nv_hps_prefetch_dropped_requests",
+            "Number of prefetch requests dropped because the prefetch queue "
+            "was full"),
+        name_, version_);
+    prefetched_keys_metric_ = NewModelCounter(
+        backend->CounterFamily(
+            "nv_hps_prefetched_keys",
+            "Number of keys loaded into the embedding caches by prefetch "
+            "requests"),
+        name_, version_);
+    prefetch_hits_metric_ = NewModelCounter(
+        backend->CounterFamily(
+            "nv_hps_prefetch_hits",
+            "Number of looked up keys that had been prefetched since they "
+            "were last looked up"),
+        name_, version_);
+  }
+}
+
+}}}  // namespace triton::backend::hps
@@ -0,0 +1,851 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//
+// Checks that TRITONBACKEND_ModelInstanceExecute does not allocate once it has
+// served a request of the same size. The test loads a small model with one
+// instance through the backend entry points, against stand-ins for the Triton
+// server API that keep all request and response objects in place. It then
+// executes the same request twice and counts the calls of operator new during
+// the second execution.
+//
+// By default, the instance is a KIND_CPU instance with a host embedding
+// cache, which serves all keys of the second execution. With --gpu, it is a
+// KIND_GPU instance on device 0 whose GPU embedding cache holds the whole
+// table. The GPU case exits with 77, which ctest reports as skipped, on hosts
+// without a CUDA device.
+//
+
+#include <cuda_runtime_api.h>
+#include <triton/core/tritonbackend.h>
+#include <triton/core/tritonserver.h>
+
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+// Every allocation through operator new is counted.
+static std::atomic<size_t> num_allocations{0};
+
+void*
+operator new(const std::size_t size)
+{
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* const ptr = std::malloc(size != 0 ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void*
+operator new(const std::size_t size, const std::align_val_t alignment)
+{
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  const size_t align = static_cast<size_t>(alignment);
+  if (void* const ptr =
+          std::aligned_alloc(align, (size + align - 1) / align * align)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void
+operator delete(void* const ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void
+operator delete(void* const ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+void
+operator delete(void* const ptr, std::align_val_t) noexcept
+{
+  std::free(ptr);
+}
+
+void
+operator delete(void* const ptr, std::size_t, std::align_val_t) noexcept
+{
+  std::free(ptr);
+}
+
+//
+// Stand-ins for the Triton server objects. Requests own their inputs, their
+// response and its output, so that executing a request allocates nothing on
+// the server side.
+//
+
+struct TRITONSERVER_Error {
+  TRITONSERVER_Error_Code code;
+  std::string message;
+};
+
+struct TRITONSERVER_Message {
+  std::string json;
+};
+
+struct TRITONBACKEND_Backend {
+  TRITONSERVER_Message config;
+  void* state = nullptr;
+};
+
+struct TRITONBACKEND_Model {
+  TRITONBACKEND_Backend* backend = nullptr;
+  TRITONSERVER_Message config;
+  void* state = nullptr;
+};
+
+struct TRITONBACKEND_ModelInstance {
+  TRITONBACKEND_Model* model = nullptr;
+  TRITONSERVER_InstanceGroupKind kind = TRITONSERVER_INSTANCEGROUPKIND_CPU;
+  void* state = nullptr;
+};
+
+struct TRITONBACKEND_Input {
+  const char* name = nullptr;
+  TRITONSERVER_DataType datatype = TRITONSERVER_TYPE_INVALID;
+  int64_t shape = 0;
+  const void* buffer = nullptr;
+  uint64_t byte_size = 0;
+};
+
+struct TRITONBACKEND_Output {
+  std::vector<float> buffer;
+  int64_t shape = 0;
+};
+
+struct TRITONBACKEND_Response {
+  TRITONBACKEND_Output output;
+  bool sent = false;
+  std::string error;
+};
+
+struct TRITONBACKEND_Request {
+  std::array<TRITONBACKEND_Input, 2> inputs;
+  TRITONBACKEND_Response response;
+  bool released = false;
+};
+
+namespace {
+
+constexpr char kModelName[] = "hps_allocation_test";
+constexpr size_t kVectorSize = 4;
+constexpr size_t kNumTableKeys = 64;
+
+// Exit code of tests that cannot run on this host.
+constexpr int kSkipReturnCode = 77;
+
+TRITONSERVER_Error*
+StubError(const TRITONSERVER_Error_Code code, const char* const message)
+{
+  return new TRITONSERVER_Error{code, message};
+}
+
+}  // namespace
+
+extern "C" {
+
+TRITONSERVER_Error*
+TRITONSERVER_ErrorNew(TRITONSERVER_Error_Code code, const char* msg)
+{
+  return StubError(code, msg);
+}
+
+void
+TRITONSERVER_ErrorDelete(TRITONSERVER_Error* error)
+{
+  delete error;
+}
+
+TRITONSERVER_Error_Code
+TRITONSERVER_ErrorCode(TRITONSERVER_Error* error)
+{
+  return error->code;
+}
+
+const char*
+TRITONSERVER_ErrorCodeString(TRITONSERVER_Error* error)
+{
+  return "error";
+}
+
+const char*
+TRITONSERVER_ErrorMessage(TRITONSERVER_Error* error)
+{
+  return error->message.c_str();
+}
+
+bool
+TRITONSERVER_LogIsEnabled(TRITONSERVER_LogLevel level)
+{
+  return level != TRITONSERVER_LOG_VERBOSE;
+}
+
+TRITONSERVER_Error*
+TRITONSERVER_LogMessage(
+    TRITONSERVER_LogLevel level, const char* filename, const int line,
+    const char* msg)
+{
+  std::fprintf(stderr, "%s:%d] %s\n", filename, line, msg);
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONSERVER_MessageSerializeToJson(
+    TRITONSERVER_Message* message, const char** base, size_t* byte_size)
+{
+  *base = message->json.c_str();
+  *byte_size = message->json.size();
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONSERVER_MessageDelete(TRITONSERVER_Message* message)
+{
+  // Messages belong to the backend and model stand-ins.
+  return nullptr;
+}
+
+uint32_t
+TRITONSERVER_DataTypeByteSize(TRITONSERVER_DataType datatype)
+{
+  switch (datatype) {
+    case TRITONSERVER_TYPE_INT32:
+    case TRITONSERVER_TYPE_FP32:
+      return 4;
+    case TRITONSERVER_TYPE_INT64:
+      return 8;
+    case TRITONSERVER_TYPE_FP16:
+    case TRITONSERVER_TYPE_BF16:
+      return 2;
+    default:
+      return 0;
+  }
+}
+
+TRITONSERVER_Error*
+TRITONSERVER_MetricFamilyNew(
+    TRITONSERVER_MetricFamily** family, const TRITONSERVER_MetricKind kind,
+    const char* name, const char* description)
+{
+  return StubError(TRITONSERVER_ERROR_UNSUPPORTED, "metrics are disabled");
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ApiVersion(uint32_t* major, uint32_t* minor)
+{
+  *major = TRITONBACKEND_API_VERSION_MAJOR;
+  *minor = TRITONBACKEND_API_VERSION_MINOR;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_BackendName(TRITONBACKEND_Backend* backend, const char** name)
+{
+  *name = "hps";
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_BackendConfig(
+    TRITONBACKEND_Backend* backend, TRITONSERVER_Message** backend_config)
+{
+  *backend_config = &backend->config;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_BackendArtifacts(
+    TRITONBACKEND_Backend* backend, TRITONBACKEND_ArtifactType* artifact_type,
+    const char** location)
+{
+  *artifact_type = TRITONBACKEND_ARTIFACT_FILESYSTEM;
+  *location = "";
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_BackendState(TRITONBACKEND_Backend* backend, void** state)
+{
+  *state = backend->state;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_BackendSetState(TRITONBACKEND_Backend* backend, void* state)
+{
+  backend->state = state;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ModelName(TRITONBACKEND_Model* model, const char** name)
+{
+  *name = kModelName;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ModelVersion(TRITONBACKEND_Model* model, uint64_t* version)
+{
+  *version = 1;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ModelRepository(
+    TRITONBACKEND_Model* model, TRITONBACKEND_ArtifactType* artifact_type,
+    const char** location)
+{
+  *artifact_type = TRITONBACKEND_ARTIFACT_FILESYSTEM;
+  *location = "";
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ModelConfig(
+    TRITONBACKEND_Model* model, const uint32_t config_version,
+    TRITONSERVER_Message** model_config)
+{
+  *model_config = &model->config;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ModelServer(
+    TRITONBACKEND_Model* model, TRITONSERVER_Server** server)
+{
+  *server = nullptr;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ModelBackend(
+    TRITONBACKEND_Model* model, TRITONBACKEND_Backend** backend)
+{
+  *backend = model->backend;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ModelState(TRITONBACKEND_Model* model, void** state)
+{
+  *state = model->state;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ModelSetState(TRITONBACKEND_Model* model, void* state)
+{
+  model->state = state;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ModelInstanceName(
+    TRITONBACKEND_ModelInstance* instance, const char** name)
+{
+  *name = "hps_allocation_test_0_0";
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ModelInstanceKind(
+    TRITONBACKEND_ModelInstance* instance, TRITONSERVER_InstanceGroupKind* kind)
+{
+  *kind = instance->kind;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ModelInstanceDeviceId(
+    TRITONBACKEND_ModelInstance* instance, int32_t* device_id)
+{
+  *device_id = 0;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ModelInstanceModel(
+    TRITONBACKEND_ModelInstance* instance, TRITONBACKEND_Model** model)
+{
+  *model = instance->model;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ModelInstanceState(
+    TRITONBACKEND_ModelInstance* instance, void** state)
+{
+  *state = instance->state;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ModelInstanceSetState(
+    TRITONBACKEND_ModelInstance* instance, void* state)
+{
+  instance->state = state;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ModelInstanceReportStatistics(
+    TRITONBACKEND_ModelInstance* instance, TRITONBACKEND_Request* request,
+    const bool success, const uint64_t exec_start_ns,
+    const uint64_t compute_start_ns, const uint64_t compute_end_ns,
+    const uint64_t exec_end_ns)
+{
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ModelInstanceReportBatchStatistics(
+    TRITONBACKEND_ModelInstance* instance, const uint64_t batch_size,
+    const uint64_t exec_start_ns, const uint64_t compute_start_ns,
+    const uint64_t compute_end_ns, const uint64_t exec_end_ns)
+{
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_RequestId(TRITONBACKEND_Request* request, const char** id)
+{
+  *id = "";
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_RequestCorrelationId(TRITONBACKEND_Request* request, uint64_t* id)
+{
+  *id = 0;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_RequestInputCount(TRITONBACKEND_Request* request, uint32_t* count)
+{
+  *count = request->inputs.size();
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_RequestInputName(
+    TRITONBACKEND_Request* request, const uint32_t index,
+    const char** input_name)
+{
+  if (index >= request->inputs.size()) {
+    return StubError(TRITONSERVER_ERROR_INVALID_ARG, "no such input");
+  }
+  *input_name = request->inputs[index].name;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_RequestInput(
+    TRITONBACKEND_Request* request, const char* name,
+    TRITONBACKEND_Input** input)
+{
+  for (TRITONBACKEND_Input& request_input : request->inputs) {
+    if (std::strcmp(request_input.name, name) == 0) {
+      *input = &request_input;
+      return nullptr;
+    }
+  }
+  return StubError(TRITONSERVER_ERROR_INVALID_ARG, "no such input");
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_RequestOutputCount(
+    TRITONBACKEND_Request* request, uint32_t* count)
+{
+  *count = 1;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_RequestOutputName(
+    TRITONBACKEND_Request* request, const uint32_t index,
+    const char** output_name)
+{
+  *output_name = "OUTPUT0";
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_RequestParameterCount(
+    TRITONBACKEND_Request* request, uint32_t* count)
+{
+  *count = 0;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_RequestRelease(
+    TRITONBACKEND_Request* request, uint32_t release_flags)
+{
+  request->released = true;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_InputProperties(
+    TRITONBACKEND_Input* input, const char** name,
+    TRITONSERVER_DataType* datatype, const int64_t** shape,
+    uint32_t* dims_count, uint64_t* byte_size, uint32_t* buffer_count)
+{
+  if (name != nullptr) {
+    *name = input->name;
+  }
+  if (datatype != nullptr) {
+    *datatype = input->datatype;
+  }
+  if (shape != nullptr) {
+    *shape = &input->shape;
+  }
+  if (dims_count != nullptr) {
+    *dims_count = 1;
+  }
+  if (byte_size != nullptr) {
+    *byte_size = input->byte_size;
+  }
+  if (buffer_count != nullptr) {
+    *buffer_count = 1;
+  }
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_InputBuffer(
+    TRITONBACKEND_Input* input, const uint32_t index, const void** buffer,
+    uint64_t* buffer_byte_size, TRITONSERVER_MemoryType* memory_type,
+    int64_t* memory_type_id)
+{
+  if (index != 0) {
+    return StubError(TRITONSERVER_ERROR_INVALID_ARG, "no such buffer");
+  }
+  *buffer = input->buffer;
+  *buffer_byte_size = input->byte_size;
+  *memory_type = TRITONSERVER_MEMORY_CPU;
+  *memory_type_id = 0;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ResponseNew(
+    TRITONBACKEND_Response** response, TRITONBACKEND_Request* request)
+{
+  request->response.sent = false;
+  request->response.error.clear();
+  *response = &request->response;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ResponseOutput(
+    TRITONBACKEND_Response* response, TRITONBACKEND_Output** output,
+    const char* name, const TRITONSERVER_DataType datatype,
+    const int64_t* shape, const uint32_t dims_count)
+{
+  if (std::strcmp(name, "OUTPUT0") != 0 ||
+      datatype != TRITONSERVER_TYPE_FP32 || dims_count != 1) {
+    return StubError(TRITONSERVER_ERROR_INVALID_ARG, "unexpected output");
+  }
+  response->output.shape = shape[0];
+  *output = &response->output;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_OutputBuffer(
+    TRITONBACKEND_Output* output, void** buffer,
+    const uint64_t buffer_byte_size, TRITONSERVER_MemoryType* memory_type,
+    int64_t* memory_type_id)
+{
+  if (buffer_byte_size > output->buffer.size() * sizeof(float)) {
+    return StubError(TRITONSERVER_ERROR_INVALID_ARG, "output too large");
+  }
+  *buffer = output->buffer.data();
+  *memory_type = TRITONSERVER_MEMORY_CPU;
+  *memory_type_id = 0;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ResponseSetIntParameter(
+    TRITONBACKEND_Response* response, const char* name, const int64_t value)
+{
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+TRITONBACKEND_ResponseSend(
+    TRITONBACKEND_Response* response, const uint32_t send_flags,
+    TRITONSERVER_Error* error)
+{
+  response->sent = true;
+  if (error != nullptr) {
+    response->error = error->message;
+  }
+  return nullptr;
+}
+
+}  // extern "C"
+
+namespace {
+
+bool
+Check(const bool condition, const char* const what)
+{
+  if (!condition) {
+    std::fprintf(stderr, "FAILED: %s\n", what);
+  }
+  return condition;
+}
+
+bool
+Succeeded(TRITONSERVER_Error* const error, const char* const what)
+{
+  if (error != nullptr) {
+    std::fprintf(stderr, "FAILED: %s: %s\n", what, error->message.c_str());
+    delete error;
+    return false;
+  }
+  return true;
+}
+
+// Write a sparse model with one embedding table, in which the vector of key k
+// holds k, k + 0.25, k + 0.5 and k + 0.75.
+void
+WriteSparseModel(const std::filesystem::path& path)
+{
+  std::filesystem::create_directories(path);
+  std::vector<long long> keys(kNumTableKeys);
+  std::vector<float> vectors(kNumTableKeys * kVectorSize);
+  for (size_t k = 0; k < kNumTableKeys; ++k) {
+    keys[k] = k;
+    for (size_t i = 0; i < kVectorSize; ++i) {
+      vectors[k * kVectorSize + i] = k + 0.25f * i;
+    }
+  }
+  std::ofstream(path / "key", std::ios::binary)
+      .write(
+          reinterpret_cast<const char*>(keys.data()),
+          keys.size() * sizeof(long long));
+  std::ofstream(path / "emb_vector", std::ios::binary)
+      .write(
+          reinterpret_cast<const char*>(vectors.data()),
+          vectors.size() * sizeof(float));
+}
+
+// The GPU embedding cache of KIND_GPU instances holds the whole table.
+std::string
+ParameterServerConfig(const std::filesystem::path& sparse_model, const bool gpu)
+{
+  return std::string(R"({
+  "supportlonglong": true,
+  "volatile_db": {"type": "hash_map", "num_partitions": 1},
+  "persistent_db": {"type": "disabled"},
+  "models": [{
+    "model": ")") +
+         kModelName + R"(",
+    "network_file": "",
+    "dense_file": "",
+    "sparse_files": [")" +
+         sparse_model.string() + R"("],
+    "num_of_worker_buffer_in_pool": 1,
+    "num_of_refresher_buffer_in_pool": 1,
+    "cache_refresh_percentage_per_iteration": 0.0,
+    "deployed_device_list": [0],
+    "default_value_for_each_table": [0.0],
+    "maxnum_catfeature_query_per_table_per_sample": [2],
+    "embedding_vecsize_per_table": [4],
+    "embedding_table_names": ["table0"],
+    "max_batch_size": 16,
+    "hit_rate_threshold": 1.0,
+    "gpucacheper": )" +
+         (gpu ? "1.0" : "0.5") + R"(,
+    "gpucache": )" +
+         (gpu ? "true" : "false") + R"(
+  }]
+})";
+}
+
+// KIND_CPU instances use a host embedding cache, which does not serve
+// KIND_GPU instances.
+std::string
+ModelConfig(const bool gpu)
+{
+  return std::string(R"({
+  "name": ")") +
+         kModelName + R"(",
+  "backend": "hps",
+  "max_batch_size": 16,
+  "input": [
+    {"name": "KEYS", "data_type": "TYPE_INT64", "dims": [-1]},
+    {"name": "NUMKEYS", "data_type": "TYPE_INT32", "dims": [-1]}
+  ],
+  "output": [{"name": "OUTPUT0", "data_type": "TYPE_FP32", "dims": [-1]}],
+  "instance_group": [{"count": 1, "kind": ")" +
+         (gpu ? "KIND_GPU" : "KIND_CPU") + R"("}],
+  "parameters": {)" +
+         (gpu ? "" : R"("host_cache_size": {"string_value": "1048576"})") +
+         R"(}
+})";
+}
+
+// Execute the request and check that it was answered with the embedding
+// vectors of its keys.
+bool
+Execute(
+    TRITONBACKEND_ModelInstance* const instance,
+    TRITONBACKEND_Request* const request, const std::vector<long long>& keys)
+{
+  TRITONBACKEND_Request* requests[] = {request};
+  request->released = false;
+  if (!Succeeded(
+          TRITONBACKEND_ModelInstanceExecute(instance, requests, 1),
+          "execute")) {
+    return false;
+  }
+  const TRITONBACKEND_Response& response = request->response;
+  if (!response.error.empty()) {
+    std::fprintf(stderr, "FAILED: response: %s\n", response.error.c_str());
+    return false;
+  }
+  if (!Check(response.sent, "response sent") ||
+      !Check(request->released, "request released") ||
+      !Check(
+          response.output.shape ==
+              static_cast<int64_t>(keys.size() * kVectorSize),
+          "output shape")) {
+    return false;
+  }
+  for (size_t k = 0; k < keys.size(); ++k) {
+    for (size_t i = 0; i < kVectorSize; ++i) {
+      if (response.output.buffer[k * kVectorSize + i] != keys[k] + 0.25f * i) {
+        return Check(false, "embedding vectors");
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int
+main(int argc, char** argv)
+{
+  const bool gpu = argc > 1 && std::strcmp(argv[1], "--gpu") == 0;
+  if (gpu) {
+    int num_devices = 0;
+    if (cudaGetDeviceCount(&num_devices) != cudaSuccess || num_devices == 0) {
+      std::printf("SKIPPED: no CUDA device\n");
+      return kSkipReturnCode;
+    }
+  }
+
+  const std::filesystem::path directory =
+      std::filesystem::temp_directory_path() /
+      (gpu ? "hps_execute_allocation_test_gpu" : "hps_execute_allocation_test");
+  std::filesystem::remove_all(directory);
+  WriteSparseModel(directory / "table0.model");
+  const std::filesystem::path ps_config = directory / "ps.json";
+  std::ofstream(ps_config) << ParameterServerConfig(
+      directory / "table0.model", gpu);
+
+  TRITONBACKEND_Backend backend;
+  backend.config.json =
+      R"({"cmdline": {"ps": ")" + ps_config.string() + R"("}})";
+  TRITONBACKEND_Model model;
+  model.backend = &backend;
+  model.config.json = ModelConfig(gpu);
+  TRITONBACKEND_ModelInstance instance;
+  instance.model = &model;
+  if (gpu) {
+    instance.kind = TRITONSERVER_INSTANCEGROUPKIND_GPU;
+  }
+
+  // Two samples with two keys each.
+  const std::vector<long long> keys = {3, 17, 42, 5};
+  const std::vector<int32_t> num_keys = {2, 2};
+  TRITONBACKEND_Request request;
+  request.inputs[0] = {
+      "KEYS", TRITONSERVER_TYPE_INT64, static_cast<int64_t>(keys.size()),
+      keys.data(), keys.size() * sizeof(long long)};
+  request.inputs[1] = {
+      "NUMKEYS", TRITONSERVER_TYPE_INT32,
+      static_cast<int64_t>(num_keys.size()), num_keys.data(),
+      num_keys.size() * sizeof(int32_t)};
+  request.response.output.buffer.resize(keys.size() * kVectorSize);
+
+  bool passed =
+      Succeeded(TRITONBACKEND_Initialize(&backend), "backend initialize") &&
+      Succeeded(TRITONBACKEND_ModelInitialize(&model), "model initialize") &&
+      Succeeded(
+          TRITONBACKEND_ModelInstanceInitialize(&instance),
+          "instance initialize") &&
+      Check(instance.state != nullptr, "instance state");
+
+  // The first execution sizes the scratch space of the instance and fills
+  // the host embedding cache of a KIND_CPU instance. The output buffers of
+  // the stand-ins are host memory, so a KIND_GPU instance also copies the
+  // embedding vectors back from its device.
+  passed = passed && Execute(&instance, &request, keys);
+  if (passed) {
+    const size_t allocations_before = num_allocations.load();
+    passed = Execute(&instance, &request, keys);
+    const size_t allocations = num_allocations.load() - allocations_before;
+    std::printf("allocations in the second execution: %zu\n", allocations);
+    passed = passed && Check(allocations == 0, "no allocations");
+  }
+
+  if (instance.state != nullptr) {
+    Succeeded(
+        TRITONBACKEND_ModelInstanceFinalize(&instance), "instance finalize");
+  }
+  if (model.state != nullptr) {
+    Succeeded(TRITONBACKEND_ModelFinalize(&model), "model finalize");
+  }
+  if (backend.state != nullptr) {
+    Succeeded(TRITONBACKEND_Finalize(&backend), "backend finalize");
+  }
+  std::filesystem::remove_all(directory);
+
+  std::printf("%s\n", passed ? "PASSED" : "FAILED");
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,228 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//
+// Checks of the host embedding cache: hits, expiry and updates, CLOCK
+// eviction within a shard, consistency of the shard index under heavy
+// eviction, concurrent use, and that neither lookups nor inserts allocate.
+//
+
+#include <atomic>
+#include <cstdlib>
+#include <host_embedding_cache.hpp>
+#include <new>
+#include <thread>
+#include <unit_test.hpp>
+#include <vector>
+
+// Every allocation through operator new is counted.
+static std::atomic<size_t> num_allocations{0};
+
+void*
+operator new(const std::size_t size)
+{
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* const ptr = std::malloc(size != 0 ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void
+operator delete(void* const ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void
+operator delete(void* const ptr, const std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+using triton::backend::hps::HostEmbeddingCache;
+
+namespace {
+
+constexpr size_t kVectorSize = 4;
+constexpr uint64_t kTtlNs = 1000;
+constexpr size_t kNumShards = 64;
+
+// The byte size of a cache that holds 'entries_per_shard' entries in each
+// shard. Entries take up their vector and 24 bytes of bookkeeping.
+size_t
+CacheByteSize(const size_t entries_per_shard)
+{
+  return kNumShards * entries_per_shard * (kVectorSize * sizeof(float) + 24);
+}
+
+// The shard of a key, as the cache picks it.
+size_t
+ShardOf(const long long key)
+{
+  return (static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL) >> 58;
+}
+
+// The vector cached for 'key' in 'version'.
+std::vector<float>
+VectorOf(const long long key, const int version = 0)
+{
+  std::vector<float> vector(kVectorSize);
+  for (size_t i = 0; i < kVectorSize; ++i) {
+    vector[i] = static_cast<float>(key * 10 + i + version * 1000);
+  }
+  return vector;
+}
+
+void
+TestHitExpiryAndUpdate()
+{
+  HostEmbeddingCache cache(CacheByteSize(4), kVectorSize, kTtlNs);
+  EXPECT_EQ(cache.vector_size(), kVectorSize);
+
+  std::vector<float> vector(kVectorSize);
+  EXPECT_TRUE(!cache.find(7, 0, vector.data()));
+  cache.insert(7, 100, VectorOf(7).data());
+  EXPECT_TRUE(cache.find(7, 100 + kTtlNs - 1, vector.data()));
+  EXPECT_TRUE(vector == VectorOf(7));
+  EXPECT_TRUE(!cache.find(7, 100 + kTtlNs, vector.data()));
+
+  // Inserting a cached key again replaces its vector and expiry.
+  cache.insert(7, 5000, VectorOf(7, 1).data());
+  EXPECT_TRUE(cache.find(7, 5000, vector.data()));
+  EXPECT_TRUE(vector == VectorOf(7, 1));
+  EXPECT_EQ(cache.hits(), uint64_t{2});
+  EXPECT_EQ(cache.misses(), uint64_t{2});
+}
+
+void
+TestClockEviction()
+{
+  // Three keys of the same shard, which holds two entries.
+  std::vector<long long> keys;
+  for (long long key = 0; keys.size() < 3; ++key) {
+    if (ShardOf(key) == 0) {
+      keys.push_back(key);
+    }
+  }
+  HostEmbeddingCache cache(CacheByteSize(2), kVectorSize, kTtlNs);
+  std::vector<float> vector(kVectorSize);
+  cache.insert(keys[0], 0, VectorOf(keys[0]).data());
+  cache.insert(keys[1], 0, VectorOf(keys[1]).data());
+  EXPECT_TRUE(cache.find(keys[0], 0, vector.data()));
+
+  // The hand passes the referenced entry, and evicts the other one.
+  cache.insert(keys[2], 0, VectorOf(keys[2]).data());
+  EXPECT_TRUE(cache.find(keys[0], 0, vector.data()));
+  EXPECT_TRUE(vector == VectorOf(keys[0]));
+  EXPECT_TRUE(!cache.find(keys[1], 0, vector.data()));
+  EXPECT_TRUE(cache.find(keys[2], 0, vector.data()));
+  EXPECT_TRUE(vector == VectorOf(keys[2]));
+}
+
+void
+TestIndexUnderEviction()
+{
+  // Many more keys than the cache holds, in a pattern that makes the keys
+  // of a shard collide in its index. Every key is found right after its
+  // insert, and every hit returns the vector of its own key.
+  HostEmbeddingCache cache(CacheByteSize(16), kVectorSize, kTtlNs);
+  std::vector<float> vector(kVectorSize);
+  size_t num_cached = 0;
+  for (long long round = 0; round < 20; ++round) {
+    for (long long k = 0; k < 4000; ++k) {
+      const long long key = (k * 4099 + round * 7) % 8192 - 4096;
+      if (!cache.find(key, 0, vector.data())) {
+        cache.insert(key, 0, VectorOf(key).data());
+        EXPECT_TRUE(cache.find(key, 0, vector.data()));
+      }
+      EXPECT_TRUE(vector == VectorOf(key));
+    }
+  }
+  for (long long key = -4096; key < 4096; ++key) {
+    if (cache.find(key, 0, vector.data())) {
+      EXPECT_TRUE(vector == VectorOf(key));
+      ++num_cached;
+    }
+  }
+  EXPECT_TRUE(num_cached <= kNumShards * 16);
+  EXPECT_TRUE(num_cached >= kNumShards * 8);
+}
+
+void
+TestNoAllocations()
+{
+  HostEmbeddingCache cache(CacheByteSize(8), kVectorSize, kTtlNs);
+  std::vector<float> vector(kVectorSize);
+  const size_t num_allocations_before = num_allocations.load();
+  for (long long key = 0; key < 10000; ++key) {
+    vector[0] = static_cast<float>(key);
+    if (!cache.find(key % 3000, 0, vector.data())) {
+      cache.insert(key % 3000, 0, vector.data());
+    }
+  }
+  EXPECT_EQ(num_allocations.load(), num_allocations_before);
+}
+
+void
+TestConcurrentUse()
+{
+  HostEmbeddingCache cache(CacheByteSize(8), kVectorSize, kTtlNs);
+  std::vector<int> wrong(4, 0);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < wrong.size(); ++t) {
+    threads.emplace_back([&cache, &wrong, t]() {
+      std::vector<float> vector(kVectorSize);
+      for (long long i = 0; i < 20000; ++i) {
+        const long long key = (i * 13 + static_cast<long long>(t)) % 2000;
+        if (cache.find(key, 0, vector.data())) {
+          wrong[t] += vector != VectorOf(key);
+        } else {
+          cache.insert(key, 0, VectorOf(key).data());
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (const int w : wrong) {
+    EXPECT_EQ(w, 0);
+  }
+}
+
+}  // namespace
+
+int
+main()
+{
+  TestHitExpiryAndUpdate();
+  TestClockEviction();
+  TestIndexUnderEviction();
+  TestNoAllocations();
+  TestConcurrentUse();
+  return UNIT_TEST_RESULT();
+}
@@ -0,0 +1,54 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <cstdio>
+
+//
+// Minimal checks for the unit tests. A failed check reports itself and marks
+// the test as failed, but lets it carry on with the remaining checks. Each
+// test returns UNIT_TEST_RESULT() from main.
+//
+
+inline int&
+UnitTestFailures()
+{
+  static int num_failures = 0;
+  return num_failures;
+}
+
+#define EXPECT_TRUE(PRED)                                                 \
+  do {                                                                    \
+    if (!(PRED)) {                                                        \
+      std::fprintf(                                                       \
+          stderr, "%s:%d: expected %s\n", __FILE__, __LINE__, #PRED);     \
+      ++UnitTestFailures();                                               \
+    }                                                                     \
+  } while (0)
+
+#define EXPECT_EQ(A, B) EXPECT_TRUE((A) == (B))
+
+#define UNIT_TEST_RESULT() (UnitTestFailures() == 0 ? 0 : 1)
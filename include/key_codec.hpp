@@ -0,0 +1,338 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace triton { namespace backend { namespace hugectr {
+
+//
+// Bit-packed categorical keys
+//
+// Compressed CATCOLUMN encoding ("catcolumn_encoding": "bitpacked"). The keys
+// are sent in CATCOLUMN order as a sequence of blocks, each of which is
+// encoded relative to a frame of reference:
+//
+//   uint8   count - 1   number of keys in the block (1 to 256)
+//   uint8   width       number of bits per packed key (0 to 64)
+//   uint64  base        frame of reference, little endian
+//   uint8[]             ceil(count * width / 8) bytes of packed keys, key i
+//                       is base plus bits [i * width, (i + 1) * width),
+//                       least significant bit first
+//
+// Encoders pick the minimum key of a block as base and the bit length of the
+// largest difference as width, so that keys of a table or slot that lie
+// close together take only a few bits each.
+//
+constexpr size_t kBitpackedBlockHeaderSize = 10;
+constexpr size_t kBitpackedMaxBlockKeys = 256;
+
+// Count the keys of a bit-packed stream, and check that it is well formed.
+inline bool
+CountBitpackedKeys(const uint8_t* src, const size_t size, size_t* num_keys)
+{
+  size_t offset = 0;
+  size_t count = 0;
+  while (offset < size) {
+    if (size - offset < kBitpackedBlockHeaderSize) {
+      return false;
+    }
+    const size_t block_keys = static_cast<size_t>(src[offset]) + 1;
+    const size_t width = src[offset + 1];
+    if (width > 64) {
+      return false;
+    }
+    offset += kBitpackedBlockHeaderSize;
+    const size_t packed_size = (block_keys * width + 7) / 8;
+    if (size - offset < packed_size) {
+      return false;
+    }
+    offset += packed_size;
+    count += block_keys;
+  }
+  *num_keys = count;
+  return true;
+}
+
+// Extract the bits [bit, bit + width) of 'packed', of which 'available' bytes
+// may be read. Assumes a little endian host.
+inline uint64_t
+LoadPackedBits(
+    const uint8_t* packed, const size_t available, const size_t bit,
+    const size_t width)
+{
+  if (width == 0) {
+    return 0;
+  }
+  const size_t byte = bit >> 3;
+  const size_t shift = bit & 7;
+  uint64_t word = 0;
+  std::memcpy(&word, packed + byte, std::min<size_t>(8, available - byte));
+  uint64_t bits = word >> shift;
+  if (shift + width > 64) {
+    bits |= static_cast<uint64_t>(packed[byte + 8]) << (64 - shift);
+  }
+  return width == 64 ? bits : bits & ((uint64_t{1} << width) - 1);
+}
+
+#if defined(__x86_64__)
+// Unpack as many keys of a block as possible with AVX2, four at a time. Each
+// lane gathers the 8 bytes starting at the first byte of its key. Keys of 58
+// to 63 bits can span a ninth byte, which a second gather shifted by one byte
+// provides, and keys of 64 bits are byte aligned and loaded directly. Stops
+// before reading past 'available' bytes. Returns the number of keys unpacked.
+__attribute__((target("avx2"))) inline size_t
+UnpackBitsAVX2(
+    const uint8_t* packed, const size_t available, const size_t width,
+    const uint64_t base, const size_t count, uint64_t* dst)
+{
+  if (width == 0) {
+    return 0;
+  }
+  const __m256i base_v = _mm256_set1_epi64x(static_cast<int64_t>(base));
+  size_t i = 0;
+  if (width == 64) {
+    for (; i + 4 <= count; i += 4) {
+      const __m256i words = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(packed + i * sizeof(uint64_t)));
+      _mm256_storeu_si256(
+          reinterpret_cast<__m256i*>(dst + i), _mm256_add_epi64(words, base_v));
+    }
+    return i;
+  }
+
+  const bool spans_nine_bytes = width > 57;
+  const size_t window = spans_nine_bytes ? 9 : 8;
+  const __m256i mask = _mm256_set1_epi64x((int64_t{1} << width) - 1);
+  const __m256i seven = _mm256_set1_epi64x(7);
+  const __m256i sixty_four = _mm256_set1_epi64x(64);
+  const __m256i step = _mm256_set1_epi64x(static_cast<int64_t>(4 * width));
+  __m256i bit = _mm256_setr_epi64x(
+      0, static_cast<int64_t>(width), static_cast<int64_t>(2 * width),
+      static_cast<int64_t>(3 * width));
+  for (; i + 4 <= count; i += 4) {
+    if (((i + 3) * width >> 3) + window > available) {
+      break;
+    }
+    const __m256i byte = _mm256_srli_epi64(bit, 3);
+    const __m256i shift = _mm256_and_si256(bit, seven);
+    __m256i keys = _mm256_srlv_epi64(
+        _mm256_i64gather_epi64(
+            reinterpret_cast<const long long*>(packed), byte, 1),
+        shift);
+    if (spans_nine_bytes) {
+      // The top byte of the word one byte further holds the ninth byte. A
+      // shift of 64 bits, for keys that start on a byte, clears it.
+      const __m256i next = _mm256_i64gather_epi64(
+          reinterpret_cast<const long long*>(packed + 1), byte, 1);
+      keys = _mm256_or_si256(
+          keys, _mm256_sllv_epi64(
+                    _mm256_srli_epi64(next, 56),
+                    _mm256_sub_epi64(sixty_four, shift)));
+    }
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(dst + i),
+        _mm256_add_epi64(_mm256_and_si256(keys, mask), base_v));
+    bit = _mm256_add_epi64(bit, step);
+  }
+  return i;
+}
+
+// Unpack as many keys of a block as possible into 32 bit keys with AVX2,
+// eight at a time. Keys of up to 25 bits are gathered as 4 byte words if
+// 'base' plus any such value fits into 32 bits. Wider keys are gathered as
+// 8 byte words and added to 'base' in 64 bits, and the unpacking stops before
+// the first eight keys of which one exceeds 32 bits, so that the caller can
+// report it. Returns the number of keys unpacked.
+__attribute__((target("avx2"))) inline size_t
+UnpackBits32AVX2(
+    const uint8_t* packed, const size_t available, const size_t width,
+    const uint64_t base, const size_t count, uint32_t* dst)
+{
+  constexpr uint64_t kMaxKey = std::numeric_limits<uint32_t>::max();
+  if (width == 0 || width > 32 || base > kMaxKey) {
+    return 0;
+  }
+  size_t i = 0;
+  if (width <= 25 && base <= kMaxKey - ((uint64_t{1} << width) - 1)) {
+    const __m256i base_v = _mm256_set1_epi32(static_cast<int32_t>(base));
+    const __m256i mask =
+        _mm256_set1_epi32(static_cast<int32_t>((uint32_t{1} << width) - 1));
+    const __m256i seven = _mm256_set1_epi32(7);
+    const __m256i step = _mm256_set1_epi32(static_cast<int32_t>(8 * width));
+    const int w = static_cast<int>(width);
+    __m256i bit =
+        _mm256_setr_epi32(0, w, 2 * w, 3 * w, 4 * w, 5 * w, 6 * w, 7 * w);
+    for (; i + 8 <= count; i += 8) {
+      if (((i + 7) * width >> 3) + 4 > available) {
+        break;
+      }
+      const __m256i words = _mm256_i32gather_epi32(
+          reinterpret_cast<const int*>(packed), _mm256_srli_epi32(bit, 3), 1);
+      const __m256i keys = _mm256_and_si256(
+          _mm256_srlv_epi32(words, _mm256_and_si256(bit, seven)), mask);
+      _mm256_storeu_si256(
+          reinterpret_cast<__m256i*>(dst + i), _mm256_add_epi32(keys, base_v));
+      bit = _mm256_add_epi32(bit, step);
+    }
+    return i;
+  }
+
+  const __m256i mask = _mm256_set1_epi64x((int64_t{1} << width) - 1);
+  const __m256i seven = _mm256_set1_epi64x(7);
+  const __m256i step = _mm256_set1_epi64x(static_cast<int64_t>(8 * width));
+  const __m256i base_v = _mm256_set1_epi64x(static_cast<int64_t>(base));
+  const __m256i high_halves =
+      _mm256_set1_epi64x(static_cast<int64_t>(~kMaxKey));
+  const __m256i low_halves = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+  const int64_t w = static_cast<int64_t>(width);
+  __m256i bit_lo = _mm256_setr_epi64x(0, w, 2 * w, 3 * w);
+  __m256i bit_hi = _mm256_setr_epi64x(4 * w, 5 * w, 6 * w, 7 * w);
+  for (; i + 8 <= count; i += 8) {
+    if (((i + 7) * width >> 3) + 8 > available) {
+      break;
+    }
+    const __m256i keys_lo = _mm256_add_epi64(
+        _mm256_and_si256(
+            _mm256_srlv_epi64(
+                _mm256_i64gather_epi64(
+                    reinterpret_cast<const long long*>(packed),
+                    _mm256_srli_epi64(bit_lo, 3), 1),
+                _mm256_and_si256(bit_lo, seven)),
+            mask),
+        base_v);
+    const __m256i keys_hi = _mm256_add_epi64(
+        _mm256_and_si256(
+            _mm256_srlv_epi64(
+                _mm256_i64gather_epi64(
+                    reinterpret_cast<const long long*>(packed),
+                    _mm256_srli_epi64(bit_hi, 3), 1),
+                _mm256_and_si256(bit_hi, seven)),
+            mask),
+        base_v);
+    if (!_mm256_testz_si256(_mm256_or_si256(keys_lo, keys_hi), high_halves)) {
+      break;
+    }
+    const __m256i keys = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm256_castsi256_si128(
+            _mm256_permutevar8x32_epi32(keys_lo, low_halves))),
+        _mm256_castsi256_si128(
+            _mm256_permutevar8x32_epi32(keys_hi, low_halves)),
+        1);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), keys);
+    bit_lo = _mm256_add_epi64(bit_lo, step);
+    bit_hi = _mm256_add_epi64(bit_hi, step);
+  }
+  return i;
+}
+
+inline bool
+HasAVX2()
+{
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2;
+}
+#endif
+
+// Decode a bit-packed stream into at most 'capacity' keys of type TKey.
+// Returns false if the stream is malformed, does not fit or holds keys that
+// exceed the range of TKey.
+template <typename TKey>
+inline bool
+DecodeBitpackedKeys(
+    const uint8_t* src, const size_t size, TKey* dst, const size_t capacity,
+    size_t* num_keys)
+{
+  static_assert(
+      sizeof(TKey) == sizeof(uint32_t) || sizeof(TKey) == sizeof(uint64_t),
+      "Keys must be 32 or 64 bit integers.");
+
+  size_t offset = 0;
+  size_t count = 0;
+  while (offset < size) {
+    if (size - offset < kBitpackedBlockHeaderSize) {
+      return false;
+    }
+    const size_t block_keys = static_cast<size_t>(src[offset]) + 1;
+    const size_t width = src[offset + 1];
+    uint64_t base;
+    std::memcpy(&base, src + offset + 2, sizeof(base));
+    offset += kBitpackedBlockHeaderSize;
+    const size_t packed_size = (block_keys * width + 7) / 8;
+    if (width > 64 || size - offset < packed_size ||
+        capacity - count < block_keys) {
+      return false;
+    }
+
+    const uint8_t* const packed = src + offset;
+    const size_t available = size - offset;
+    TKey* const block_dst = dst + count;
+    size_t i = 0;
+    if (sizeof(TKey) == sizeof(uint64_t)) {
+#if defined(__x86_64__)
+      if (HasAVX2()) {
+        i = UnpackBitsAVX2(
+            packed, available, width, base, block_keys,
+            reinterpret_cast<uint64_t*>(block_dst));
+      }
+#endif
+      for (; i < block_keys; ++i) {
+        block_dst[i] = static_cast<TKey>(
+            base + LoadPackedBits(packed, available, i * width, width));
+      }
+    } else {
+#if defined(__x86_64__)
+      if (HasAVX2()) {
+        i = UnpackBits32AVX2(
+            packed, available, width, base, block_keys,
+            reinterpret_cast<uint32_t*>(block_dst));
+      }
+#endif
+      for (; i < block_keys; ++i) {
+        const uint64_t key =
+            base + LoadPackedBits(packed, available, i * width, width);
+        if (key > std::numeric_limits<uint32_t>::max()) {
+          return false;
+        }
+        block_dst[i] = static_cast<TKey>(key);
+      }
+    }
+    offset += packed_size;
+    count += block_keys;
+  }
+  *num_keys = count;
+  return true;
+}
+
+}}}  // namespace triton::backend::hugectr
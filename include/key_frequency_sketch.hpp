@@ -0,0 +1,237 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <hot_keys.hpp>
+#include <memory>
+#include <vector>
+
+namespace triton { namespace backend { namespace hugectr {
+
+//
+// Key frequency sketch
+//
+// A count-min sketch of the keys looked up in one embedding table, in the
+// style of TinyLFU. A key maps to a block of 32 counters of 16 bit, which
+// fills one cache line, and increments one of the eight counters in each of
+// its four rows. The estimate of a key is the least of its counters, which
+// saturate instead of wrapping around. Whenever as many keys were added as
+// ten times the number of counters, all counters are halved, so that the
+// sketch follows shifts in popularity.
+//
+// Besides the counters, the sketch keeps the candidates for the hottest keys
+// in a table of four slots per tracked key. A key may live in either of two
+// slots, and takes over the colder of them once its estimate exceeds the one
+// last seen for the resident key.
+//
+// Keys are added lock-free from any number of threads. Counters are relaxed
+// atomics that are incremented by a load and a store instead of a locked
+// read-modify-write, so concurrent increments of a counter, as well as those
+// racing with halving, may be lost. This only makes the estimates a bit less
+// accurate, but keeps an update as cheap as a plain increment.
+//
+class KeyFrequencySketch {
+ public:
+  // A sketch of at least 'num_counters' counters, which tracks the
+  // 'num_hot_keys' hottest keys.
+  KeyFrequencySketch(const size_t num_counters, const size_t num_hot_keys)
+      : num_hot_keys_{num_hot_keys}
+  {
+    size_t num_blocks = 1;
+    while (num_blocks * kCountersPerBlock < num_counters) {
+      num_blocks *= 2;
+    }
+    size_t num_slots = 1;
+    while (num_slots < 4 * num_hot_keys) {
+      num_slots *= 2;
+    }
+    block_mask_ = num_blocks - 1;
+    slot_mask_ = num_slots - 1;
+    sample_size_ = kSampleFactor * num_blocks * kCountersPerBlock;
+    blocks_.reset(new Block[num_blocks]);
+    slots_.reset(new Slot[num_slots]);
+  }
+
+  // Count the lookup of 'num_keys' keys.
+  void Add(const long long* const keys, const size_t num_keys)
+  {
+    for (size_t i = 0; i < num_keys; ++i) {
+      const uint64_t h = Mix(keys[i]);
+      Block& block = blocks_[h & block_mask_];
+      uint32_t estimate = UINT16_MAX;
+      for (size_t row = 0; row < kRows; ++row) {
+        std::atomic<uint16_t>& counter = block.counters[CounterIndex(h, row)];
+        const uint16_t count = counter.load(std::memory_order_relaxed);
+        if (count != UINT16_MAX) {
+          counter.store(count + 1, std::memory_order_relaxed);
+          estimate = std::min<uint32_t>(estimate, count + 1);
+        }
+      }
+      Offer(keys[i], h, estimate);
+    }
+
+    const uint64_t added =
+        num_added_.fetch_add(num_keys, std::memory_order_relaxed);
+    if (added / sample_size_ != (added + num_keys) / sample_size_) {
+      Age();
+    }
+  }
+
+  // Estimate how often 'key' was looked up lately.
+  uint32_t Estimate(const long long key) const
+  {
+    const uint64_t h = Mix(key);
+    const Block& block = blocks_[h & block_mask_];
+    uint32_t estimate = UINT16_MAX;
+    for (size_t row = 0; row < kRows; ++row) {
+      estimate = std::min<uint32_t>(
+          estimate,
+          block.counters[CounterIndex(h, row)].load(std::memory_order_relaxed));
+    }
+    return estimate;
+  }
+
+  // The hottest keys in order of decreasing estimate.
+  std::vector<HotKey> HotKeys() const
+  {
+    std::vector<HotKey> hot_keys;
+    for (size_t s = 0; s <= slot_mask_; ++s) {
+      const long long key = slots_[s].key.load(std::memory_order_relaxed);
+      if (key != kEmptySlot) {
+        hot_keys.push_back({key, Estimate(key)});
+      }
+    }
+    // Racing offers may have put a key into both of its slots.
+    std::sort(
+        hot_keys.begin(), hot_keys.end(),
+        [](const HotKey& a, const HotKey& b) { return a.key < b.key; });
+    hot_keys.erase(
+        std::unique(
+            hot_keys.begin(), hot_keys.end(),
+            [](const HotKey& a, const HotKey& b) { return a.key == b.key; }),
+        hot_keys.end());
+    std::stable_sort(
+        hot_keys.begin(), hot_keys.end(),
+        [](const HotKey& a, const HotKey& b) { return a.count > b.count; });
+    if (hot_keys.size() > num_hot_keys_) {
+      hot_keys.resize(num_hot_keys_);
+    }
+    return hot_keys;
+  }
+
+ private:
+  static constexpr size_t kRows = 4;
+  static constexpr size_t kCountersPerRow = 8;
+  static constexpr size_t kCountersPerBlock = kRows * kCountersPerRow;
+  static constexpr uint64_t kSampleFactor = 10;
+  // Marks empty hot key slots, and is therefore never tracked as a hot key.
+  static constexpr long long kEmptySlot = LLONG_MIN;
+
+  struct alignas(64) Block {
+    std::atomic<uint16_t> counters[kCountersPerBlock] = {};
+  };
+
+  struct Slot {
+    std::atomic<long long> key{kEmptySlot};
+    std::atomic<uint32_t> estimate{0};
+  };
+
+  // The finalizer of SplitMix64, which spreads sequential keys over all bits.
+  static uint64_t Mix(const long long key)
+  {
+    uint64_t h = static_cast<uint64_t>(key);
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    return h ^ (h >> 31);
+  }
+
+  // The counter of row 'row' of a key within its block. The block is chosen
+  // by the low bits of the hash, the counters by the high ones.
+  static size_t CounterIndex(const uint64_t h, const size_t row)
+  {
+    return row * kCountersPerRow + ((h >> (32 + 3 * row)) & 7);
+  }
+
+  // Let 'key' take over the colder of its hot key slots if it is hotter than
+  // the resident key. Key and estimate of a slot are not updated together, so
+  // a slot may briefly pair a key with the estimate of another one.
+  void Offer(const long long key, const uint64_t h, const uint32_t estimate)
+  {
+    if (key == kEmptySlot) {
+      return;
+    }
+    Slot* const candidates[] = {
+        &slots_[(h >> 12) & slot_mask_], &slots_[(h >> 44) & slot_mask_]};
+    for (Slot* const slot : candidates) {
+      if (slot->key.load(std::memory_order_relaxed) == key) {
+        slot->estimate.store(estimate, std::memory_order_relaxed);
+        return;
+      }
+    }
+    Slot& slot = candidates[0]->estimate.load(std::memory_order_relaxed) <=
+                         candidates[1]->estimate.load(std::memory_order_relaxed)
+                     ? *candidates[0]
+                     : *candidates[1];
+    long long resident = slot.key.load(std::memory_order_relaxed);
+    if (estimate > slot.estimate.load(std::memory_order_relaxed) &&
+        slot.key.compare_exchange_strong(
+            resident, key, std::memory_order_relaxed)) {
+      slot.estimate.store(estimate, std::memory_order_relaxed);
+    }
+  }
+
+  void Age()
+  {
+    for (size_t b = 0; b <= block_mask_; ++b) {
+      for (std::atomic<uint16_t>& counter : blocks_[b].counters) {
+        counter.store(
+            counter.load(std::memory_order_relaxed) / 2,
+            std::memory_order_relaxed);
+      }
+    }
+    for (size_t s = 0; s <= slot_mask_; ++s) {
+      std::atomic<uint32_t>& estimate = slots_[s].estimate;
+      estimate.store(
+          estimate.load(std::memory_order_relaxed) / 2,
+          std::memory_order_relaxed);
+    }
+  }
+
+  const size_t num_hot_keys_;
+  size_t block_mask_;
+  size_t slot_mask_;
+  uint64_t sample_size_;
+  std::unique_ptr<Block[]> blocks_;
+  std::unique_ptr<Slot[]> slots_;
+  std::atomic<uint64_t> num_added_{0};
+};
+
+}}}  // namespace triton::backend::hugectr
@@ -0,0 +1,142 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace triton { namespace backend { namespace hugectr {
+
+//
+// Server-side key hashing
+//
+// Raw categorical values ("catcolumn_encoding": "hashed") are hashed with
+// XXH64 (seed 0). The key of a value in slot i is then
+//
+//   key_offset[i] + XXH64(value) % hash_buckets[i]
+//
+// where the key offsets are the prefix sums of the hash buckets of the
+// preceding slots of the same embedding table.
+//
+constexpr uint64_t kXXH64Prime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kXXH64Prime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kXXH64Prime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t kXXH64Prime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t kXXH64Prime5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t
+RotateLeft64(const uint64_t x, const int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t
+LoadLE64(const uint8_t* const p)
+{
+  uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint32_t
+LoadLE32(const uint8_t* const p)
+{
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t
+XXH64Round(uint64_t acc, const uint64_t input)
+{
+  acc += input * kXXH64Prime2;
+  acc = RotateLeft64(acc, 31);
+  return acc * kXXH64Prime1;
+}
+
+inline uint64_t
+XXH64MergeRound(uint64_t acc, const uint64_t val)
+{
+  acc ^= XXH64Round(0, val);
+  return acc * kXXH64Prime1 + kXXH64Prime4;
+}
+
+// XXH64 of 'len' bytes at 'data'. Long values are consumed in 32 byte
+// stripes by four independent accumulators, which keeps the multipliers of
+// the CPU busy.
+inline uint64_t
+XXHash64(const void* const data, const size_t len, const uint64_t seed = 0)
+{
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  const uint8_t* const end = p + len;
+  uint64_t h;
+
+  if (len >= 32) {
+    uint64_t v1 = seed + kXXH64Prime1 + kXXH64Prime2;
+    uint64_t v2 = seed + kXXH64Prime2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - kXXH64Prime1;
+    for (; end - p >= 32; p += 32) {
+      v1 = XXH64Round(v1, LoadLE64(p));
+      v2 = XXH64Round(v2, LoadLE64(p + 8));
+      v3 = XXH64Round(v3, LoadLE64(p + 16));
+      v4 = XXH64Round(v4, LoadLE64(p + 24));
+    }
+    h = RotateLeft64(v1, 1) + RotateLeft64(v2, 7) + RotateLeft64(v3, 12) +
+        RotateLeft64(v4, 18);
+    h = XXH64MergeRound(h, v1);
+    h = XXH64MergeRound(h, v2);
+    h = XXH64MergeRound(h, v3);
+    h = XXH64MergeRound(h, v4);
+  } else {
+    h = seed + kXXH64Prime5;
+  }
+  h += len;
+
+  for (; end - p >= 8; p += 8) {
+    h ^= XXH64Round(0, LoadLE64(p));
+    h = RotateLeft64(h, 27) * kXXH64Prime1 + kXXH64Prime4;
+  }
+  if (end - p >= 4) {
+    h ^= static_cast<uint64_t>(LoadLE32(p)) * kXXH64Prime1;
+    h = RotateLeft64(h, 23) * kXXH64Prime2 + kXXH64Prime3;
+    p += 4;
+  }
+  for (; p < end; ++p) {
+    h ^= *p * kXXH64Prime5;
+    h = RotateLeft64(h, 11) * kXXH64Prime1;
+  }
+
+  h ^= h >> 33;
+  h *= kXXH64Prime2;
+  h ^= h >> 29;
+  h *= kXXH64Prime3;
+  h ^= h >> 32;
+  return h;
+}
+
+}}}  // namespace triton::backend::hugectr
@@ -0,0 +1,138 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace triton { namespace backend { namespace hugectr {
+
+//
+// PredictionCache
+//
+// Bounded cache of per-sample predictions, keyed by a 64-bit hash of the
+// features of a sample. The cache is direct-mapped: each key has a single
+// slot, and a newer prediction replaces whatever occupied it. Entries expire
+// after a TTL, and invalidate() drops all entries at once by advancing the
+// generation.
+//
+class PredictionCache {
+ public:
+  PredictionCache(
+      const size_t capacity, const size_t value_byte_size,
+      const uint64_t ttl_ns)
+      : entries_(capacity), values_(capacity * value_byte_size),
+        value_byte_size_(value_byte_size), ttl_ns_(ttl_ns)
+  {
+  }
+
+  size_t value_byte_size() const { return value_byte_size_; }
+
+  uint64_t generation() const
+  {
+    return generation_.load(std::memory_order_acquire);
+  }
+
+  // Copy the prediction cached for 'key' into 'value', unless it is missing,
+  // expired or stale.
+  bool find(const uint64_t key, const uint64_t now_ns, void* const value)
+  {
+    const size_t slot = key % entries_.size();
+    {
+      std::lock_guard<std::mutex> lock(locks_[slot % num_locks]);
+      const Entry& entry = entries_[slot];
+      if (entry.key == key && entry.generation == generation() &&
+          now_ns < entry.expiry_ns) {
+        std::memcpy(
+            value, &values_[slot * value_byte_size_], value_byte_size_);
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  // Cache the prediction for 'key', which was computed with the embeddings
+  // of the given generation. Predictions of a past generation are dropped.
+  void insert(
+      const uint64_t key, const uint64_t now_ns, const uint64_t generation,
+      const void* const value)
+  {
+    if (generation != this->generation()) {
+      return;
+    }
+    const size_t slot = key % entries_.size();
+    std::lock_guard<std::mutex> lock(locks_[slot % num_locks]);
+    entries_[slot] = {key, generation, now_ns + ttl_ns_};
+    std::memcpy(&values_[slot * value_byte_size_], value, value_byte_size_);
+  }
+
+  void invalidate() { generation_.fetch_add(1, std::memory_order_acq_rel); }
+
+  uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+
+  uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+  std::string to_string() const
+  {
+    const uint64_t h = hits();
+    const uint64_t n = h + misses();
+    std::stringstream ss;
+    ss << "hits = " << h << ", misses = " << n - h;
+    if (n != 0) {
+      ss << ", hit rate = " << 100.0 * h / n << "%";
+    }
+    return ss.str();
+  }
+
+ private:
+  static constexpr size_t num_locks = 64;
+
+  struct Entry {
+    uint64_t key = 0;
+    uint64_t generation = 0;
+    uint64_t expiry_ns = 0;
+  };
+
+  std::vector<Entry> entries_;
+  std::vector<uint8_t> values_;
+  const size_t value_byte_size_;
+  const uint64_t ttl_ns_;
+  std::array<std::mutex, num_locks> locks_;
+  // Entries start out in generation 0, which is never current.
+  std::atomic<uint64_t> generation_{1};
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+};
+
+}}}  // namespace triton::backend::hugectr
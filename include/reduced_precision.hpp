@@ -0,0 +1,185 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace triton { namespace backend { namespace hugectr {
+
+//
+// Host conversions between FP32 and the 16 bit floating point formats that
+// requests may use for dense features and predictions. FP16 conversions use
+// the F16C instructions if the CPU supports them. BF16 is the upper half of
+// FP32, so widening it is a shift that the compiler vectorizes.
+//
+
+inline float
+HalfToFloat(const uint16_t h)
+{
+  const uint32_t sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+  const uint32_t exponent = (h >> 10) & 0x1fu;
+  uint32_t mantissa = h & 0x3ffu;
+  uint32_t bits;
+  if (exponent == 0x1fu) {
+    // Inf and NaN.
+    bits = sign | 0x7f800000u | (mantissa << 13);
+  } else if (exponent != 0) {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  } else if (mantissa == 0) {
+    bits = sign;
+  } else {
+    // Subnormal halfs are normal floats.
+    uint32_t float_exponent = 113;
+    while ((mantissa & 0x400u) == 0) {
+      mantissa <<= 1;
+      --float_exponent;
+    }
+    bits = sign | (float_exponent << 23) | ((mantissa & 0x3ffu) << 13);
+  }
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+inline uint16_t
+FloatToHalf(const float f)
+{
+  // Rounds to nearest even, see float_to_half_fast3_rtne by F. Giesen.
+  constexpr uint32_t f32_infinity = 255u << 23;
+  constexpr uint32_t f16_overflow = (127u + 16u) << 23;
+  constexpr uint32_t f16_min_normal = 113u << 23;
+  constexpr uint32_t denormal_magic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+  uint32_t bits;
+  std::memcpy(&bits, &f, sizeof(bits));
+  const uint32_t sign = bits & 0x80000000u;
+  bits ^= sign;
+
+  uint16_t h;
+  if (bits >= f16_overflow) {
+    h = bits > f32_infinity ? 0x7e00u : 0x7c00u;
+  } else if (bits < f16_min_normal) {
+    // Let the FPU round the subnormal mantissa.
+    float magic;
+    std::memcpy(&magic, &denormal_magic, sizeof(magic));
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    value += magic;
+    std::memcpy(&bits, &value, sizeof(bits));
+    h = static_cast<uint16_t>(bits - denormal_magic);
+  } else {
+    const uint32_t mantissa_odd = (bits >> 13) & 1u;
+    bits += ((15u - 127u) << 23) + 0xfffu + mantissa_odd;
+    h = static_cast<uint16_t>(bits >> 13);
+  }
+  return h | static_cast<uint16_t>(sign >> 16);
+}
+
+inline float
+BFloat16ToFloat(const uint16_t b)
+{
+  const uint32_t bits = static_cast<uint32_t>(b) << 16;
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx,f16c"))) inline size_t
+HalfToFloatF16C(const uint16_t* src, float* dst, const size_t n)
+{
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m128i h =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+  }
+  return i;
+}
+
+__attribute__((target("avx,f16c"))) inline size_t
+FloatToHalfF16C(const float* src, uint16_t* dst, const size_t n)
+{
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m128i h =
+        _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+  }
+  return i;
+}
+
+inline bool
+HasF16C()
+{
+  static const bool has_f16c =
+      __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+  return has_f16c;
+}
+#endif
+
+inline void
+ConvertHalfToFloat(const uint16_t* src, float* dst, const size_t n)
+{
+  size_t i = 0;
+#if defined(__x86_64__)
+  if (HasF16C()) {
+    i = HalfToFloatF16C(src, dst, n);
+  }
+#endif
+  for (; i < n; ++i) {
+    dst[i] = HalfToFloat(src[i]);
+  }
+}
+
+inline void
+ConvertFloatToHalf(const float* src, uint16_t* dst, const size_t n)
+{
+  size_t i = 0;
+#if defined(__x86_64__)
+  if (HasF16C()) {
+    i = FloatToHalfF16C(src, dst, n);
+  }
+#endif
+  for (; i < n; ++i) {
+    dst[i] = FloatToHalf(src[i]);
+  }
+}
+
+inline void
+ConvertBFloat16ToFloat(const uint16_t* src, float* dst, const size_t n)
+{
+  for (size_t i = 0; i < n; ++i) {
+    dst[i] = BFloat16ToFloat(src[i]);
+  }
+}
+
+}}}  // namespace triton::backend::hugectr
@@ -0,0 +1,70 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+namespace triton { namespace backend { namespace hugectr {
+
+//
+// Top-K selection
+//
+// Samples are ranked by their first prediction, which is every 'stride'-th
+// score. Ties go to the lower index, and NaN scores rank last. The top-K are
+// selected in linear time, and only those are sorted.
+//
+
+// Put the indices of the 'k' highest ranked of 'num_samples' samples into
+// the first 'k' elements of 'order', best first. 'order' is resized to
+// 'num_samples', so that it can be reused without allocating.
+inline void
+SelectTopK(
+    const float* const scores, const int64_t num_samples, const int64_t stride,
+    const int64_t k, std::vector<int64_t>* const order)
+{
+  const auto score = [scores, stride](const int64_t i) {
+    const float s = scores[i * stride];
+    return std::isnan(s) ? -std::numeric_limits<float>::infinity() : s;
+  };
+  const auto higher = [&score](const int64_t a, const int64_t b) {
+    const float score_a = score(a);
+    const float score_b = score(b);
+    return score_a > score_b || (score_a == score_b && a < b);
+  };
+  order->resize(num_samples);
+  std::iota(order->begin(), order->end(), int64_t{0});
+  if (k < num_samples) {
+    std::nth_element(order->begin(), order->begin() + k, order->end(), higher);
+  }
+  std::sort(order->begin(), order->begin() + k, higher);
+}
+
+}}}  // namespace triton::backend::hugectr
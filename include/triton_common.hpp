@@ -32,15 +32,18 @@
 namespace triton { namespace backend { namespace hugectr {
 
 /**
- * CPP style concats arguments to Triton log entry.
+ * CPP style concats arguments to Triton log entry. The message is only built
+ * if the log level is enabled.
  */
-#define HCTR_TRITON_LOG(LEVEL, ...)                                     \
-  do {                                                                  \
-    const std::string& msg = hctr_str_concat(__VA_ARGS__);              \
-    LOG_IF_ERROR(                                                       \
-        TRITONSERVER_LogMessage(                                        \
-            TRITONSERVER_LOG_##LEVEL, __FILE__, __LINE__, msg.c_str()), \
-        ("failed to log message: "));                                   \
+#define HCTR_TRITON_LOG(LEVEL, ...)                                       \
+  do {                                                                    \
+    if (TRITONSERVER_LogIsEnabled(TRITONSERVER_LOG_##LEVEL)) {            \
+      const std::string& msg = hctr_str_concat(__VA_ARGS__);              \
+      LOG_IF_ERROR(                                                       \
+          TRITONSERVER_LogMessage(                                        \
+              TRITONSERVER_LOG_##LEVEL, __FILE__, __LINE__, msg.c_str()), \
+          ("failed to log message: "));                                   \
+    }                                                                     \
   } while (0)
 
 /**
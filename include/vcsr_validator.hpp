@@ -0,0 +1,118 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace triton { namespace backend { namespace hugectr {
+
+//
+// Checks of VCSR row offsets. The offsets of a table are valid if every
+// slot holds between 0 and 'max_nnz' keys, i.e. they do not decrease and
+// grow by at most 'max_nnz' from row to row. The differences are compared as
+// unsigned integers, so that a single comparison catches both.
+//
+
+// Number of keys in slot 'i'. The offsets are subtracted as unsigned
+// integers, so that the difference wraps around instead of overflowing.
+inline uint32_t
+RowNnz(const int* rows, const size_t i)
+{
+  return static_cast<uint32_t>(rows[i + 1]) - static_cast<uint32_t>(rows[i]);
+}
+
+#if defined(__x86_64__)
+// Check the rows [0, returned) with AVX2, eight at a time. 'valid' is
+// cleared if any of them is invalid.
+__attribute__((target("avx2"))) inline size_t
+CheckRowOffsetsAVX2(
+    const int* rows, const size_t num_rows, const uint32_t max_nnz,
+    bool* valid)
+{
+  const __m256i max_v = _mm256_set1_epi32(static_cast<int>(max_nnz));
+  __m256i ok = _mm256_set1_epi32(-1);
+  size_t i = 0;
+  for (; i + 9 <= num_rows; i += 8) {
+    const __m256i lo =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows + i));
+    const __m256i hi =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows + i + 1));
+    const __m256i nnz = _mm256_sub_epi32(hi, lo);
+    ok = _mm256_and_si256(
+        ok, _mm256_cmpeq_epi32(_mm256_min_epu32(nnz, max_v), nnz));
+  }
+  *valid = _mm256_movemask_epi8(ok) == -1;
+  return i;
+}
+
+inline bool
+HasAVX2ForRows()
+{
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2;
+}
+#endif
+
+// Whether all 'num_rows' row offsets are valid.
+inline bool
+RowOffsetsValid(const int* rows, const size_t num_rows, const uint32_t max_nnz)
+{
+  bool valid = true;
+  size_t i = 0;
+#if defined(__x86_64__)
+  if (HasAVX2ForRows()) {
+    i = CheckRowOffsetsAVX2(rows, num_rows, max_nnz, &valid);
+  }
+#endif
+  uint32_t worst = 0;
+  for (; i + 1 < num_rows; ++i) {
+    const uint32_t nnz = RowNnz(rows, i);
+    worst = nnz > worst ? nnz : worst;
+  }
+  return valid && worst <= max_nnz;
+}
+
+// Find the first slot whose row offsets are invalid. Returns 'num_rows' - 1
+// if there is none.
+inline size_t
+FindInvalidRowOffset(
+    const int* rows, const size_t num_rows, const uint32_t max_nnz)
+{
+  size_t i = 0;
+  for (; i + 1 < num_rows; ++i) {
+    if (RowNnz(rows, i) > max_nnz) {
+      break;
+    }
+  }
+  return i;
+}
+
+}}}  // namespace triton::backend::hugectr
@@ -32,20 +32,36 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <hot_keys.hpp>
 #include <hps/embedding_cache_base.hpp>
 #include <hps/hier_parameter_server_base.hpp>
 #include <hps/inference_utils.hpp>
 #include <inference/inference_session_base.hpp>
+#include <key_codec.hpp>
+#include <key_frequency_sketch.hpp>
+#include <key_hash.hpp>
+#include <latency_histogram.hpp>
+#include <limits>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <numeric>
+#include <prediction_cache.hpp>
+#include <reduced_precision.hpp>
 #include <sstream>
 #include <thread>
 #include <timer.hpp>
+#include <top_k.hpp>
 #include <triton_helpers.hpp>
+#include <utility>
+#include <vcsr_validator.hpp>
 #include <vector>
 
 namespace triton { namespace backend { namespace hugectr {
@@ -62,10 +78,9 @@ enum class MemoryType_t { GPU, CPU, PIN };
 
 // HugeCTR Backend supports any model that trained by HugeCTR, which
 // has exactly 3 input and exactly 1 output. The input and output should
-// define the name as "DES","CATCOLUMN" and "ROWINDEX", datatype as FP32,
-// UINT32  and INT32, the shape and datatype of the input and output must
-// match. The backend  responds with the output tensor contains the prediction
-// result
+// define the name as "DES","CATCOLUMN" and "ROWINDEX", datatype as FP32
+// (or FP16/BF16), UINT32 (or INT64) and INT32. The backend responds with the
+// output tensor contains the prediction result as FP32 (or FP16).
 //
 
 #define GUARDED_RESPOND_IF_ERROR(RESPONSES, IDX, EXPR)                  \
@@ -115,6 +130,11 @@ enum class MemoryType_t { GPU, CPU, PIN };
     }                                                                   \
   } while (false)
 
+// Names of the optional outputs that return the top-scored samples of a
+// request.
+constexpr char kTopKIndexOutput[] = "TOPK_INDEX";
+constexpr char kTopKScoreOutput[] = "TOPK_SCORE";
+
 // An internal abstraction for cuda memory allocation
 class CudaAllocator {
  public:
@@ -235,6 +255,46 @@ class HugeCTRBuffer : public std::enable_shared_from_this<HugeCTRBuffer<T>> {
   }
 };
 
+//
+// Gather all buffers of a request input into a contiguous staging buffer.
+// Triton may split an input tensor into several chunks, which are appended
+// one after another. Host-to-host copies go through memcpy, which glibc
+// implements with vectorized loads/stores; everything else is left to CUDA.
+//
+TRITONSERVER_Error*
+GatherInputBuffers(
+    TRITONBACKEND_Input* input, const uint32_t buffer_count, void* dst,
+    const MemoryType_t dst_memory_type, const size_t dst_byte_size,
+    size_t* gathered_byte_size)
+{
+  char* const dst_bytes = reinterpret_cast<char*>(dst);
+  size_t offset = 0;
+  for (uint32_t b = 0; b < buffer_count; ++b) {
+    const void* src = nullptr;
+    uint64_t src_byte_size = 0;
+    TRITONSERVER_MemoryType src_memory_type = TRITONSERVER_MEMORY_CPU;
+    int64_t src_memory_type_id = 0;
+    RETURN_IF_ERROR(TRITONBACKEND_InputBuffer(
+        input, b, &src, &src_byte_size, &src_memory_type,
+        &src_memory_type_id));
+    HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+        offset + src_byte_size > dst_byte_size, INVALID_ARG,
+        "Input exceeds the capacity of the staging buffer (", dst_byte_size,
+        " bytes).");
+
+    if (dst_memory_type != MemoryType_t::GPU &&
+        src_memory_type != TRITONSERVER_MEMORY_GPU) {
+      std::memcpy(dst_bytes + offset, src, src_byte_size);
+    } else {
+      CK_CUDA_THROW_(cudaMemcpy(
+          dst_bytes + offset, src, src_byte_size, cudaMemcpyDefault));
+    }
+    offset += src_byte_size;
+  }
+  *gathered_byte_size = offset;
+  return nullptr;
+}
+
 //
 // HugeCTRBackend
 //
@@ -276,6 +336,11 @@ class HugeCTRBackend {
   std::string ParameterServerJsonFile();
   bool UpdateModelVersion(const std::string& model_name, uint64_t version);
 
+  // Get the counter family of the given name, which is shared by all models.
+  // Null if metrics are not supported.
+  TRITONSERVER_MetricFamily* CounterFamily(
+      const std::string& name, const std::string& description);
+
  private:
   TRITONBACKEND_Backend* triton_backend_;
   std::string ps_json_config_file_;
@@ -288,6 +353,9 @@ class HugeCTRBackend {
   std::map<std::string, uint64_t> model_version_map;
   std::mutex version_map_mutex;
 
+  std::map<std::string, TRITONSERVER_MetricFamily*> counter_families_;
+  std::mutex counter_families_mutex_;
+
   common::TritonJson::Value parameter_server_config;
 
   bool support_int64_key_ = false;
@@ -337,7 +405,40 @@ HugeCTRBackend::HugeCTRBackend(
   // current much Model Backend initialization handled by TritonBackend_Backend
 }
 
-HugeCTRBackend::~HugeCTRBackend() {}
+HugeCTRBackend::~HugeCTRBackend()
+{
+  for (const auto& family : counter_families_) {
+    if (family.second != nullptr) {
+      LOG_IF_ERROR(
+          TRITONSERVER_MetricFamilyDelete(family.second),
+          "failed to delete metric family");
+    }
+  }
+}
+
+TRITONSERVER_MetricFamily*
+HugeCTRBackend::CounterFamily(
+    const std::string& name, const std::string& description)
+{
+  std::lock_guard<std::mutex> lock(counter_families_mutex_);
+  const auto it = counter_families_.find(name);
+  if (it != counter_families_.end()) {
+    return it->second;
+  }
+  TRITONSERVER_MetricFamily* family = nullptr;
+  TRITONSERVER_Error* err = TRITONSERVER_MetricFamilyNew(
+      &family, TRITONSERVER_METRIC_KIND_COUNTER, name.c_str(),
+      description.c_str());
+  if (err != nullptr) {
+    HCTR_TRITON_LOG(
+        WARN, "Metric ", name,
+        " is not available: ", TRITONSERVER_ErrorMessage(err));
+    TRITONSERVER_ErrorDelete(err);
+    family = nullptr;
+  }
+  counter_families_.emplace(name, family);
+  return family;
+}
 
 TRITONSERVER_Error*
 HugeCTRBackend::ParseParameterServer(const std::string& path)
@@ -854,12 +955,47 @@ class ModelState {
   // Get the HugeCTR model slots size.
   int64_t SlotNum() const { return slot_num_; }
 
+  // Get the number of slots of each embedding table.
+  const std::vector<int64_t>& SlotNumPerTable() const
+  {
+    return slot_num_per_table_;
+  }
+
+  // Get the number of dense features and the number of leading slots of each
+  // embedding table that all samples of a request share, and which are sent
+  // only once per request.
+  int64_t SharedDesNum() const { return shared_dese_num_; }
+  int64_t SharedSlotNum() const { return shared_slot_num_; }
+  const std::vector<int64_t>& SharedSlotNumPerTable() const
+  {
+    return shared_slot_num_per_table_;
+  }
+
+  // Whether requests carry shared features, which are broadcast to all
+  // samples.
+  bool SharedContext() const
+  {
+    return shared_dese_num_ > 0 || shared_slot_num_ > 0;
+  }
+
   // Get the HugeCTR model max nnz.
   int64_t MaxNNZ() const { return max_nnz_; }
 
   // Get the HugeCTR model dense size.
   int64_t DeseNum() const { return dese_num_; }
 
+  // Get the datatypes of the DES input and the prediction output.
+  TRITONSERVER_DataType DesDataType() const { return des_datatype_; }
+  TRITONSERVER_DataType OutputDataType() const { return output_datatype_; }
+
+  // Get the rank of the prediction output: 1 for [N], or 2 for
+  // [N, label_dim].
+  uint32_t OutputRank() const { return output_shape_.size(); }
+
+  // Get the number of top-scored samples returned by the top-K outputs, or 0
+  // if the model has no top-K outputs.
+  int64_t TopK() const { return has_topk_outputs_ ? top_k_ : 0; }
+
   // Get the HugeCTR model cat feature size.
   int64_t CatNum() const { return cat_num_; }
 
@@ -878,7 +1014,10 @@ class ModelState {
   }
 
   // Get input data entry map
-  std::map<std::string, size_t> GetInputmap() { return input_map_; }
+  const std::map<std::string, size_t, std::less<>>& GetInputmap() const
+  {
+    return input_map_;
+  }
 
   // Get the HugeCTR cache size percentage.
   float CacheSizePer() const { return cache_size_per; }
@@ -895,6 +1034,48 @@ class ModelState {
   // Support int64 embedding key
   bool SupportLongEmbeddingKey() const { return support_int64_key_; }
 
+  // Whether the CATCOLUMN input holds bit-packed keys.
+  bool BitpackedCatKeys() const { return bitpacked_cat_keys_; }
+
+  // Whether the CATCOLUMN input holds raw categorical values, which are
+  // hashed into keys by the backend.
+  bool HashedCatKeys() const { return hashed_cat_keys_; }
+
+  // Get the number of hash buckets, and the key offset of each slot.
+  const std::vector<int64_t>& SlotHashBuckets() const
+  {
+    return slot_hash_buckets_;
+  }
+  const std::vector<uint64_t>& SlotKeyOffsets() const
+  {
+    return slot_key_offsets_;
+  }
+
+  // Whether the ROWINDEX input of every request is validated before
+  // prediction.
+  bool StrictInputValidation() const { return strict_input_validation_; }
+
+  // Get the cache of per-sample predictions. Null if the cache is disabled.
+  PredictionCache* ResultCache() const { return prediction_cache_.get(); }
+
+  // Create the prediction cache, if enabled.
+  TRITONSERVER_Error* CreatePredictionCache();
+
+  // Whether requests that cannot meet their deadline are rejected before
+  // they are executed.
+  bool DeadlineShedding() const { return deadline_shedding_; }
+
+  // Create the counters of the enabled features, labeled with the name and
+  // version of the model.
+  void CreateMetrics(HugeCTRBackend* backend);
+
+  // Account the lookups of a request in the prediction cache metrics.
+  void RecordCacheLookups(uint64_t hits, uint64_t misses);
+
+  // Account a request that was rejected because its deadline had passed
+  // ('expired'), or because it could not be met.
+  void RecordShedRequest(bool expired);
+
   // Get the current HugeCTR model original json config.
   const std::string& HugeCTRJsonConfig() { return hugectr_config_; }
 
@@ -918,6 +1099,26 @@ class ModelState {
   // Create Embedding_cache
   TRITONSERVER_Error* Create_EmbeddingCache();
 
+  // Insert the embeddings of the hot keys into the embedding cache of a
+  // device, so that the first requests do not pay for the cache misses.
+  TRITONSERVER_Error* WarmUpEmbeddingCache(
+      int64_t device_id, const std::vector<std::vector<long long>>& hot_keys);
+
+  // Get the hottest keys of each embedding table with their estimated
+  // frequencies, or nothing if key frequencies are not tracked.
+  std::vector<std::vector<HotKey>> SketchedHotKeys() const;
+
+  // Whether the frequencies of the keys looked up in each embedding table
+  // are tracked.
+  bool TracksKeyFrequencies() const { return !key_frequency_sketches_.empty(); }
+
+  // Count the keys looked up in an embedding table.
+  void RecordKeyFrequencies(
+      const size_t table, const long long* keys, const size_t num_keys)
+  {
+    key_frequency_sketches_[table]->Add(keys, num_keys);
+  }
+
   // Refresh embedding cache periodically
   void Refresh_Embedding_Cache();
 
@@ -955,6 +1156,32 @@ class ModelState {
   int64_t embedding_size_ = 64;
   int64_t max_nnz_ = 3;
   int64_t label_dim_ = 1;
+  std::vector<int64_t> slot_num_per_table_;
+  int64_t shared_dese_num_ = 0;
+  int64_t shared_slot_num_ = 0;
+  std::vector<int64_t> shared_slot_num_per_table_;
+  std::vector<int64_t> slot_hash_buckets_;
+  std::vector<uint64_t> slot_key_offsets_;
+  std::vector<int64_t> output_shape_;
+  bool has_topk_outputs_ = false;
+  int64_t top_k_ = 0;
+  int64_t prediction_cache_size_ = 0;
+  int64_t prediction_cache_ttl_ms_ = 1000;
+  std::unique_ptr<PredictionCache> prediction_cache_;
+  bool deadline_shedding_ = false;
+  std::string hot_key_file_;
+  size_t max_hot_keys_per_table_ = 0;
+  size_t key_frequency_sketch_size_ = 0;
+  size_t tracked_hot_keys_per_table_ = 1024;
+  std::string key_frequency_snapshot_;
+  std::vector<std::unique_ptr<KeyFrequencySketch>> key_frequency_sketches_;
+  TRITONSERVER_Metric* cache_hits_metric_ = nullptr;
+  TRITONSERVER_Metric* cache_misses_metric_ = nullptr;
+  TRITONSERVER_Metric* shed_expired_metric_ = nullptr;
+  TRITONSERVER_Metric* shed_late_metric_ = nullptr;
+  TRITONSERVER_DataType des_datatype_ = TRITONSERVER_TYPE_FP32;
+  TRITONSERVER_DataType cat_datatype_ = TRITONSERVER_TYPE_INT64;
+  TRITONSERVER_DataType output_datatype_ = TRITONSERVER_TYPE_FP32;
   float cache_size_per = 0.5;
   float hit_rate_threshold = 0.9;
   float refresh_interval_ = 0.0f;
@@ -968,6 +1195,9 @@ class ModelState {
   std::vector<std::thread> cache_refresh_threads;
 
   bool support_int64_key_ = false;
+  bool bitpacked_cat_keys_ = false;
+  bool hashed_cat_keys_ = false;
+  bool strict_input_validation_ = false;
   bool support_gpu_cache_ = true;
   bool use_mixed_precision_ = false;
   bool freeze_embedding_ = false;
@@ -978,7 +1208,7 @@ class ModelState {
   std::map<int64_t, std::shared_ptr<HugeCTR::EmbeddingCacheBase>>
       embedding_cache_map;
 
-  std::map<std::string, size_t> input_map_{
+  std::map<std::string, size_t, std::less<>> input_map_{
       {"DES", 0}, {"CATCOLUMN", 1}, {"ROWINDEX", 2}};
 
   Timer timer;
@@ -1054,6 +1284,10 @@ ModelState::EmbeddingCacheRefresh(const std::string& model_name, int device_id)
   if (support_gpu_cache_) {
     EmbeddingTable->refresh_embedding_cache(model_name, device_id);
   }
+  // Cached predictions were computed with the embeddings before the refresh.
+  if (prediction_cache_) {
+    prediction_cache_->invalidate();
+  }
   HCTR_TRITON_LOG(
       INFO, "The model ", model_name,
       " has completed the asynchronous refresh of the embedding cache on "
@@ -1103,15 +1337,24 @@ ModelState::ValidateModelConfig()
           TritonJsonHelper::parse(data_type, input, "data_type", true));
       if (name == "DES") {
         HCTR_RETURN_TRITON_ERROR_IF_FALSE(
-            data_type == "TYPE_FP32", INVALID_ARG,
-            "expected DES input datatype as TYPE_FP32, got ", data_type);
+            data_type == "TYPE_FP32" || data_type == "TYPE_FP16" ||
+                data_type == "TYPE_BF16",
+            INVALID_ARG,
+            "expected DES input datatype as TYPE_FP32, TYPE_FP16 or TYPE_BF16, "
+            "got ",
+            data_type);
+        des_datatype_ =
+            backend::ModelConfigDataTypeToTritonServerDataType(data_type);
       } else if (name == "CATCOLUMN") {
         HCTR_RETURN_TRITON_ERROR_IF_FALSE(
-            data_type == "TYPE_UINT32" || data_type == "TYPE_INT64",
+            data_type == "TYPE_UINT32" || data_type == "TYPE_INT64" ||
+                data_type == "TYPE_UINT8" || data_type == "TYPE_STRING",
             INVALID_ARG,
-            "expected CATCOLUMN input datatype as TYPE_UINT32 or TYPE_INT64, "
-            "got ",
+            "expected CATCOLUMN input datatype as TYPE_UINT32, TYPE_INT64, "
+            "TYPE_UINT8 (encoded keys) or TYPE_STRING (raw values), got ",
             data_type);
+        cat_datatype_ =
+            backend::ModelConfigDataTypeToTritonServerDataType(data_type);
       } else if (name == "ROWINDEX") {
         HCTR_RETURN_TRITON_ERROR_IF_FALSE(
             data_type == "TYPE_INT32", INVALID_ARG,
@@ -1127,35 +1370,92 @@ ModelState::ValidateModelConfig()
     }
   }
 
-  // And there must be 1 output.
+  // And there must be 1 output, optionally followed by the top-K outputs.
   {
     common::TritonJson::Value outputs;
     RETURN_IF_ERROR(model_config_.MemberAsArray("output", &outputs));
     HCTR_RETURN_TRITON_ERROR_IF_FALSE(
-        outputs.ArraySize() == 1, INVALID_ARG, "expect 1 output, got ",
-        outputs.ArraySize());
+        outputs.ArraySize() == 1 || outputs.ArraySize() == 3, INVALID_ARG,
+        "expect 1 output, or 3 outputs including ", kTopKIndexOutput, " and ",
+        kTopKScoreOutput, ", got ", outputs.ArraySize());
 
-    common::TritonJson::Value output;
-    RETURN_IF_ERROR(outputs.IndexAsObject(0, &output));
+    std::string topk_score_data_type;
+    for (size_t i = 0; i < outputs.ArraySize(); i++) {
+      common::TritonJson::Value output;
+      RETURN_IF_ERROR(outputs.IndexAsObject(i, &output));
 
-    std::string data_type;
-    RETURN_IF_ERROR(
-        TritonJsonHelper::parse(data_type, output, "data_type", true));
-    HCTR_RETURN_TRITON_ERROR_IF_FALSE(
-        data_type == "TYPE_FP32", INVALID_ARG,
-        "expected  output datatype as TYPE_FP32, got ", data_type);
+      std::string name;
+      RETURN_IF_ERROR(TritonJsonHelper::parse(name, output, "name", true));
+      std::string data_type;
+      RETURN_IF_ERROR(
+          TritonJsonHelper::parse(data_type, output, "data_type", true));
+      if (name == kTopKIndexOutput) {
+        HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+            data_type == "TYPE_INT64", INVALID_ARG, "expected ",
+            kTopKIndexOutput, " output datatype as TYPE_INT64, got ",
+            data_type);
+        has_topk_outputs_ = true;
+      } else if (name == kTopKScoreOutput) {
+        topk_score_data_type = data_type;
+      } else {
+        HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+            data_type == "TYPE_FP32" || data_type == "TYPE_FP16", INVALID_ARG,
+            "expected  output datatype as TYPE_FP32 or TYPE_FP16, got ",
+            data_type);
+        output_datatype_ =
+            backend::ModelConfigDataTypeToTritonServerDataType(data_type);
+      }
 
-    // output must have -1 shape
-    std::vector<int64_t> shape;
-    RETURN_IF_ERROR(backend::ParseShape(output, "dims", &shape));
-    HCTR_RETURN_TRITON_ERROR_IF_FALSE(
-        shape[0] == -1, INVALID_ARG, "expected  output shape equal -1, got ",
-        backend::ShapeToString(shape));
+      // output must have -1 shape
+      std::vector<int64_t> shape;
+      RETURN_IF_ERROR(backend::ParseShape(output, "dims", &shape));
+      HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+          shape[0] == -1, INVALID_ARG,
+          "expected  output shape equal -1, got ",
+          backend::ShapeToString(shape));
+      if (name != kTopKIndexOutput && name != kTopKScoreOutput) {
+        output_shape_ = shape;
+      }
+    }
+    if (outputs.ArraySize() == 3) {
+      HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+          has_topk_outputs_ &&
+              backend::ModelConfigDataTypeToTritonServerDataType(
+                  topk_score_data_type) == output_datatype_,
+          INVALID_ARG, "expected outputs ", kTopKIndexOutput, " and ",
+          kTopKScoreOutput,
+          " besides the prediction output, with the score in the datatype of "
+          "the predictions");
+    }
   }
 
   return nullptr;  // success
 }
 
+// Parses the comma-separated integer list given for the model parameter 'key'.
+// Fails on anything that is not an integer of at least 'min_value'.
+static TRITONSERVER_Error*
+ParseIntegerList(
+    const std::string& list, const char* key, const int64_t min_value,
+    std::vector<int64_t>* values)
+{
+  for (const std::string& item : hctr_str_split(list, ',')) {
+    const char* begin = item.c_str();
+    char* end = nullptr;
+    errno = 0;
+    const long long value = std::strtoll(begin, &end, 10);
+    while (end != begin && std::isspace(static_cast<unsigned char>(*end))) {
+      ++end;
+    }
+    HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+        end == begin || *end != '\0' || errno == ERANGE || value < min_value,
+        INVALID_ARG, "expected '", key, "' to list integers >= ", min_value,
+        ", got '", item, "'");
+    values->emplace_back(value);
+  }
+  return nullptr;  // success
+}
+
 TRITONSERVER_Error*
 ModelState::ParseModelConfig()
 {
@@ -1212,6 +1512,67 @@ ModelState::ParseModelConfig()
     }
     HCTR_TRITON_LOG(INFO, "slots set = ", slot_num_);
 
+    if (parameters.Find("slot_num_per_table", &value)) {
+      std::string tmp;
+      RETURN_IF_ERROR(
+          TritonJsonHelper::parse(tmp, value, "string_value", false));
+      RETURN_IF_ERROR(
+          ParseIntegerList(tmp, "slot_num_per_table", 0, &slot_num_per_table_));
+      HCTR_TRITON_LOG(
+          INFO, "slots per table = [", hctr_str_join(", ", slot_num_per_table_),
+          "]");
+    }
+
+    if (parameters.Find("shared_des_feature_num", &value)) {
+      RETURN_IF_ERROR(TritonJsonHelper::parse(
+          shared_dese_num_, value, "string_value", false));
+      HCTR_TRITON_LOG(INFO, "shared dense features = ", shared_dese_num_);
+    }
+
+    if (parameters.Find("shared_slot_num_per_table", &value)) {
+      std::string tmp;
+      RETURN_IF_ERROR(
+          TritonJsonHelper::parse(tmp, value, "string_value", false));
+      RETURN_IF_ERROR(ParseIntegerList(
+          tmp, "shared_slot_num_per_table", 0, &shared_slot_num_per_table_));
+      HCTR_TRITON_LOG(
+          INFO, "shared slots per table = [",
+          hctr_str_join(", ", shared_slot_num_per_table_), "]");
+    }
+
+    if (parameters.Find("strict_input_validation", &value)) {
+      RETURN_IF_ERROR(TritonJsonHelper::parse(
+          strict_input_validation_, value, "string_value", false));
+    }
+    HCTR_TRITON_LOG(
+        INFO, "strict input validation = ", strict_input_validation_);
+
+    if (parameters.Find("catcolumn_encoding", &value)) {
+      std::string encoding;
+      RETURN_IF_ERROR(
+          TritonJsonHelper::parse(encoding, value, "string_value", false));
+      HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+          encoding == "none" || encoding == "bitpacked" ||
+              encoding == "hashed",
+          INVALID_ARG,
+          "expected 'catcolumn_encoding' as none, bitpacked or hashed, got ",
+          encoding);
+      bitpacked_cat_keys_ = encoding == "bitpacked";
+      hashed_cat_keys_ = encoding == "hashed";
+      HCTR_TRITON_LOG(INFO, "CATCOLUMN encoding = ", encoding);
+    }
+
+    if (parameters.Find("slot_hash_buckets", &value)) {
+      std::string tmp;
+      RETURN_IF_ERROR(
+          TritonJsonHelper::parse(tmp, value, "string_value", false));
+      RETURN_IF_ERROR(
+          ParseIntegerList(tmp, "slot_hash_buckets", 1, &slot_hash_buckets_));
+      HCTR_TRITON_LOG(
+          INFO, "hash buckets per slot = [",
+          hctr_str_join(", ", slot_hash_buckets_), "]");
+    }
+
     if (parameters.Find("des_feature_num", &value)) {
       RETURN_IF_ERROR(
           TritonJsonHelper::parse(dese_num_, value, "string_value", false));
@@ -1256,6 +1617,66 @@ ModelState::ParseModelConfig()
       HCTR_TRITON_LOG(INFO, "maxnnz = ", max_nnz_);
     }
 
+    if (parameters.Find("top_k", &value)) {
+      RETURN_IF_ERROR(
+          TritonJsonHelper::parse(top_k_, value, "string_value", false));
+      HCTR_TRITON_LOG(INFO, "top k = ", top_k_);
+    }
+
+    if (parameters.Find("prediction_cache_size", &value)) {
+      RETURN_IF_ERROR(TritonJsonHelper::parse(
+          prediction_cache_size_, value, "string_value", false));
+      HCTR_TRITON_LOG(
+          INFO, "prediction cache size = ", prediction_cache_size_);
+    }
+
+    if (parameters.Find("prediction_cache_ttl_ms", &value)) {
+      RETURN_IF_ERROR(TritonJsonHelper::parse(
+          prediction_cache_ttl_ms_, value, "string_value", false));
+      HCTR_TRITON_LOG(
+          INFO, "prediction cache ttl = ", prediction_cache_ttl_ms_, " ms");
+    }
+
+    if (parameters.Find("deadline_shedding", &value)) {
+      RETURN_IF_ERROR(TritonJsonHelper::parse(
+          deadline_shedding_, value, "string_value", false));
+      HCTR_TRITON_LOG(INFO, "deadline shedding = ", deadline_shedding_);
+    }
+
+    if (parameters.Find("hot_key_file", &value)) {
+      RETURN_IF_ERROR(TritonJsonHelper::parse(
+          hot_key_file_, value, "string_value", false));
+      HCTR_TRITON_LOG(INFO, "hot key file = ", hot_key_file_);
+    }
+
+    if (parameters.Find("max_hot_keys_per_table", &value)) {
+      RETURN_IF_ERROR(TritonJsonHelper::parse(
+          max_hot_keys_per_table_, value, "string_value", false));
+      HCTR_TRITON_LOG(
+          INFO, "max hot keys per table = ", max_hot_keys_per_table_);
+    }
+
+    if (parameters.Find("key_frequency_sketch_size", &value)) {
+      RETURN_IF_ERROR(TritonJsonHelper::parse(
+          key_frequency_sketch_size_, value, "string_value", false));
+      HCTR_TRITON_LOG(
+          INFO, "key frequency sketch size = ", key_frequency_sketch_size_);
+    }
+
+    if (parameters.Find("tracked_hot_keys_per_table", &value)) {
+      RETURN_IF_ERROR(TritonJsonHelper::parse(
+          tracked_hot_keys_per_table_, value, "string_value", false));
+      HCTR_TRITON_LOG(
+          INFO, "tracked hot keys per table = ", tracked_hot_keys_per_table_);
+    }
+
+    if (parameters.Find("key_frequency_snapshot", &value)) {
+      RETURN_IF_ERROR(TritonJsonHelper::parse(
+          key_frequency_snapshot_, value, "string_value", false));
+      HCTR_TRITON_LOG(
+          INFO, "key frequency snapshot = ", key_frequency_snapshot_);
+    }
+
     if (parameters.Find("refresh_interval", &value)) {
       RETURN_IF_ERROR(TritonJsonHelper::parse(
           refresh_interval_, value, "string_value", false));
@@ -1384,6 +1805,129 @@ ModelState::ParseModelConfig()
         INFO, "support 64-bit embedding key = ", support_int64_key_);
   }
 
+  HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+      bitpacked_cat_keys_ == (cat_datatype_ == TRITONSERVER_TYPE_UINT8),
+      INVALID_ARG,
+      "expected CATCOLUMN input datatype as TYPE_UINT8 if and only if "
+      "'catcolumn_encoding' is bitpacked");
+  HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+      hashed_cat_keys_ == (cat_datatype_ == TRITONSERVER_TYPE_BYTES),
+      INVALID_ARG,
+      "expected CATCOLUMN input datatype as TYPE_STRING if and only if "
+      "'catcolumn_encoding' is hashed");
+
+  // The slots of a single embedding table need no explicit configuration.
+  const size_t num_tables = Model_Inference_Para.sparse_model_files.size();
+  if (slot_num_per_table_.empty() && num_tables == 1) {
+    slot_num_per_table_.emplace_back(slot_num_);
+  }
+  if (!slot_num_per_table_.empty()) {
+    HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+        slot_num_per_table_.size() == num_tables &&
+            std::accumulate(
+                slot_num_per_table_.begin(), slot_num_per_table_.end(),
+                int64_t{0}) == slot_num_,
+        INVALID_ARG, "expected 'slot_num_per_table' to list the slots of ",
+        num_tables, " embedding table(s) adding up to ", slot_num_, ", got [",
+        hctr_str_join(", ", slot_num_per_table_), "]");
+  }
+
+  // Keys are attributed to their embedding tables by the slots per table.
+  if (key_frequency_sketch_size_ > 0) {
+    HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+        slot_num_per_table_.empty(), UNSUPPORTED,
+        "Tracking key frequencies requires \"slot_num_per_table\" to be set "
+        "in config.pbtxt for models with multiple embedding tables.");
+    for (size_t t = 0; t < num_tables; ++t) {
+      key_frequency_sketches_.emplace_back(new KeyFrequencySketch(
+          key_frequency_sketch_size_, tracked_hot_keys_per_table_));
+    }
+  }
+
+  // Shared features are the leading dense features and the leading slots of
+  // each embedding table. At least one slot must remain per sample.
+  HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+      shared_dese_num_ >= 0 && shared_dese_num_ <= dese_num_, INVALID_ARG,
+      "expected 'shared_des_feature_num' between 0 and ", dese_num_, ", got ",
+      shared_dese_num_);
+  if (!shared_slot_num_per_table_.empty()) {
+    HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+        shared_slot_num_per_table_.size() == slot_num_per_table_.size(),
+        INVALID_ARG, "expected 'shared_slot_num_per_table' to list the ",
+        "shared slots of the ", slot_num_per_table_.size(),
+        " embedding table(s) listed in 'slot_num_per_table', got [",
+        hctr_str_join(", ", shared_slot_num_per_table_), "]");
+    for (size_t i = 0; i < shared_slot_num_per_table_.size(); ++i) {
+      HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+          shared_slot_num_per_table_[i] >= 0 &&
+              shared_slot_num_per_table_[i] <= slot_num_per_table_[i],
+          INVALID_ARG, "expected at most ", slot_num_per_table_[i],
+          " shared slots for embedding table ", i, ", got ",
+          shared_slot_num_per_table_[i]);
+    }
+    shared_slot_num_ = std::accumulate(
+        shared_slot_num_per_table_.begin(), shared_slot_num_per_table_.end(),
+        int64_t{0});
+    HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+        shared_slot_num_ < slot_num_, INVALID_ARG,
+        "expected at least one slot per sample that is not shared, got ",
+        shared_slot_num_, " shared slots out of ", slot_num_);
+  } else {
+    shared_slot_num_per_table_.assign(slot_num_per_table_.size(), 0);
+  }
+  HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+      strict_input_validation_ && slot_num_per_table_.empty(), INVALID_ARG,
+      "Strict input validation requires 'slot_num_per_table' to be set for "
+      "models with multiple embedding tables.");
+  HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+      SharedContext() && slot_num_per_table_.empty(), INVALID_ARG,
+      "Shared features require 'slot_num_per_table' to be set for models "
+      "with multiple embedding tables.");
+
+  // Multi-head models predict 'label_dim' values per sample, all of which
+  // are returned in the prediction output.
+  HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+      (output_shape_.size() == 1 && label_dim_ == 1) ||
+          (output_shape_.size() == 2 && output_shape_[1] == label_dim_),
+      INVALID_ARG, "expected the prediction output dims as [ -1, ", label_dim_,
+      " ]", label_dim_ == 1 ? " or [ -1 ]" : "", ", got ",
+      backend::ShapeToString(output_shape_));
+  HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+      has_topk_outputs_ && top_k_ <= 0, INVALID_ARG,
+      "The top-K outputs require 'top_k' to be set to a positive value.");
+
+  // Hashed keys of a slot lie in [offset, offset + buckets), and the slots of
+  // each embedding table are laid out back to back starting from key 0.
+  if (hashed_cat_keys_) {
+    HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+        slot_num_per_table_.empty(), INVALID_ARG,
+        "Hashed keys require 'slot_num_per_table' to be set for models with "
+        "multiple embedding tables.");
+    HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+        slot_hash_buckets_.size() == static_cast<size_t>(slot_num_),
+        INVALID_ARG, "expected 'slot_hash_buckets' to list the hash buckets ",
+        "of ", slot_num_, " slots, got [",
+        hctr_str_join(", ", slot_hash_buckets_), "]");
+    const uint64_t max_key = support_int64_key_
+                                 ? std::numeric_limits<long long>::max()
+                                 : std::numeric_limits<unsigned int>::max();
+    size_t slot = 0;
+    for (const int64_t slots : slot_num_per_table_) {
+      uint64_t offset = 0;
+      for (int64_t i = 0; i < slots; ++i, ++slot) {
+        const int64_t buckets = slot_hash_buckets_[slot];
+        HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+            buckets > 0 && static_cast<uint64_t>(buckets) - 1 <= max_key &&
+                offset <= max_key - (buckets - 1),
+            INVALID_ARG, "expected the hash buckets of slot ", slot,
+            " to be positive, and the keys of each embedding table to fit ",
+            "into the embedding key type, got ", buckets, " buckets");
+        slot_key_offsets_.emplace_back(offset);
+        offset += buckets;
+      }
+    }
+  }
+
   model_config_.MemberAsInt("max_batch_size", &max_batch_size_);
   HCTR_RETURN_TRITON_ERROR_IF_FALSE(
       static_cast<size_t>(max_batch_size_) ==
@@ -1407,6 +1951,15 @@ ModelState::Refresh_Embedding_Cache()
   int64_t count = gpu_shape.size();
   uint64_t exec_start_ns = 0;
   SET_TIMESTAMP(exec_start_ns);
+  // The hottest keys seen lately are prefetched after each refresh, so that
+  // they are neither evicted nor left stale.
+  std::vector<std::vector<long long>> prefetch_keys;
+  for (const std::vector<HotKey>& hot_keys : SketchedHotKeys()) {
+    prefetch_keys.emplace_back();
+    for (const HotKey& hot_key : hot_keys) {
+      prefetch_keys.back().push_back(hot_key.key);
+    }
+  }
   for (int i = 0; i < count; i++) {
     if (support_gpu_cache_) {
       LOG_MESSAGE(
@@ -1424,8 +1977,16 @@ ModelState::Refresh_Embedding_Cache()
                " has refreshed the embedding cache asynchronously on device ") +
            std::to_string(gpu_shape[i]))
               .c_str());
+      if (!prefetch_keys.empty()) {
+        LOG_IF_ERROR(
+            WarmUpEmbeddingCache(gpu_shape[i], prefetch_keys),
+            "failed to prefetch hot keys");
+      }
     }
   }
+  if (prediction_cache_) {
+    prediction_cache_->invalidate();
+  }
   uint64_t exec_end_ns = 0;
   SET_TIMESTAMP(exec_end_ns);
   int64_t exe_time = (exec_end_ns - exec_start_ns) / 1000000;
@@ -1440,6 +2001,7 @@ TRITONSERVER_Error*
 ModelState::Create_EmbeddingCache()
 {
   int64_t count = gpu_shape.size();
+  std::vector<std::vector<long long>> hot_keys;
   if (count > 0 && support_gpu_cache_) {
     if (EmbeddingTable->get_embedding_cache(name_, gpu_shape[0]) == nullptr) {
       HCTR_TRITON_LOG(
@@ -1453,6 +2015,15 @@ ModelState::Create_EmbeddingCache()
       HCTR_TRITON_LOG(INFO, "Create embedding cache for model ", name_);
       EmbeddingTable->create_embedding_cache_per_model(Model_Inference_Para);
     }
+    if (!hot_key_file_.empty()) {
+      std::string error;
+      HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+          ReadHotKeys(
+              hot_key_file_,
+              Model_Inference_Para.embedding_vecsize_per_table.size(),
+              max_hot_keys_per_table_, &hot_keys, &error),
+          INVALID_ARG, error);
+    }
   }
   for (int i = 0; i < count; i++) {
     std::vector<int>::iterator iter = find(
@@ -1470,6 +2041,9 @@ ModelState::Create_EmbeddingCache()
       Model_Inference_Para.device_id = gpu_shape[i];
       embedding_cache_map[gpu_shape[i]] =
           EmbeddingTable->get_embedding_cache(name_, gpu_shape[i]);
+      if (!hot_keys.empty()) {
+        RETURN_IF_ERROR(WarmUpEmbeddingCache(gpu_shape[i], hot_keys));
+      }
       if (version_ps_ > 0 && version_ps_ != version_) {
         timer.startonce(
             0,
@@ -1497,53 +2071,411 @@ ModelState::Create_EmbeddingCache()
   return nullptr;
 }
 
-ModelState::~ModelState()
+TRITONSERVER_Error*
+ModelState::WarmUpEmbeddingCache(
+    const int64_t device_id,
+    const std::vector<std::vector<long long>>& hot_keys)
 {
-  if (support_gpu_cache_ && version_ps_ == version_) {
-    EmbeddingTable->destory_embedding_cache_per_model(name_);
-    HCTR_TRITON_LOG(
-        INFO, "******Destorying Embedding Cache for model ", name_,
-        " successfully");
+  // Not operator[], which would insert a null cache for an unknown device
+  // while other threads may read the map.
+  const auto it = embedding_cache_map.find(device_id);
+  HugeCTR::EmbeddingCacheBase* const embedding_cache =
+      it != embedding_cache_map.end() ? it->second.get() : nullptr;
+  HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+      embedding_cache != nullptr, INTERNAL,
+      "missing embedding cache of model ", name_, " in device ", device_id);
+
+  // Look up the hot keys in batches as large as a request can be. With a hit
+  // rate threshold of 1, the missing embeddings are fetched from the
+  // parameter server and inserted into the cache before the lookup returns.
+  const std::vector<size_t>& max_keys_per_sample =
+      Model_Inference_Para.maxnum_catfeature_query_per_table_per_sample;
+  const std::vector<size_t>& vector_sizes =
+      Model_Inference_Para.embedding_vecsize_per_table;
+  std::vector<size_t> batch_sizes(hot_keys.size());
+  size_t max_num_elements = 0;
+  for (size_t t = 0; t < hot_keys.size(); ++t) {
+    batch_sizes[t] = Model_Inference_Para.max_batchsize;
+    if (t < max_keys_per_sample.size() && max_keys_per_sample[t] > 0) {
+      batch_sizes[t] *= max_keys_per_sample[t];
+    }
+    max_num_elements =
+        std::max(max_num_elements, batch_sizes[t] * vector_sizes[t]);
   }
-  embedding_cache_map.clear();
-  for (auto& ec_refresh_thread : cache_refresh_threads) {
-    ec_refresh_thread.join();
+
+  uint64_t exec_start_ns = 0;
+  SET_TIMESTAMP(exec_start_ns);
+  size_t num_hot_keys = 0;
+  cudaStream_t stream = nullptr;
+  try {
+    CK_CUDA_THROW_(cudaSetDevice(device_id));
+    auto vectors_buf = HugeCTRBuffer<float>::create();
+    vectors_buf->reserve({max_num_elements});
+    vectors_buf->allocate();
+    CK_CUDA_THROW_(cudaStreamCreate(&stream));
+    std::vector<unsigned int> keys_int32;
+    for (size_t t = 0; t < hot_keys.size(); ++t) {
+      const std::vector<long long>& keys = hot_keys[t];
+      for (size_t i = 0; i < keys.size(); i += batch_sizes[t]) {
+        const size_t num_keys = std::min(batch_sizes[t], keys.size() - i);
+        const void* h_keys = &keys[i];
+        if (!Model_Inference_Para.i64_input_key) {
+          keys_int32.assign(&keys[i], &keys[i] + num_keys);
+          h_keys = keys_int32.data();
+        }
+        embedding_cache->lookup(
+            t, vectors_buf->get_ptr(), h_keys, num_keys, 1.0f, stream);
+        CK_CUDA_THROW_(cudaStreamSynchronize(stream));
+      }
+      num_hot_keys += keys.size();
+    }
+    CK_CUDA_THROW_(cudaStreamDestroy(std::exchange(stream, nullptr)));
   }
-  timer.stop();
+  catch (const std::exception& e) {
+    // Do not leak the stream if a lookup failed.
+    if (stream != nullptr) {
+      cudaStreamDestroy(stream);
+    }
+    return HCTR_TRITON_ERROR(
+        INTERNAL, "failed to warm up the embedding cache of model ", name_,
+        " in device ", device_id, ": ", e.what());
+  }
+
+  uint64_t exec_end_ns = 0;
+  SET_TIMESTAMP(exec_end_ns);
+  HCTR_TRITON_LOG(
+      INFO, "Warmed up the embedding cache of model ", name_, " in device ",
+      device_id, " with ", num_hot_keys, " hot keys in ",
+      (exec_end_ns - exec_start_ns) / 1000000, " ms");
+  return nullptr;
 }
 
-//
-// ModelInstanceState
-//
-// State associated with a model instance. An object of this class is
-// created and associated with each TRITONBACKEND_ModelInstance.
-//
-class ModelInstanceState {
- public:
-  static TRITONSERVER_Error* Create(
-      ModelState* model_state,
-      TRITONBACKEND_ModelInstance* triton_model_instance,
-      ModelInstanceState** state, HugeCTR::InferenceParams instance_params);
+std::vector<std::vector<HotKey>>
+ModelState::SketchedHotKeys() const
+{
+  std::vector<std::vector<HotKey>> hot_keys;
+  for (const std::unique_ptr<KeyFrequencySketch>& sketch :
+       key_frequency_sketches_) {
+    hot_keys.emplace_back(sketch->HotKeys());
+  }
+  return hot_keys;
+}
 
-  ~ModelInstanceState();
+TRITONSERVER_Error*
+ModelState::CreatePredictionCache()
+{
+  HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+      prediction_cache_size_ >= 0 && prediction_cache_ttl_ms_ > 0,
+      INVALID_ARG,
+      "expected 'prediction_cache_size' to be non-negative and "
+      "'prediction_cache_ttl_ms' to be positive, got ",
+      prediction_cache_size_, " and ", prediction_cache_ttl_ms_);
+  if (prediction_cache_size_ == 0) {
+    return nullptr;
+  }
+  HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+      slot_num_per_table_.empty(), INVALID_ARG,
+      "The prediction cache requires 'slot_num_per_table' to be set for "
+      "models with multiple embedding tables.");
+
+  prediction_cache_ = std::make_unique<PredictionCache>(
+      prediction_cache_size_,
+      label_dim_ * TRITONSERVER_DataTypeByteSize(output_datatype_),
+      prediction_cache_ttl_ms_ * 1000000);
+  HCTR_TRITON_LOG(
+      INFO, "******Creating prediction cache for model ", name_, " with ",
+      prediction_cache_size_, " entries");
+  return nullptr;
+}
 
-  // Get the handle to the TRITONBACKEND model instance.
-  TRITONBACKEND_ModelInstance* TritonModelInstance()
-  {
-    return triton_model_instance_;
+// Create a counter of the given family, labeled with the name and version of
+// the model. Null if the family is not available.
+static TRITONSERVER_Metric*
+NewModelCounter(
+    TRITONSERVER_MetricFamily* family, const std::string& model_name,
+    const uint64_t model_version)
+{
+  if (family == nullptr) {
+    return nullptr;
+  }
+  const std::string version = std::to_string(model_version);
+  std::array<const TRITONSERVER_Parameter*, 2> labels = {
+      TRITONSERVER_ParameterNew(
+          "model", TRITONSERVER_PARAMETER_STRING, model_name.c_str()),
+      TRITONSERVER_ParameterNew(
+          "version", TRITONSERVER_PARAMETER_STRING, version.c_str())};
+  TRITONSERVER_Metric* metric = nullptr;
+  LOG_IF_ERROR(
+      TRITONSERVER_MetricNew(&metric, family, labels.data(), labels.size()),
+      "failed to create metric");
+  for (const TRITONSERVER_Parameter* label : labels) {
+    TRITONSERVER_ParameterDelete(const_cast<TRITONSERVER_Parameter*>(label));
   }
+  return metric;
+}
 
-  // Get the name, kind and device ID of the instance.
-  const std::string& Name() const { return name_; }
-  TRITONSERVER_InstanceGroupKind Kind() const { return kind_; }
-  int32_t DeviceId() const { return device_id_; }
-  size_t EmbeddingTableCount() { return num_embedding_tables; }
+// Increment a counter, if it exists.
+static void
+IncrementCounter(TRITONSERVER_Metric* metric, const double value)
+{
+  if (metric != nullptr) {
+    LOG_IF_ERROR(
+        TRITONSERVER_MetricIncrement(metric, value),
+        "failed to update metric");
+  }
+}
 
-  // Get the state of the model that corresponds to this instance.
+void
+ModelState::CreateMetrics(HugeCTRBackend* backend)
+{
+  if (prediction_cache_) {
+    cache_hits_metric_ = NewModelCounter(
+        backend->CounterFamily(
+            "nv_hugectr_prediction_cache_hits",
+            "Number of samples whose prediction was served from the "
+            "prediction cache"),
+        name_, version_);
+    cache_misses_metric_ = NewModelCounter(
+        backend->CounterFamily(
+            "nv_hugectr_prediction_cache_misses",
+            "Number of samples whose prediction was not found in the "
+            "prediction cache"),
+        name_, version_);
+  }
+  if (deadline_shedding_) {
+    shed_expired_metric_ = NewModelCounter(
+        backend->CounterFamily(
+            "nv_hugectr_shed_expired_requests",
+            "Number of requests rejected because their deadline had passed"),
+        name_, version_);
+    shed_late_metric_ = NewModelCounter(
+        backend->CounterFamily(
+            "nv_hugectr_shed_late_requests",
+            "Number of requests rejected because their deadline could not "
+            "be met"),
+        name_, version_);
+  }
+}
+
+void
+ModelState::RecordCacheLookups(const uint64_t hits, const uint64_t misses)
+{
+  IncrementCounter(cache_hits_metric_, hits);
+  IncrementCounter(cache_misses_metric_, misses);
+}
+
+void
+ModelState::RecordShedRequest(const bool expired)
+{
+  IncrementCounter(expired ? shed_expired_metric_ : shed_late_metric_, 1);
+}
+
+ModelState::~ModelState()
+{
+  // Stop refreshing before the embedding caches go away, as refreshes also
+  // prefetch into them.
+  timer.stop();
+  if (!key_frequency_snapshot_.empty() && TracksKeyFrequencies()) {
+    std::string error;
+    if (WriteHotKeys(key_frequency_snapshot_, SketchedHotKeys(), &error)) {
+      HCTR_TRITON_LOG(
+          INFO, "Wrote the key frequency snapshot of model ", name_, " to ",
+          key_frequency_snapshot_);
+    } else {
+      HCTR_TRITON_LOG(ERROR, error);
+    }
+  }
+  if (prediction_cache_) {
+    HCTR_TRITON_LOG(
+        INFO, "Model ", name_,
+        " prediction cache: ", prediction_cache_->to_string());
+  }
+  for (TRITONSERVER_Metric* metric :
+       {cache_hits_metric_, cache_misses_metric_, shed_expired_metric_,
+        shed_late_metric_}) {
+    if (metric != nullptr) {
+      LOG_IF_ERROR(
+          TRITONSERVER_MetricDelete(metric), "failed to delete metric");
+    }
+  }
+  if (support_gpu_cache_ && version_ps_ == version_) {
+    EmbeddingTable->destory_embedding_cache_per_model(name_);
+    HCTR_TRITON_LOG(
+        INFO, "******Destorying Embedding Cache for model ", name_,
+        " successfully");
+  }
+  embedding_cache_map.clear();
+  for (auto& ec_refresh_thread : cache_refresh_threads) {
+    ec_refresh_thread.join();
+  }
+}
+
+//
+// ModelInstanceState
+//
+// State associated with a model instance. An object of this class is
+// created and associated with each TRITONBACKEND_ModelInstance.
+//
+class ModelInstanceState {
+ public:
+  static TRITONSERVER_Error* Create(
+      ModelState* model_state,
+      TRITONBACKEND_ModelInstance* triton_model_instance,
+      ModelInstanceState** state, HugeCTR::InferenceParams instance_params);
+
+  ~ModelInstanceState();
+
+  // Get the handle to the TRITONBACKEND model instance.
+  TRITONBACKEND_ModelInstance* TritonModelInstance()
+  {
+    return triton_model_instance_;
+  }
+
+  // Get the name, kind and device ID of the instance.
+  const std::string& Name() const { return name_; }
+  TRITONSERVER_InstanceGroupKind Kind() const { return kind_; }
+  int32_t DeviceId() const { return device_id_; }
+  size_t EmbeddingTableCount() { return num_embedding_tables; }
+
+  // Get the state of the model that corresponds to this instance.
   ModelState* StateForModel() const { return model_state_; }
 
-  // Get the prediction result that corresponds to this instance.
-  TRITONSERVER_Error* ProcessRequest(int64_t numofsamples);
+  // Get the prediction result that corresponds to this instance. The
+  // predictions are written to 'output' if given, which must be device memory
+  // of this instance, and to the prediction buffer otherwise.
+  TRITONSERVER_Error* ProcessRequest(
+      int64_t numofsamples, float* output = nullptr);
+
+  // Stage a request with more samples than the max batch size in host memory.
+  TRITONSERVER_Error* StageOversizedRequest(
+      TRITONBACKEND_Input* des_input, uint32_t des_buffer_count,
+      uint64_t des_byte_size, TRITONBACKEND_Input* cat_input,
+      uint32_t cat_buffer_count, uint64_t cat_byte_size,
+      TRITONBACKEND_Input* row_input, uint32_t row_buffer_count,
+      uint64_t row_byte_size);
+
+  // Predict a staged request in micro-batches of at most the max batch size
+  // and stitch the predictions together in the output buffer.
+  TRITONSERVER_Error* ProcessRequestInMicroBatches(
+      int64_t numofsamples, void* output_buffer,
+      TRITONSERVER_MemoryType output_memory_type,
+      int64_t output_memory_type_id);
+
+  // Serve the samples of a staged request from the prediction cache, and
+  // predict the remaining samples in micro-batches.
+  TRITONSERVER_Error* ProcessRequestWithCache(
+      int64_t numofsamples, void* output_buffer,
+      TRITONSERVER_MemoryType output_memory_type);
+
+  // Create the requested top-K outputs of a response from the predictions of
+  // its samples.
+  TRITONSERVER_Error* RespondTopK(
+      TRITONBACKEND_Response* response, int64_t numofsamples,
+      const void* predictions, TRITONSERVER_MemoryType predictions_memory_type,
+      bool index_requested, bool score_requested);
+
+  // Get host memory for the predictions of a request that only asks for the
+  // top-K outputs.
+  void* HostPredictionBuffer(size_t byte_size)
+  {
+    unrequested_predictions_.resize(byte_size);
+    return unrequested_predictions_.data();
+  }
+
+  // Hash the features of each sample of a staged request into
+  // 'sample_hashes_'.
+  TRITONSERVER_Error* HashStagedSamples(int64_t numofsamples);
+
+  // Reduce a staged request to the samples listed in 'missed_samples_'.
+  void SelectStagedSamples(int64_t numofsamples);
+
+  // Check that the row offsets of each table start at zero, that each slot
+  // holds between 0 and max nnz keys, and that the tables hold 'num_keys'
+  // keys in total.
+  TRITONSERVER_Error* ValidateRowIndex(
+      const int* rows, size_t num_rows, int64_t numofsamples,
+      size_t num_keys) const;
+
+  // Expand a staged request with shared features into the regular layout,
+  // in which each sample carries all of its features. The shared keys are
+  // repeated for every sample, and passed on to the inference session as
+  // they are: the backend does not deduplicate keys.
+  TRITONSERVER_Error* BroadcastSharedContext(int64_t numofsamples);
+
+  // Gather the encoded CATCOLUMN input into 'encoded_cat_', and count its
+  // keys.
+  TRITONSERVER_Error* GatherEncodedKeys(
+      TRITONBACKEND_Input* cat_input, uint32_t buffer_count,
+      uint64_t byte_size, size_t* num_keys);
+
+  // Decode 'encoded_cat_' into 'dst', which holds 'dst_byte_size' bytes.
+  TRITONSERVER_Error* DecodeEncodedKeys(void* dst, size_t dst_byte_size);
+
+  // Hash the raw categorical values of a staged request, held in
+  // 'encoded_cat_', into the keys of their slots.
+  TRITONSERVER_Error* HashRawKeys(int64_t numofsamples);
+
+  // Whether predictions can be written straight into an output buffer of
+  // the given memory type, instead of being copied from the prediction
+  // buffer.
+  bool CanPredictInto(
+      TRITONSERVER_MemoryType memory_type, int64_t memory_type_id) const
+  {
+    return model_state_->OutputDataType() == TRITONSERVER_TYPE_FP32 &&
+           memory_type == TRITONSERVER_MEMORY_GPU &&
+           memory_type_id == device_id_;
+  }
+
+  // Gather the DES input of a request into 'dst' as FP32. Reduced-precision
+  // features are widened on the host. 'gathered_byte_size' is the size of the
+  // input as sent in the request.
+  TRITONSERVER_Error* GatherDenseFeatures(
+      TRITONBACKEND_Input* des_input, uint32_t buffer_count,
+      uint64_t byte_size, float* dst, MemoryType_t dst_memory_type,
+      size_t dst_byte_size, size_t* gathered_byte_size);
+
+  // Gather the CATCOLUMN input of a request into the CATCOLUMN buffer as raw
+  // keys. Bit-packed keys are decoded on the host. 'gathered_byte_size' is
+  // the size of the input as sent in the request.
+  TRITONSERVER_Error* GatherCategoricalKeys(
+      TRITONBACKEND_Input* cat_input, uint32_t buffer_count,
+      uint64_t byte_size, size_t* gathered_byte_size, size_t* num_keys);
+
+  // Gather the ROWINDEX input of a request into the ROWINDEX buffer. With
+  // strict input validation, the rows are gathered and validated on the host
+  // first.
+  TRITONSERVER_Error* GatherRowIndex(
+      TRITONBACKEND_Input* row_input, uint32_t buffer_count,
+      int64_t numofsamples, size_t num_keys, size_t* gathered_byte_size);
+
+  // Validate the row offsets of a staged request.
+  TRITONSERVER_Error* ValidateStagedRequest(int64_t numofsamples) const;
+
+  // Copy the predictions of 'count' samples from the prediction buffer to
+  // the output buffer, starting at sample 'offset', in the datatype of the
+  // output. Each sample has 'label_dim' predictions.
+  TRITONSERVER_Error* CopyPredictions(
+      int64_t count, void* output_buffer, int64_t offset,
+      TRITONSERVER_MemoryType output_memory_type);
+
+  // Count the keys of the staged batch in the key frequency sketches of their
+  // embedding tables.
+  void RecordKeyFrequencies(int64_t numofsamples);
+
+  // Record the time spent staging inputs, predicting and copying outputs.
+  void RecordPhaseLatencies(
+      uint64_t exec_start_ns, uint64_t compute_start_ns,
+      uint64_t compute_end_ns, uint64_t exec_end_ns, int64_t numofsamples);
+
+  // Reject a request of 'numofsamples' samples if its deadline has passed,
+  // or cannot be met at the measured cost per sample. Execution of the
+  // batch of requests started at 'batch_start_ns'.
+  TRITONSERVER_Error* AdmitRequest(
+      TRITONBACKEND_Request* request, uint64_t batch_start_ns,
+      int64_t numofsamples);
+
+  // Log the latency distribution of each execution phase.
+  void LogPhaseLatencies(TRITONSERVER_LogLevel level) const;
 
   // Create Embedding_cache
   TRITONSERVER_Error* LoadHugeCTRModel();
@@ -1565,6 +2497,9 @@ class ModelInstanceState {
 
   std::shared_ptr<HugeCTRBuffer<int>> GetRowBuffer() { return row_ptr_buf; }
 
+  // Response objects of the requests currently being executed.
+  std::vector<TRITONBACKEND_Response*>& Responses() { return responses_; }
+
   std::shared_ptr<HugeCTRBuffer<float>> GetPredictBuffer()
   {
     return prediction_buf;
@@ -1594,6 +2529,69 @@ class ModelInstanceState {
   std::shared_ptr<HugeCTR::EmbeddingCacheBase> embedding_cache;
   HugeCTR::InferenceParams instance_params_;
 
+  // Host side staging of oversized requests, which are split into
+  // micro-batches. These only grow, so repeated large requests reuse them.
+  std::vector<float> staged_des_;
+  std::vector<char> staged_cat_;
+  std::vector<int> staged_row_;
+  std::vector<int> micro_batch_row_;
+
+  // Host side conversion of reduced-precision dense features and
+  // predictions.
+  std::vector<uint16_t> reduced_des_;
+  std::vector<float> widened_des_;
+  std::vector<float> host_predictions_;
+  std::vector<uint16_t> narrowed_predictions_;
+
+  // Staged requests with shared features before they are expanded.
+  std::vector<float> compact_des_;
+  std::vector<char> compact_cat_;
+  std::vector<int> compact_row_;
+
+  // Top-K selection of the request being executed.
+  std::vector<uint8_t> unrequested_predictions_;
+  std::vector<uint8_t> topk_raw_;
+  std::vector<float> topk_scores_;
+  std::vector<int64_t> topk_order_;
+  std::vector<uint8_t> topk_selected_;
+
+  // Prediction cache lookups of the request being executed.
+  std::vector<uint64_t> sample_hashes_;
+  std::vector<int64_t> missed_samples_;
+  std::vector<uint8_t> cached_output_;
+  std::vector<uint8_t> missed_output_;
+
+  // Row offsets of the request being executed, gathered on the host for
+  // strict input validation or key frequency tracking.
+  std::vector<int> host_row_;
+
+  // Host copy of the row offsets in the ROWINDEX buffer, which is either
+  // 'host_row_' or 'micro_batch_row_'.
+  const int* staged_host_row_ = nullptr;
+  size_t staged_host_row_count_ = 0;
+
+  // Encoded keys of the request being executed.
+  std::vector<uint8_t> encoded_cat_;
+
+  // 32-bit keys of the batch being executed, widened for the key frequency
+  // sketches.
+  std::vector<long long> widened_keys_;
+
+  // Offsets of the raw categorical values in 'encoded_cat_'.
+  std::vector<size_t> raw_value_offsets_;
+
+  std::vector<TRITONBACKEND_Response*> responses_;
+
+  // Per-phase latency distributions of the requests served by this instance.
+  LatencyHistogram input_latency_;
+  LatencyHistogram infer_latency_;
+  LatencyHistogram output_latency_;
+
+  // Moving average of the execution time per sample, and the number of
+  // requests that were shed by this instance.
+  double ns_per_sample_ = 0;
+  uint64_t shed_requests_ = 0;
+
   std::shared_ptr<HugeCTR::InferenceSessionBase> hugectrmodel_;
 };
 
@@ -1675,6 +2673,7 @@ ModelInstanceState::ModelInstanceState(
       model_state_->ModelInferencePara().sparse_model_files.size())};
   row_ptr_buf->reserve(row_ptrs_dims);
   row_ptr_buf->allocate();
+  micro_batch_row_.resize(row_ptrs_dims[0]);
 
   HCTR_TRITON_LOG(INFO, "Predict result buffer allocation: ");
   prediction_buf = HugeCTRBuffer<float>::create();
@@ -1686,6 +2685,8 @@ ModelInstanceState::ModelInstanceState(
 
 ModelInstanceState::~ModelInstanceState()
 {
+  LogPhaseLatencies(TRITONSERVER_LOG_INFO);
+
   // release all the buffers
   embedding_cache.reset();
   model_state_->GetEmbeddingCache(device_id_).reset();
@@ -1707,20 +2708,973 @@ ModelInstanceState::LoadHugeCTRModel()
 }
 
 TRITONSERVER_Error*
-ModelInstanceState::ProcessRequest(int64_t numofsamples)
+ModelInstanceState::ProcessRequest(int64_t numofsamples, float* output)
 {
+  if (output == nullptr) {
+    output = prediction_buf->get_ptr();
+  }
+  if (model_state_->TracksKeyFrequencies()) {
+    RecordKeyFrequencies(numofsamples);
+  }
   if (model_state_->SupportLongEmbeddingKey()) {
     hugectrmodel_->predict(
         dense_value_buf->get_ptr(), cat_column_index_buf_int64->get_raw_ptr(),
-        row_ptr_buf->get_ptr(), prediction_buf->get_ptr(), numofsamples);
+        row_ptr_buf->get_ptr(), output, numofsamples);
   } else {
     hugectrmodel_->predict(
         dense_value_buf->get_ptr(), cat_column_index_buf_int32->get_raw_ptr(),
-        row_ptr_buf->get_ptr(), prediction_buf->get_ptr(), numofsamples);
+        row_ptr_buf->get_ptr(), output, numofsamples);
   }
   return nullptr;
 }
 
+void
+ModelInstanceState::RecordKeyFrequencies(const int64_t numofsamples)
+{
+  // The keys are laid out table by table, and the row offsets of each table
+  // start at zero, so that the last row offset of a table is its number of
+  // keys. These are read from the host copy of the staged row offsets. Row
+  // offsets that have not been validated are clamped to the keys in the
+  // CATCOLUMN buffer.
+  const std::vector<int64_t>& slots_per_table =
+      model_state_->SlotNumPerTable();
+  const size_t max_num_keys =
+      model_state_->SupportLongEmbeddingKey()
+          ? cat_column_index_buf_int64->get_buffer_size() / sizeof(long long)
+          : cat_column_index_buf_int32->get_buffer_size() /
+                sizeof(unsigned int);
+  size_t row_base = 0;
+  size_t key_base = 0;
+  for (size_t t = 0; t < slots_per_table.size(); ++t) {
+    row_base += numofsamples * slots_per_table[t];
+    if (row_base >= staged_host_row_count_) {
+      return;
+    }
+    const int table_end = staged_host_row_[row_base];
+    const size_t num_keys = std::min<size_t>(
+        std::max(table_end, 0), max_num_keys - key_base);
+    const long long* keys;
+    if (model_state_->SupportLongEmbeddingKey()) {
+      keys = cat_column_index_buf_int64->get_ptr() + key_base;
+    } else {
+      const unsigned int* narrow_keys =
+          cat_column_index_buf_int32->get_ptr() + key_base;
+      widened_keys_.assign(narrow_keys, narrow_keys + num_keys);
+      keys = widened_keys_.data();
+    }
+    model_state_->RecordKeyFrequencies(t, keys, num_keys);
+    row_base += 1;
+    key_base += num_keys;
+  }
+}
+
+void
+ModelInstanceState::RecordPhaseLatencies(
+    const uint64_t exec_start_ns, const uint64_t compute_start_ns,
+    const uint64_t compute_end_ns, const uint64_t exec_end_ns,
+    const int64_t numofsamples)
+{
+  input_latency_.record(compute_start_ns - exec_start_ns);
+  infer_latency_.record(compute_end_ns - compute_start_ns);
+  output_latency_.record(exec_end_ns - compute_end_ns);
+  if (numofsamples > 0) {
+    const double ns_per_sample =
+        static_cast<double>(exec_end_ns - exec_start_ns) / numofsamples;
+    ns_per_sample_ = ns_per_sample_ == 0
+                         ? ns_per_sample
+                         : 0.9 * ns_per_sample_ + 0.1 * ns_per_sample;
+  }
+
+  // Periodically summarize where the time goes.
+  if (infer_latency_.count() % 1000 == 0) {
+    LogPhaseLatencies(TRITONSERVER_LOG_VERBOSE);
+  }
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::AdmitRequest(
+    TRITONBACKEND_Request* request, const uint64_t batch_start_ns,
+    const int64_t numofsamples)
+{
+  uint64_t timeout_us = 0;
+  RETURN_IF_ERROR(
+      TRITONBACKEND_RequestTimeoutMicroseconds(request, &timeout_us));
+  if (timeout_us == 0) {
+    return nullptr;
+  }
+
+  // Backends do not learn how long a request was queued, so its deadline is
+  // taken as its timeout from the start of the batch. The actual deadline is
+  // never later than that.
+  const uint64_t deadline_ns = batch_start_ns + timeout_us * 1000;
+  uint64_t now_ns = 0;
+  SET_TIMESTAMP(now_ns);
+  if (now_ns >= deadline_ns) {
+    ++shed_requests_;
+    model_state_->RecordShedRequest(true);
+    return HCTR_TRITON_ERROR(
+        UNAVAILABLE, "The request was shed, as its timeout of ", timeout_us,
+        " us expired before it could be executed.");
+  }
+  const uint64_t estimate_ns =
+      static_cast<uint64_t>(ns_per_sample_ * numofsamples);
+  if (now_ns + estimate_ns > deadline_ns) {
+    ++shed_requests_;
+    model_state_->RecordShedRequest(false);
+    return HCTR_TRITON_ERROR(
+        UNAVAILABLE, "The request was shed, as its ", numofsamples,
+        " samples take an estimated ", estimate_ns / 1000,
+        " us, but its timeout expires in ", (deadline_ns - now_ns) / 1000,
+        " us.");
+  }
+  return nullptr;
+}
+
+void
+ModelInstanceState::LogPhaseLatencies(const TRITONSERVER_LogLevel level) const
+{
+  if (!TRITONSERVER_LogIsEnabled(level)) {
+    return;
+  }
+  std::string msg = hctr_str_concat(
+      "Model ", name_, " on device ", device_id_,
+      " phase latencies:\n\tinput staging: ", input_latency_.to_string(),
+      "\n\tprediction: ", infer_latency_.to_string(),
+      "\n\toutput copy: ", output_latency_.to_string());
+  if (model_state_->ResultCache() != nullptr) {
+    msg += hctr_str_concat(
+        "\n\tprediction cache: ", model_state_->ResultCache()->to_string());
+  }
+  if (model_state_->DeadlineShedding()) {
+    msg += hctr_str_concat("\n\tshed requests: ", shed_requests_);
+  }
+  LOG_IF_ERROR(
+      TRITONSERVER_LogMessage(level, __FILE__, __LINE__, msg.c_str()),
+      "failed to log message: ");
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::GatherDenseFeatures(
+    TRITONBACKEND_Input* des_input, const uint32_t buffer_count,
+    const uint64_t byte_size, float* dst, const MemoryType_t dst_memory_type,
+    const size_t dst_byte_size, size_t* gathered_byte_size)
+{
+  const TRITONSERVER_DataType datatype = model_state_->DesDataType();
+  if (datatype == TRITONSERVER_TYPE_FP32) {
+    return GatherInputBuffers(
+        des_input, buffer_count, dst, dst_memory_type, dst_byte_size,
+        gathered_byte_size);
+  }
+
+  reduced_des_.resize(byte_size / sizeof(uint16_t));
+  RETURN_IF_ERROR(GatherInputBuffers(
+      des_input, buffer_count, reduced_des_.data(), MemoryType_t::CPU,
+      reduced_des_.size() * sizeof(uint16_t), gathered_byte_size));
+  const size_t num_values = reduced_des_.size();
+  HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+      num_values * sizeof(float) > dst_byte_size, INVALID_ARG,
+      "Input exceeds the capacity of the staging buffer (", dst_byte_size,
+      " bytes).");
+
+  float* widened = dst;
+  if (dst_memory_type == MemoryType_t::GPU) {
+    widened_des_.resize(num_values);
+    widened = widened_des_.data();
+  }
+  if (datatype == TRITONSERVER_TYPE_FP16) {
+    ConvertHalfToFloat(reduced_des_.data(), widened, num_values);
+  } else {
+    ConvertBFloat16ToFloat(reduced_des_.data(), widened, num_values);
+  }
+  if (dst_memory_type == MemoryType_t::GPU) {
+    CK_CUDA_THROW_(cudaMemcpy(
+        dst, widened, num_values * sizeof(float), cudaMemcpyHostToDevice));
+  }
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::GatherEncodedKeys(
+    TRITONBACKEND_Input* cat_input, const uint32_t buffer_count,
+    const uint64_t byte_size, size_t* num_keys)
+{
+  size_t gathered_byte_size;
+  encoded_cat_.resize(byte_size);
+  RETURN_IF_ERROR(GatherInputBuffers(
+      cat_input, buffer_count, encoded_cat_.data(), MemoryType_t::CPU,
+      encoded_cat_.size(), &gathered_byte_size));
+  HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+      gathered_byte_size == byte_size, INVALID_ARG,
+      "The gathered CATCOLUMN input size does not match the input "
+      "properties.");
+  HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+      CountBitpackedKeys(encoded_cat_.data(), encoded_cat_.size(), num_keys),
+      INVALID_ARG, "The bit-packed CATCOLUMN input is malformed.");
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::DecodeEncodedKeys(void* dst, const size_t dst_byte_size)
+{
+  size_t num_keys = 0;
+  bool decoded;
+  if (model_state_->SupportLongEmbeddingKey()) {
+    decoded = DecodeBitpackedKeys(
+        encoded_cat_.data(), encoded_cat_.size(),
+        reinterpret_cast<long long*>(dst), dst_byte_size / sizeof(long long),
+        &num_keys);
+  } else {
+    decoded = DecodeBitpackedKeys(
+        encoded_cat_.data(), encoded_cat_.size(),
+        reinterpret_cast<unsigned int*>(dst),
+        dst_byte_size / sizeof(unsigned int), &num_keys);
+  }
+  HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+      decoded, INVALID_ARG,
+      "The bit-packed CATCOLUMN input is malformed, holds keys out of range "
+      "or exceeds the capacity of the CATCOLUMN buffer (",
+      dst_byte_size, " bytes).");
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::GatherCategoricalKeys(
+    TRITONBACKEND_Input* cat_input, const uint32_t buffer_count,
+    const uint64_t byte_size, size_t* gathered_byte_size, size_t* num_keys)
+{
+  void* const dst = model_state_->SupportLongEmbeddingKey()
+                        ? cat_column_index_buf_int64->get_raw_ptr()
+                        : cat_column_index_buf_int32->get_raw_ptr();
+  const size_t dst_byte_size =
+      model_state_->SupportLongEmbeddingKey()
+          ? cat_column_index_buf_int64->get_buffer_size()
+          : cat_column_index_buf_int32->get_buffer_size();
+  if (!model_state_->BitpackedCatKeys()) {
+    RETURN_IF_ERROR(GatherInputBuffers(
+        cat_input, buffer_count, dst, MemoryType_t::PIN, dst_byte_size,
+        gathered_byte_size));
+    *num_keys = *gathered_byte_size / (model_state_->SupportLongEmbeddingKey()
+                                           ? sizeof(long long)
+                                           : sizeof(unsigned int));
+    return nullptr;
+  }
+
+  // The CATCOLUMN buffer is pinned host memory, so decode straight into it.
+  RETURN_IF_ERROR(
+      GatherEncodedKeys(cat_input, buffer_count, byte_size, num_keys));
+  RETURN_IF_ERROR(DecodeEncodedKeys(dst, dst_byte_size));
+  *gathered_byte_size = byte_size;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::GatherRowIndex(
+    TRITONBACKEND_Input* row_input, const uint32_t buffer_count,
+    const int64_t numofsamples, const size_t num_keys,
+    size_t* gathered_byte_size)
+{
+  // Key frequency tracking reads the row offsets on the host as well.
+  if (!model_state_->StrictInputValidation() &&
+      !model_state_->TracksKeyFrequencies()) {
+    return GatherInputBuffers(
+        row_input, buffer_count, row_ptr_buf->get_raw_ptr(), MemoryType_t::GPU,
+        row_ptr_buf->get_buffer_size(), gathered_byte_size);
+  }
+
+  host_row_.resize(row_ptr_buf->get_buffer_size() / sizeof(int));
+  RETURN_IF_ERROR(GatherInputBuffers(
+      row_input, buffer_count, host_row_.data(), MemoryType_t::CPU,
+      host_row_.size() * sizeof(int), gathered_byte_size));
+  const size_t num_rows = *gathered_byte_size / sizeof(int);
+  if (model_state_->StrictInputValidation()) {
+    RETURN_IF_ERROR(
+        ValidateRowIndex(host_row_.data(), num_rows, numofsamples, num_keys));
+  }
+  CK_CUDA_THROW_(cudaMemcpy(
+      row_ptr_buf->get_raw_ptr(), host_row_.data(), *gathered_byte_size,
+      cudaMemcpyHostToDevice));
+  staged_host_row_ = host_row_.data();
+  staged_host_row_count_ = num_rows;
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::ValidateStagedRequest(const int64_t numofsamples) const
+{
+  const size_t key_size = model_state_->SupportLongEmbeddingKey()
+                              ? sizeof(long long)
+                              : sizeof(unsigned int);
+  return ValidateRowIndex(
+      staged_row_.data(), staged_row_.size(), numofsamples,
+      staged_cat_.size() / key_size);
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::ValidateRowIndex(
+    const int* rows, const size_t num_rows, const int64_t numofsamples,
+    const size_t num_keys) const
+{
+  const uint32_t max_nnz = model_state_->MaxNNZ();
+  size_t row_base = 0;
+  size_t key_base = 0;
+  for (const int64_t slots : model_state_->SlotNumPerTable()) {
+    const size_t table_rows = numofsamples * slots + 1;
+    HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+        row_base + table_rows > num_rows, INVALID_ARG,
+        "The ROWINDEX input holds ", num_rows, " row offsets, expected ",
+        row_base + table_rows, " or more.");
+    const int* const table = rows + row_base;
+    HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+        table[0] != 0, INVALID_ARG,
+        "The ROWINDEX input is invalid: the row offsets of each embedding "
+        "table must start at 0, got ",
+        table[0], " at row ", row_base, ".");
+    if (!RowOffsetsValid(table, table_rows, max_nnz)) {
+      const size_t row = FindInvalidRowOffset(table, table_rows, max_nnz);
+      return HCTR_TRITON_ERROR(
+          INVALID_ARG,
+          "The ROWINDEX input is invalid: each slot must hold between 0 and ",
+          max_nnz, " keys, but row ", row_base + row, " holds ",
+          static_cast<int64_t>(table[row + 1]) - table[row], ".");
+    }
+    row_base += table_rows;
+    key_base += table[table_rows - 1];
+  }
+  HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+      row_base != num_rows || key_base != num_keys, INVALID_ARG,
+      "The ROWINDEX input is invalid: it holds ", num_rows,
+      " row offsets addressing ", key_base, " keys, expected ", row_base,
+      " row offsets addressing the ", num_keys, " keys of CATCOLUMN.");
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::CopyPredictions(
+    const int64_t count, void* output_buffer, const int64_t offset,
+    const TRITONSERVER_MemoryType output_memory_type)
+{
+  const bool output_on_device = output_memory_type == TRITONSERVER_MEMORY_GPU;
+  const int64_t num_values = count * model_state_->LabelDim();
+  const int64_t first_value = offset * model_state_->LabelDim();
+  if (model_state_->OutputDataType() == TRITONSERVER_TYPE_FP32) {
+    CK_CUDA_THROW_(cudaMemcpy(
+        reinterpret_cast<float*>(output_buffer) + first_value,
+        prediction_buf->get_raw_ptr(), num_values * sizeof(float),
+        output_on_device ? cudaMemcpyDeviceToDevice : cudaMemcpyDeviceToHost));
+    return nullptr;
+  }
+
+  // FP16 predictions are narrowed on the host.
+  host_predictions_.resize(num_values);
+  CK_CUDA_THROW_(cudaMemcpy(
+      host_predictions_.data(), prediction_buf->get_raw_ptr(),
+      num_values * sizeof(float), cudaMemcpyDeviceToHost));
+  uint16_t* const output =
+      reinterpret_cast<uint16_t*>(output_buffer) + first_value;
+  if (output_on_device) {
+    narrowed_predictions_.resize(num_values);
+    ConvertFloatToHalf(
+        host_predictions_.data(), narrowed_predictions_.data(), num_values);
+    CK_CUDA_THROW_(cudaMemcpy(
+        output, narrowed_predictions_.data(), num_values * sizeof(uint16_t),
+        cudaMemcpyHostToDevice));
+  } else {
+    ConvertFloatToHalf(host_predictions_.data(), output, num_values);
+  }
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::StageOversizedRequest(
+    TRITONBACKEND_Input* des_input, const uint32_t des_buffer_count,
+    const uint64_t des_byte_size, TRITONBACKEND_Input* cat_input,
+    const uint32_t cat_buffer_count, const uint64_t cat_byte_size,
+    TRITONBACKEND_Input* row_input, const uint32_t row_buffer_count,
+    const uint64_t row_byte_size)
+{
+  size_t gathered_byte_size;
+
+  staged_des_.resize(
+      des_byte_size /
+      TRITONSERVER_DataTypeByteSize(model_state_->DesDataType()));
+  RETURN_IF_ERROR(GatherDenseFeatures(
+      des_input, des_buffer_count, des_byte_size, staged_des_.data(),
+      MemoryType_t::CPU, staged_des_.size() * sizeof(float),
+      &gathered_byte_size));
+  HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+      gathered_byte_size == des_byte_size, INVALID_ARG,
+      "The gathered DES input size does not match the input properties.");
+
+  if (model_state_->BitpackedCatKeys()) {
+    size_t num_keys;
+    RETURN_IF_ERROR(GatherEncodedKeys(
+        cat_input, cat_buffer_count, cat_byte_size, &num_keys));
+    staged_cat_.resize(
+        num_keys * (model_state_->SupportLongEmbeddingKey()
+                        ? sizeof(long long)
+                        : sizeof(unsigned int)));
+    RETURN_IF_ERROR(DecodeEncodedKeys(staged_cat_.data(), staged_cat_.size()));
+  } else if (model_state_->HashedCatKeys()) {
+    // The raw values are hashed once the row offsets are known.
+    encoded_cat_.resize(cat_byte_size);
+    RETURN_IF_ERROR(GatherInputBuffers(
+        cat_input, cat_buffer_count, encoded_cat_.data(), MemoryType_t::CPU,
+        encoded_cat_.size(), &gathered_byte_size));
+    HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+        gathered_byte_size == cat_byte_size, INVALID_ARG,
+        "The gathered CATCOLUMN input size does not match the input "
+        "properties.");
+  } else {
+    staged_cat_.resize(cat_byte_size);
+    RETURN_IF_ERROR(GatherInputBuffers(
+        cat_input, cat_buffer_count, staged_cat_.data(), MemoryType_t::CPU,
+        staged_cat_.size(), &gathered_byte_size));
+    HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+        gathered_byte_size == cat_byte_size, INVALID_ARG,
+        "The gathered CATCOLUMN input size does not match the input "
+        "properties.");
+  }
+
+  staged_row_.resize(row_byte_size / sizeof(int));
+  RETURN_IF_ERROR(GatherInputBuffers(
+      row_input, row_buffer_count, staged_row_.data(), MemoryType_t::CPU,
+      staged_row_.size() * sizeof(int), &gathered_byte_size));
+  HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+      gathered_byte_size == row_byte_size, INVALID_ARG,
+      "The gathered ROWINDEX input size does not match the input properties.");
+
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::HashRawKeys(const int64_t numofsamples)
+{
+  // A serialized BYTES tensor holds each value as a 4 byte length followed
+  // by the value itself.
+  const uint8_t* const raw = encoded_cat_.data();
+  const size_t raw_size = encoded_cat_.size();
+  raw_value_offsets_.clear();
+  for (size_t pos = 0; pos < raw_size;) {
+    HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+        raw_size - pos >= sizeof(uint32_t), INVALID_ARG,
+        "The raw CATCOLUMN input is malformed.");
+    const uint32_t len = LoadLE32(raw + pos);
+    pos += sizeof(uint32_t);
+    HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+        raw_size - pos >= len, INVALID_ARG,
+        "The raw CATCOLUMN input is malformed.");
+    raw_value_offsets_.emplace_back(pos);
+    pos += len;
+  }
+  const size_t num_values = raw_value_offsets_.size();
+  // Sentinel, so that value i spans [offset i, offset i + 1 - 4).
+  raw_value_offsets_.emplace_back(raw_size + sizeof(uint32_t));
+
+  const bool long_keys = model_state_->SupportLongEmbeddingKey();
+  const size_t key_size = long_keys ? sizeof(long long) : sizeof(unsigned int);
+  staged_cat_.resize(num_values * key_size);
+  long long* const long_dst = reinterpret_cast<long long*>(staged_cat_.data());
+  unsigned int* const dst =
+      reinterpret_cast<unsigned int*>(staged_cat_.data());
+
+  // The shared slots of a table, if any, come first, followed by the own
+  // slots of each sample.
+  const std::vector<int64_t>& slots_per_table =
+      model_state_->SlotNumPerTable();
+  const std::vector<int64_t>& shared_slots_per_table =
+      model_state_->SharedSlotNumPerTable();
+  const std::vector<int64_t>& buckets = model_state_->SlotHashBuckets();
+  const std::vector<uint64_t>& offsets = model_state_->SlotKeyOffsets();
+  size_t row_base = 0;
+  size_t key_base = 0;
+  int64_t slot_base = 0;
+  for (size_t t = 0; t < slots_per_table.size(); ++t) {
+    const int64_t shared_slots = shared_slots_per_table[t];
+    const int64_t own_slots = slots_per_table[t] - shared_slots;
+    const size_t table_rows = shared_slots + numofsamples * own_slots;
+    HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+        row_base + table_rows < staged_row_.size(), INVALID_ARG,
+        "The ROWINDEX input holds ", staged_row_.size(),
+        " row offsets, expected more than ", row_base + table_rows, ".");
+    const int* const rows = &staged_row_[row_base];
+    HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+        rows[0] == 0, INVALID_ARG, "The ROWINDEX input of embedding table ", t,
+        " starts at ", rows[0], ", expected 0.");
+    for (size_t i = 0; i < table_rows; ++i) {
+      const int64_t row = i;
+      const int64_t slot =
+          slot_base + (row < shared_slots
+                           ? row
+                           : shared_slots + (row - shared_slots) % own_slots);
+      const size_t begin = key_base + rows[i];
+      const size_t end = key_base + rows[i + 1];
+      HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+          rows[i] >= 0 && rows[i] <= rows[i + 1] && end <= num_values,
+          INVALID_ARG, "The ROWINDEX input is invalid at row ", row_base + i,
+          ".");
+      for (size_t k = begin; k < end; ++k) {
+        const size_t len = raw_value_offsets_[k + 1] - sizeof(uint32_t) -
+                           raw_value_offsets_[k];
+        const uint64_t key =
+            offsets[slot] +
+            XXHash64(raw + raw_value_offsets_[k], len) % buckets[slot];
+        if (long_keys) {
+          long_dst[k] = static_cast<long long>(key);
+        } else {
+          dst[k] = static_cast<unsigned int>(key);
+        }
+      }
+    }
+    row_base += table_rows + 1;
+    key_base += rows[table_rows];
+    slot_base += slots_per_table[t];
+  }
+  HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+      key_base == num_values, INVALID_ARG, "The ROWINDEX input addresses ",
+      key_base, " values, but CATCOLUMN holds ", num_values, ".");
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::BroadcastSharedContext(const int64_t numofsamples)
+{
+  const int64_t des_num = model_state_->DeseNum();
+  const int64_t shared_des_num = model_state_->SharedDesNum();
+  const int64_t own_des_num = des_num - shared_des_num;
+  const std::vector<int64_t>& slots_per_table =
+      model_state_->SlotNumPerTable();
+  const std::vector<int64_t>& shared_slots_per_table =
+      model_state_->SharedSlotNumPerTable();
+  const size_t key_size = model_state_->SupportLongEmbeddingKey()
+                              ? sizeof(long long)
+                              : sizeof(unsigned int);
+
+  // Move the compact request aside and expand it into the staging buffers.
+  compact_des_.swap(staged_des_);
+  compact_cat_.swap(staged_cat_);
+  compact_row_.swap(staged_row_);
+
+  // Each sample gets the shared dense features followed by its own.
+  HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+      compact_des_.size() ==
+          static_cast<size_t>(shared_des_num + numofsamples * own_des_num),
+      INVALID_ARG, "expected ", shared_des_num, " shared and ",
+      numofsamples * own_des_num, " per-sample dense features, got ",
+      compact_des_.size());
+  staged_des_.resize(numofsamples * des_num);
+  for (int64_t i = 0; i < numofsamples; ++i) {
+    float* const sample = &staged_des_[i * des_num];
+    std::copy_n(compact_des_.begin(), shared_des_num, sample);
+    std::copy_n(
+        compact_des_.begin() + shared_des_num + i * own_des_num, own_des_num,
+        sample + shared_des_num);
+  }
+
+  // The rows of each table hold the shared slots once, followed by the
+  // remaining slots of each sample. Size the expanded tables first.
+  const size_t num_compact_keys = compact_cat_.size() / key_size;
+  size_t row_base = 0;
+  size_t key_base = 0;
+  size_t num_keys = 0;
+  for (size_t t = 0; t < slots_per_table.size(); ++t) {
+    const int64_t shared_slots = shared_slots_per_table[t];
+    const int64_t own_slots = slots_per_table[t] - shared_slots;
+    const size_t num_rows = shared_slots + numofsamples * own_slots + 1;
+    HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+        row_base + num_rows > compact_row_.size(), INVALID_ARG,
+        "The ROWINDEX input of the request is too small for the shared and "
+        "per-sample slots of embedding table ",
+        t, ".");
+    const int* const rows = &compact_row_[row_base];
+    const int64_t shared_keys = rows[shared_slots];
+    const int64_t table_keys = rows[num_rows - 1];
+    const int64_t expanded_keys =
+        numofsamples * shared_keys + table_keys - shared_keys;
+    HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+        rows[0] != 0 || shared_keys < 0 || shared_keys > table_keys ||
+            key_base + table_keys > num_compact_keys ||
+            expanded_keys > std::numeric_limits<int>::max(),
+        INVALID_ARG,
+        "The ROWINDEX input of the request does not match its CATCOLUMN "
+        "input.");
+    num_keys += expanded_keys;
+    row_base += num_rows;
+    key_base += table_keys;
+  }
+  HCTR_RETURN_TRITON_ERROR_IF_FALSE(
+      row_base == compact_row_.size(), INVALID_ARG,
+      "The ROWINDEX input of the request holds ", compact_row_.size(),
+      " row offsets, expected ", row_base, ".");
+
+  staged_cat_.resize(num_keys * key_size);
+  staged_row_.resize(
+      numofsamples * model_state_->SlotNum() + slots_per_table.size());
+  const char* const compact_cat = compact_cat_.data();
+  char* cat = staged_cat_.data();
+  int* row = staged_row_.data();
+  row_base = 0;
+  key_base = 0;
+  for (size_t t = 0; t < slots_per_table.size(); ++t) {
+    const int64_t shared_slots = shared_slots_per_table[t];
+    const int64_t own_slots = slots_per_table[t] - shared_slots;
+    const int* const rows = &compact_row_[row_base];
+    const int shared_keys = rows[shared_slots];
+    const int table_keys = rows[shared_slots + numofsamples * own_slots];
+    const char* const table_cat = compact_cat + key_base * key_size;
+
+    int key = 0;
+    *row++ = 0;
+    for (int64_t i = 0; i < numofsamples; ++i) {
+      for (int64_t j = 1; j <= shared_slots; ++j) {
+        *row++ = key + rows[j];
+      }
+      std::memcpy(cat, table_cat, shared_keys * key_size);
+      cat += shared_keys * key_size;
+      key += shared_keys;
+
+      const int* const own_rows = rows + shared_slots + i * own_slots;
+      const int first = own_rows[0];
+      const int last = own_rows[own_slots];
+      HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+          first < shared_keys || first > last || last > table_keys,
+          INVALID_ARG,
+          "The ROWINDEX input of the request does not match its CATCOLUMN "
+          "input.");
+      for (int64_t j = 1; j <= own_slots; ++j) {
+        *row++ = key + own_rows[j] - first;
+      }
+      std::memcpy(cat, table_cat + first * key_size, (last - first) * key_size);
+      cat += (last - first) * key_size;
+      key += last - first;
+    }
+    row_base += shared_slots + numofsamples * own_slots + 1;
+    key_base += table_keys;
+  }
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::ProcessRequestInMicroBatches(
+    const int64_t numofsamples, void* output_buffer,
+    const TRITONSERVER_MemoryType output_memory_type,
+    const int64_t output_memory_type_id)
+{
+  const std::vector<int64_t>& slots_per_table =
+      model_state_->SlotNumPerTable();
+  HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+      slots_per_table.size() != num_embedding_tables, UNSUPPORTED,
+      "The number of input samples is greater than the max batch size. "
+      "Splitting such requests requires \"slot_num_per_table\" to be set in "
+      "config.pbtxt for models with multiple embedding tables.");
+
+  const int64_t max_batch_size = model_state_->BatchSize();
+  const int64_t des_num = model_state_->DeseNum();
+  const bool i64_keys = model_state_->SupportLongEmbeddingKey();
+  const size_t key_size = i64_keys ? sizeof(long long) : sizeof(unsigned int);
+  const size_t num_keys = staged_cat_.size() / key_size;
+  char* const cat_buf = reinterpret_cast<char*>(
+      i64_keys ? cat_column_index_buf_int64->get_raw_ptr()
+               : cat_column_index_buf_int32->get_raw_ptr());
+  const size_t cat_buf_size =
+      i64_keys ? cat_column_index_buf_int64->get_buffer_size()
+               : cat_column_index_buf_int32->get_buffer_size();
+  const bool predict_into_output =
+      CanPredictInto(output_memory_type, output_memory_type_id);
+
+  for (int64_t first = 0; first < numofsamples; first += max_batch_size) {
+    const int64_t last = std::min(first + max_batch_size, numofsamples);
+    const int64_t batch_size = last - first;
+
+    // Dense features are laid out sample by sample.
+    CK_CUDA_THROW_(cudaMemcpy(
+        dense_value_buf->get_raw_ptr(), &staged_des_[first * des_num],
+        batch_size * des_num * sizeof(float), cudaMemcpyHostToDevice));
+
+    // Keys and row offsets are laid out table by table, and the row offsets
+    // of each table start at zero. Cut out the rows of the micro-batch and
+    // rebase them onto its first key.
+    size_t row_base = 0;
+    size_t key_base = 0;
+    size_t cat_offset = 0;
+    size_t row_offset = 0;
+    for (const int64_t slots : slots_per_table) {
+      const int* const rows = &staged_row_[row_base];
+      const int begin = rows[first * slots];
+      const int end = rows[last * slots];
+      const int table_end = rows[numofsamples * slots];
+      HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+          begin < 0 || begin > end || end > table_end ||
+              key_base + table_end > num_keys,
+          INVALID_ARG,
+          "The ROWINDEX input of the request does not match its CATCOLUMN "
+          "input.");
+
+      const size_t key_byte_size = (end - begin) * key_size;
+      HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+          cat_offset + key_byte_size > cat_buf_size, INVALID_ARG,
+          "The categorical features of samples ", first, " to ", last,
+          " exceed the capacity of the CATCOLUMN buffer.");
+      std::memcpy(
+          cat_buf + cat_offset, &staged_cat_[(key_base + begin) * key_size],
+          key_byte_size);
+      cat_offset += key_byte_size;
+
+      const int64_t num_rows = batch_size * slots + 1;
+      for (int64_t i = 0; i < num_rows; ++i) {
+        micro_batch_row_[row_offset + i] = rows[first * slots + i] - begin;
+      }
+      row_offset += num_rows;
+      row_base += numofsamples * slots + 1;
+      key_base += table_end;
+    }
+    CK_CUDA_THROW_(cudaMemcpy(
+        row_ptr_buf->get_raw_ptr(), micro_batch_row_.data(),
+        row_offset * sizeof(int), cudaMemcpyHostToDevice));
+    staged_host_row_ = micro_batch_row_.data();
+    staged_host_row_count_ = row_offset;
+
+    if (predict_into_output) {
+      RETURN_IF_ERROR(ProcessRequest(
+          batch_size, reinterpret_cast<float*>(output_buffer) +
+                          first * model_state_->LabelDim()));
+    } else {
+      RETURN_IF_ERROR(ProcessRequest(batch_size));
+      RETURN_IF_ERROR(CopyPredictions(
+          batch_size, output_buffer, first, output_memory_type));
+    }
+  }
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::ProcessRequestWithCache(
+    const int64_t numofsamples, void* output_buffer,
+    const TRITONSERVER_MemoryType output_memory_type)
+{
+  PredictionCache& cache = *model_state_->ResultCache();
+  const size_t value_size = cache.value_byte_size();
+  // Predictions are only cached if the embeddings are not refreshed while
+  // they are computed.
+  const uint64_t generation = cache.generation();
+  uint64_t now_ns = 0;
+  SET_TIMESTAMP(now_ns);
+
+  RETURN_IF_ERROR(HashStagedSamples(numofsamples));
+  cached_output_.resize(numofsamples * value_size);
+  missed_samples_.clear();
+  for (int64_t i = 0; i < numofsamples; ++i) {
+    if (!cache.find(
+            sample_hashes_[i], now_ns, &cached_output_[i * value_size])) {
+      missed_samples_.emplace_back(i);
+    }
+  }
+  const int64_t num_misses = missed_samples_.size();
+  model_state_->RecordCacheLookups(numofsamples - num_misses, num_misses);
+
+  if (num_misses != 0) {
+    if (num_misses != numofsamples) {
+      SelectStagedSamples(numofsamples);
+    }
+    missed_output_.resize(num_misses * value_size);
+    RETURN_IF_ERROR(ProcessRequestInMicroBatches(
+        num_misses, missed_output_.data(), TRITONSERVER_MEMORY_CPU, 0));
+    for (int64_t i = 0; i < num_misses; ++i) {
+      const uint8_t* const value = &missed_output_[i * value_size];
+      const int64_t sample = missed_samples_[i];
+      std::memcpy(&cached_output_[sample * value_size], value, value_size);
+      cache.insert(sample_hashes_[sample], now_ns, generation, value);
+    }
+  }
+
+  if (output_memory_type == TRITONSERVER_MEMORY_GPU) {
+    CK_CUDA_THROW_(cudaMemcpy(
+        output_buffer, cached_output_.data(), cached_output_.size(),
+        cudaMemcpyHostToDevice));
+  } else {
+    std::memcpy(output_buffer, cached_output_.data(), cached_output_.size());
+  }
+  return nullptr;
+}
+
+// Copy host data into an output, wherever Triton places it.
+static TRITONSERVER_Error*
+CopyToOutput(
+    TRITONBACKEND_Output* output, const void* src, const size_t byte_size)
+{
+  void* buffer;
+  TRITONSERVER_MemoryType memory_type = TRITONSERVER_MEMORY_CPU;
+  int64_t memory_type_id = 0;
+  RETURN_IF_ERROR(TRITONBACKEND_OutputBuffer(
+      output, &buffer, byte_size, &memory_type, &memory_type_id));
+  if (memory_type == TRITONSERVER_MEMORY_GPU) {
+    CK_CUDA_THROW_(
+        cudaMemcpy(buffer, src, byte_size, cudaMemcpyHostToDevice));
+  } else {
+    std::memcpy(buffer, src, byte_size);
+  }
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::RespondTopK(
+    TRITONBACKEND_Response* response, const int64_t numofsamples,
+    const void* predictions,
+    const TRITONSERVER_MemoryType predictions_memory_type,
+    const bool index_requested, const bool score_requested)
+{
+  const TRITONSERVER_DataType datatype = model_state_->OutputDataType();
+  const size_t score_size = TRITONSERVER_DataTypeByteSize(datatype);
+  const int64_t label_dim = model_state_->LabelDim();
+  const int64_t num_values = numofsamples * label_dim;
+  const int64_t k = std::min(model_state_->TopK(), numofsamples);
+
+  // Bring the predictions to the host, and widen them for comparison.
+  const uint8_t* raw = static_cast<const uint8_t*>(predictions);
+  if (predictions_memory_type == TRITONSERVER_MEMORY_GPU) {
+    topk_raw_.resize(num_values * score_size);
+    CK_CUDA_THROW_(cudaMemcpy(
+        topk_raw_.data(), predictions, topk_raw_.size(),
+        cudaMemcpyDeviceToHost));
+    raw = topk_raw_.data();
+  }
+  const float* scores = reinterpret_cast<const float*>(raw);
+  if (datatype == TRITONSERVER_TYPE_FP16) {
+    topk_scores_.resize(num_values);
+    ConvertHalfToFloat(
+        reinterpret_cast<const uint16_t*>(raw), topk_scores_.data(),
+        num_values);
+    scores = topk_scores_.data();
+  }
+
+  SelectTopK(scores, numofsamples, label_dim, k, &topk_order_);
+
+  if (index_requested) {
+    TRITONBACKEND_Output* output;
+    RETURN_IF_ERROR(TRITONBACKEND_ResponseOutput(
+        response, &output, kTopKIndexOutput, TRITONSERVER_TYPE_INT64, &k, 1));
+    RETURN_IF_ERROR(
+        CopyToOutput(output, topk_order_.data(), k * sizeof(int64_t)));
+  }
+  if (score_requested) {
+    // The scores are returned bit for bit as predicted.
+    topk_selected_.resize(k * score_size);
+    for (int64_t i = 0; i < k; ++i) {
+      std::memcpy(
+          &topk_selected_[i * score_size],
+          raw + topk_order_[i] * label_dim * score_size, score_size);
+    }
+    TRITONBACKEND_Output* output;
+    RETURN_IF_ERROR(TRITONBACKEND_ResponseOutput(
+        response, &output, kTopKScoreOutput, datatype, &k, 1));
+    RETURN_IF_ERROR(
+        CopyToOutput(output, topk_selected_.data(), topk_selected_.size()));
+  }
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::HashStagedSamples(const int64_t numofsamples)
+{
+  const std::vector<int64_t>& slots_per_table =
+      model_state_->SlotNumPerTable();
+  const int64_t des_num = model_state_->DeseNum();
+  const size_t key_size = model_state_->SupportLongEmbeddingKey()
+                              ? sizeof(long long)
+                              : sizeof(unsigned int);
+  const size_t num_keys = staged_cat_.size() / key_size;
+  HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+      staged_des_.size() < static_cast<size_t>(numofsamples * des_num),
+      INVALID_ARG, "The DES input holds ", staged_des_.size(),
+      " dense features, expected ", numofsamples * des_num, ".");
+
+  // A sample is identified by its dense features, and by the number of keys
+  // of each of its slots along with the keys themselves.
+  sample_hashes_.resize(numofsamples);
+  for (int64_t i = 0; i < numofsamples; ++i) {
+    sample_hashes_[i] =
+        XXHash64(&staged_des_[i * des_num], des_num * sizeof(float));
+  }
+  size_t row_base = 0;
+  size_t key_base = 0;
+  for (const int64_t slots : slots_per_table) {
+    const size_t num_rows = numofsamples * slots + 1;
+    HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+        row_base + num_rows > staged_row_.size(), INVALID_ARG,
+        "The ROWINDEX input holds ", staged_row_.size(),
+        " row offsets, expected ", row_base + num_rows, " or more.");
+    const int* const rows = &staged_row_[row_base];
+    const int table_end = rows[num_rows - 1];
+    HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+        rows[0] < 0 || key_base + table_end > num_keys, INVALID_ARG,
+        "The ROWINDEX input of the request does not match its CATCOLUMN "
+        "input.");
+    for (int64_t i = 0; i < numofsamples; ++i) {
+      const int* const sample_rows = rows + i * slots;
+      uint64_t h = sample_hashes_[i];
+      for (int64_t j = 0; j < slots; ++j) {
+        HCTR_RETURN_TRITION_ERROR_IF_TRUE(
+            sample_rows[j] > sample_rows[j + 1], INVALID_ARG,
+            "The ROWINDEX input is invalid at row ",
+            row_base + i * slots + j, ".");
+        h = XXH64MergeRound(h, sample_rows[j + 1] - sample_rows[j]);
+      }
+      sample_hashes_[i] = XXHash64(
+          &staged_cat_[(key_base + sample_rows[0]) * key_size],
+          (sample_rows[slots] - sample_rows[0]) * key_size, h);
+    }
+    row_base += num_rows;
+    key_base += table_end;
+  }
+  return nullptr;
+}
+
+void
+ModelInstanceState::SelectStagedSamples(const int64_t numofsamples)
+{
+  const std::vector<int64_t>& slots_per_table =
+      model_state_->SlotNumPerTable();
+  const int64_t des_num = model_state_->DeseNum();
+  const size_t key_size = model_state_->SupportLongEmbeddingKey()
+                              ? sizeof(long long)
+                              : sizeof(unsigned int);
+
+  compact_des_.resize(missed_samples_.size() * des_num);
+  for (size_t i = 0; i < missed_samples_.size(); ++i) {
+    std::copy_n(
+        &staged_des_[missed_samples_[i] * des_num], des_num,
+        &compact_des_[i * des_num]);
+  }
+
+  // The rows of each table are rebased onto the keys of the selected
+  // samples. HashStagedSamples() has validated them.
+  compact_cat_.clear();
+  compact_row_.clear();
+  size_t row_base = 0;
+  size_t key_base = 0;
+  for (const int64_t slots : slots_per_table) {
+    const int* const rows = &staged_row_[row_base];
+    compact_row_.emplace_back(0);
+    for (const int64_t sample : missed_samples_) {
+      const int* const sample_rows = rows + sample * slots;
+      const char* const keys =
+          &staged_cat_[(key_base + sample_rows[0]) * key_size];
+      compact_cat_.insert(
+          compact_cat_.end(), keys,
+          keys + (sample_rows[slots] - sample_rows[0]) * key_size);
+      const int offset = compact_row_.back() - sample_rows[0];
+      for (int64_t j = 1; j <= slots; ++j) {
+        compact_row_.emplace_back(sample_rows[j] + offset);
+      }
+    }
+    row_base += numofsamples * slots + 1;
+    key_base += rows[numofsamples * slots];
+  }
+
+  staged_des_.swap(compact_des_);
+  staged_cat_.swap(compact_cat_);
+  staged_row_.swap(compact_row_);
+}
+
 
 /////////////
 
@@ -1929,6 +3883,11 @@ TRITONBACKEND_ModelInitialize(TRITONBACKEND_Model* model)
   // model from loading.
   RETURN_IF_ERROR(model_state->Create_EmbeddingCache());
 
+  // The prediction cache of a model version starts out empty, so that a new
+  // version never serves the predictions of its predecessor.
+  RETURN_IF_ERROR(model_state->CreatePredictionCache());
+  model_state->CreateMetrics(backend_state);
+
   return nullptr;  // success
 }
 
@@ -2062,7 +4021,10 @@ TRITONBACKEND_ModelInstanceExecute(
   // if/when an error response is sent the corresponding entry in
   // 'responses' is set to nullptr to indicate that that response has
   // already been sent.
-  std::vector<TRITONBACKEND_Response*> responses;
+  // The vector is owned by the instance so that it is only reallocated when
+  // a larger batch of requests comes in.
+  std::vector<TRITONBACKEND_Response*>& responses = instance_state->Responses();
+  responses.clear();
   responses.reserve(request_count);
   // Create a single response object for each request. If something
   // goes wrong when attempting to create the response objects just
@@ -2075,10 +4037,13 @@ TRITONBACKEND_ModelInstanceExecute(
 
   // HugeCTR model can't support concurrent prediction for all the requests,
   // which means you would execute all the requests at the same time,
-  // So here we execute each request separately so there is no single range.
-  // As a result we just show the entire execution time as being the compute
-  // time as well.
+  // So here we execute each request separately. For each request we record
+  // when execution starts, when the inputs have been staged and prediction
+  // starts, when prediction ends and output copy starts, and when the
+  // response has been sent. The batch statistics span all requests.
   uint64_t min_exec_start_ns = std::numeric_limits<uint64_t>::max();
+  uint64_t min_compute_start_ns = std::numeric_limits<uint64_t>::max();
+  uint64_t max_compute_end_ns = 0;
   uint64_t max_exec_end_ns = 0;
   uint64_t total_batch_size = 0;
 
@@ -2089,6 +4054,10 @@ TRITONBACKEND_ModelInstanceExecute(
 
   for (uint32_t r = 0; r < request_count; ++r) {
     uint64_t exec_start_ns = 0;
+    SET_TIMESTAMP(exec_start_ns);
+    min_exec_start_ns = std::min(min_exec_start_ns, exec_start_ns);
+    uint64_t compute_start_ns = 0;
+    uint64_t compute_end_ns = 0;
 
     TRITONBACKEND_Request* request = requests[r];
     const char* request_id = "";
@@ -2176,16 +4145,28 @@ TRITONBACKEND_ModelInstanceExecute(
         responses, r,
         TRITONBACKEND_RequestInput(request, row_input_name, &row_input));
 
-    // We also validated that the model configuration specifies only a
-    // single output, but the request is not required to request any
-    // output at all so we only produce an output if requested.
+    // The request may ask for the prediction output, the top-K outputs, any
+    // combination of them or no output at all, so we only produce the
+    // outputs that are requested.
     const char* requested_output_name = nullptr;
-    if (requested_output_count > 0) {
+    bool topk_index_requested = false;
+    bool topk_score_requested = false;
+    for (uint32_t i = 0; i < requested_output_count; ++i) {
+      const char* name = nullptr;
       GUARDED_RESPOND_IF_ERROR(
-          responses, r,
-          TRITONBACKEND_RequestOutputName(
-              request, 0 /* index */, &requested_output_name));
+          responses, r, TRITONBACKEND_RequestOutputName(request, i, &name));
+      if (responses[r] == nullptr) {
+        break;
+      }
+      if (std::strcmp(name, kTopKIndexOutput) == 0) {
+        topk_index_requested = true;
+      } else if (std::strcmp(name, kTopKScoreOutput) == 0) {
+        topk_score_requested = true;
+      } else {
+        requested_output_name = name;
+      }
     }
+    const bool predictions_requested = requested_output_name != nullptr;
 
     // If an error response was sent while getting the input or
     // requested output name then display an error message and move on
@@ -2272,7 +4253,13 @@ TRITONBACKEND_ModelInstanceExecute(
       continue;
     }
 
-    HCTR_TRITON_LOG(VERBOSE, "\trequested_output ", requested_output_name);
+    HCTR_TRITON_LOG(
+        VERBOSE, "\trequested_output ",
+        predictions_requested ? requested_output_name : "(none)",
+        topk_index_requested ? ", " : "",
+        topk_index_requested ? kTopKIndexOutput : "",
+        topk_score_requested ? ", " : "",
+        topk_score_requested ? kTopKScoreOutput : "");
 
     // If the model doesn't support batching with two-dimension tensor then each
     // request is necessarily batch-size 1. So the first dimension of the shape
@@ -2300,14 +4287,34 @@ TRITONBACKEND_ModelInstanceExecute(
       TRITONBACKEND_Response* response = responses[r];
 
       // Step 1. Input should have correct size...
-      TRITONBACKEND_Output* output;
-
-      numofdes = des_byte_size / sizeof(float);
-      numofcat = row_byte_size / sizeof(int);
-
-
-      if (instance_state->StateForModel()->DeseNum() != 0 &&
-          numofdes % instance_state->StateForModel()->DeseNum() != 0) {
+      TRITONBACKEND_Output* output = nullptr;
+
+      // Shared features are sent once per request, and do not count towards
+      // the number of samples.
+      const int64_t des_per_sample =
+          instance_state->StateForModel()->DeseNum() -
+          instance_state->StateForModel()->SharedDesNum();
+      const int64_t slots_per_sample =
+          instance_state->StateForModel()->SlotNum() -
+          instance_state->StateForModel()->SharedSlotNum();
+      numofdes = des_byte_size /
+                     TRITONSERVER_DataTypeByteSize(
+                         instance_state->StateForModel()->DesDataType()) -
+                 instance_state->StateForModel()->SharedDesNum();
+      numofcat = row_byte_size / sizeof(int) -
+                 instance_state->StateForModel()->SharedSlotNum();
+
+      if (numofdes < 0 ||
+          numofcat < static_cast<int64_t>(
+                         instance_state->EmbeddingTableCount())) {
+        GUARDED_RESPOND_IF_ERROR(
+            responses, r,
+            TRITONSERVER_ErrorNew(
+                TRITONSERVER_ERROR_INVALID_ARG,
+                "The DES or ROWINDEX input in request is smaller than the "
+                "shared features configured for the model."));
+      }
+      if (des_per_sample != 0 && numofdes % des_per_sample != 0) {
         GUARDED_RESPOND_IF_ERROR(
             responses, r,
             TRITONSERVER_ErrorNew(
@@ -2317,7 +4324,7 @@ TRITONBACKEND_ModelInstanceExecute(
                 "multiple of the configuration."));
       }
       if ((numofcat - instance_state->EmbeddingTableCount()) %
-              instance_state->StateForModel()->SlotNum() !=
+              slots_per_sample !=
           0) {
         GUARDED_RESPOND_IF_ERROR(
             responses, r,
@@ -2327,17 +4334,15 @@ TRITONBACKEND_ModelInstanceExecute(
                 "configuration. The input sample size to be an integer "
                 "multiple of the configuration."));
       }
-      if (instance_state->StateForModel()->DeseNum() != 0) {
-        num_of_sample_des =
-            floor(numofdes / instance_state->StateForModel()->DeseNum());
+      if (des_per_sample != 0) {
+        num_of_sample_des = floor(numofdes / des_per_sample);
       }
 
       num_of_sample_cat = floor(
           (numofcat - instance_state->EmbeddingTableCount()) /
-          instance_state->StateForModel()->SlotNum());
+          slots_per_sample);
 
-      if (instance_state->StateForModel()->DeseNum() != 0 &&
-          num_of_sample_des != num_of_sample_cat) {
+      if (des_per_sample != 0 && num_of_sample_des != num_of_sample_cat) {
         GUARDED_RESPOND_IF_ERROR(
             responses, r,
             TRITONSERVER_ErrorNew(
@@ -2345,129 +4350,225 @@ TRITONBACKEND_ModelInstanceExecute(
                 "The input sample size in DES and CATCOLUMN is not match"));
       }
       num_of_samples = num_of_sample_cat;
-      if (num_of_samples > instance_state->StateForModel()->BatchSize()) {
+      if (responses[r] != nullptr &&
+          instance_state->StateForModel()->DeadlineShedding()) {
         GUARDED_RESPOND_IF_ERROR(
             responses, r,
-            TRITONSERVER_ErrorNew(
-                TRITONSERVER_ERROR_UNSUPPORTED,
-                "The number of Input sample greater than max batch size"));
+            instance_state->AdmitRequest(
+                request, min_exec_start_ns, num_of_samples));
+        if (responses[r] == nullptr) {
+          HCTR_TRITON_LOG(
+              VERBOSE, "request ", r, ": shed, error response sent");
+          continue;
+        }
       }
-      int64_t* out_putshape = &num_of_samples;
-      GUARDED_RESPOND_IF_ERROR(
-          responses, r,
-          TRITONBACKEND_ResponseOutput(
-              response, &output, requested_output_name, des_datatype,
-              out_putshape, 1));
-      if (responses[r] == nullptr) {
-        HCTR_TRITON_LOG(
-            ERROR, "request ", r,
-            ": failed to create response output, error response sent");
-        continue;
+      // Requests with more samples than the max batch size are split into
+      // micro-batches, and the predictions are stitched together. Requests
+      // with shared features or raw categorical values are expanded or
+      // hashed on the host, and take the same path. So do requests that are
+      // looked up in the prediction cache.
+      const bool use_micro_batches =
+          num_of_samples > instance_state->StateForModel()->BatchSize() ||
+          instance_state->StateForModel()->SharedContext() ||
+          instance_state->StateForModel()->HashedCatKeys() ||
+          instance_state->StateForModel()->ResultCache() != nullptr;
+      const TRITONSERVER_DataType output_datatype =
+          instance_state->StateForModel()->OutputDataType();
+      const int64_t out_putshape[] = {
+          num_of_samples, instance_state->StateForModel()->LabelDim()};
+      const size_t output_byte_size =
+          num_of_samples * instance_state->StateForModel()->LabelDim() *
+          TRITONSERVER_DataTypeByteSize(output_datatype);
+      if (predictions_requested) {
+        GUARDED_RESPOND_IF_ERROR(
+            responses, r,
+            TRITONBACKEND_ResponseOutput(
+                response, &output, requested_output_name, output_datatype,
+                out_putshape, instance_state->StateForModel()->OutputRank()));
+        if (responses[r] == nullptr) {
+          HCTR_TRITON_LOG(
+              ERROR, "request ", r,
+              ": failed to create response output, error response sent");
+          continue;
+        }
       }
 
-      // Step 2. Initialize the output tensor.
+      // Step 2. Initialize the output tensor. Requests that only ask for the
+      // top-K outputs get their predictions in host memory.
       void* output_buffer;
       TRITONSERVER_MemoryType output_memory_type = TRITONSERVER_MEMORY_GPU;
       int64_t output_memory_type_id = 0;
-      GUARDED_RESPOND_IF_ERROR(
-          responses, r,
-          TRITONBACKEND_OutputBuffer(
-              output, &output_buffer, num_of_samples * sizeof(float),
-              &output_memory_type, &output_memory_type_id));
-      if (responses[r] == nullptr) {
+      if (predictions_requested) {
         GUARDED_RESPOND_IF_ERROR(
             responses, r,
-            TRITONSERVER_ErrorNew(
-                TRITONSERVER_ERROR_UNSUPPORTED,
-                "failed to create output buffer in GPU memory"));
-        HCTR_TRITON_LOG(
-            ERROR, "request ", r,
-            ": failed to create output buffer in CPU memory, error response "
-            "sent");
-        continue;
+            TRITONBACKEND_OutputBuffer(
+                output, &output_buffer, output_byte_size, &output_memory_type,
+                &output_memory_type_id));
+        if (responses[r] == nullptr) {
+          GUARDED_RESPOND_IF_ERROR(
+              responses, r,
+              TRITONSERVER_ErrorNew(
+                  TRITONSERVER_ERROR_UNSUPPORTED,
+                  "failed to create output buffer in GPU memory"));
+          HCTR_TRITON_LOG(
+              ERROR, "request ", r,
+              ": failed to create output buffer in CPU memory, error response "
+              "sent");
+          continue;
+        }
+      } else {
+        output_buffer = instance_state->HostPredictionBuffer(output_byte_size);
+        output_memory_type = TRITONSERVER_MEMORY_CPU;
       }
-      // Step 3. Copy all input data -> Device Buffer.
-      size_t output_buffer_offset = 0;
-      for (uint32_t b = 0; b < cat_input_buffer_count; ++b) {
-        const void* des_buffer = nullptr;
-        uint64_t buffer_byte_size = des_byte_size;
-        TRITONSERVER_MemoryType input_memory_type = TRITONSERVER_MEMORY_GPU;
-        int64_t input_memory_type_id = 0;
+      // Step 3. Gather all input data -> Device Buffer. Triton may deliver
+      // each input tensor in several chunks, which are assembled back to back
+      // before a single prediction is executed for the whole request.
+      // Oversized requests are staged in host memory instead, from where the
+      // micro-batches are cut out.
+      if (use_micro_batches) {
         GUARDED_RESPOND_IF_ERROR(
             responses, r,
-            TRITONBACKEND_InputBuffer(
-                des_input, b, &des_buffer, &buffer_byte_size,
-                &input_memory_type, &input_memory_type_id));
-        CK_CUDA_THROW_(cudaMemcpy(
-            instance_state->GetDeseBuffer()->get_raw_ptr(), des_buffer,
-            des_byte_size, cudaMemcpyHostToDevice));
-
-        const void* cat_buffer = nullptr;
+            instance_state->StageOversizedRequest(
+                des_input, des_input_buffer_count, des_byte_size,
+                catcol_input, cat_input_buffer_count, cat_byte_size, row_input,
+                rowindex_input_buffer_count, row_byte_size));
+        if (instance_state->StateForModel()->HashedCatKeys()) {
+          GUARDED_RESPOND_IF_ERROR(
+              responses, r, instance_state->HashRawKeys(num_of_samples));
+        }
+        if (instance_state->StateForModel()->SharedContext()) {
+          GUARDED_RESPOND_IF_ERROR(
+              responses, r,
+              instance_state->BroadcastSharedContext(num_of_samples));
+        }
+        if (instance_state->StateForModel()->StrictInputValidation()) {
+          GUARDED_RESPOND_IF_ERROR(
+              responses, r,
+              instance_state->ValidateStagedRequest(num_of_samples));
+        }
+      } else {
+        size_t des_gathered_byte_size = 0;
         GUARDED_RESPOND_IF_ERROR(
             responses, r,
-            TRITONBACKEND_InputBuffer(
-                catcol_input, b, &cat_buffer, &cat_byte_size,
-                &input_memory_type, &input_memory_type_id));
-        if (instance_state->StateForModel()->SupportLongEmbeddingKey()) {
-          CK_CUDA_THROW_(cudaMemcpy(
-              instance_state->GetCatColBuffer_int64()->get_raw_ptr(),
-              cat_buffer, cat_byte_size, cudaMemcpyHostToHost));
-        } else {
-          CK_CUDA_THROW_(cudaMemcpy(
-              instance_state->GetCatColBuffer_int32()->get_raw_ptr(),
-              cat_buffer, cat_byte_size, cudaMemcpyHostToHost));
-        }
-
-        const void* row_buffer = nullptr;
+            instance_state->GatherDenseFeatures(
+                des_input, des_input_buffer_count, des_byte_size,
+                instance_state->GetDeseBuffer()->get_ptr(), MemoryType_t::GPU,
+                instance_state->GetDeseBuffer()->get_buffer_size(),
+                &des_gathered_byte_size));
+
+        size_t cat_gathered_byte_size = 0;
+        size_t num_keys = 0;
         GUARDED_RESPOND_IF_ERROR(
             responses, r,
-            TRITONBACKEND_InputBuffer(
-                row_input, b, &row_buffer, &row_byte_size, &input_memory_type,
-                &input_memory_type_id));
-        CK_CUDA_THROW_(cudaMemcpy(
-            instance_state->GetRowBuffer()->get_raw_ptr(), row_buffer,
-            row_byte_size, cudaMemcpyHostToDevice));
+            instance_state->GatherCategoricalKeys(
+                catcol_input, cat_input_buffer_count, cat_byte_size,
+                &cat_gathered_byte_size, &num_keys));
 
-
-        if (responses[r] == nullptr) {
+        size_t row_gathered_byte_size = 0;
+        GUARDED_RESPOND_IF_ERROR(
+            responses, r,
+            instance_state->GatherRowIndex(
+                row_input, rowindex_input_buffer_count, num_of_samples,
+                num_keys, &row_gathered_byte_size));
+
+        if (responses[r] != nullptr &&
+            (des_gathered_byte_size != des_byte_size ||
+             cat_gathered_byte_size != cat_byte_size ||
+             row_gathered_byte_size != row_byte_size)) {
           GUARDED_RESPOND_IF_ERROR(
               responses, r,
-              TRITONSERVER_ErrorNew(
-                  TRITONSERVER_ERROR_UNSUPPORTED,
-                  "failed to get input buffer in GPU memory"));
+              HCTR_TRITON_ERROR(
+                  INVALID_ARG,
+                  "The gathered input size does not match the input "
+                  "properties (DES: ",
+                  des_gathered_byte_size, "/", des_byte_size,
+                  " bytes, CATCOLUMN: ", cat_gathered_byte_size, "/",
+                  cat_byte_size, " bytes, ROWINDEX: ", row_gathered_byte_size,
+                  "/", row_byte_size, " bytes)."));
         }
-        // Step 4. Perform prediction in device and copy result to cpu output
-        // buffer
-        HCTR_TRITON_LOG(
-            VERBOSE, "*****Processing request on device***** ",
-            instance_state->DeviceId(), " for model ", instance_state->Name());
-        // Set Timestamp here to compute the prediction execution time for each
-        // request
-        SET_TIMESTAMP(exec_start_ns);
-        min_exec_start_ns = std::min(min_exec_start_ns, exec_start_ns);
-        // Model prediction
-        RETURN_IF_ERROR(instance_state->ProcessRequest(num_of_samples));
-        HCTR_TRITON_LOG(VERBOSE, "******Processing request completed!******");
-        output_buffer_offset += buffer_byte_size;
-        CK_CUDA_THROW_(cudaMemcpy(
-            output_buffer, instance_state->GetPredictBuffer()->get_raw_ptr(),
-            num_of_samples * sizeof(float), cudaMemcpyDeviceToHost));
-
-        uint64_t exec_end_ns = 0;
-        SET_TIMESTAMP(exec_end_ns);
-        max_exec_end_ns = std::max(max_exec_end_ns, exec_end_ns);
-        // Get the prediction execution time (ms)
-        int64_t exe_time = (max_exec_end_ns - min_exec_start_ns) / 1000000;
-        HCTR_TRITON_LOG(
-            VERBOSE, "Prediction execution time is ", exe_time, " ms");
       }
-
       if (responses[r] == nullptr) {
         HCTR_TRITON_LOG(
             ERROR, "request ", r,
-            ": failed to get input buffer in CPU memory, error response sent");
+            ": failed to gather input buffers, error response sent");
         continue;
       }
+
+      // Step 4. Perform prediction in device and copy result to cpu output
+      // buffer
+      HCTR_TRITON_LOG(
+          VERBOSE, "*****Processing request on device***** ",
+          instance_state->DeviceId(), " for model ", instance_state->Name());
+      // Set Timestamp here to compute the prediction execution time for each
+      // request
+      SET_TIMESTAMP(compute_start_ns);
+      // Model prediction. Micro-batches interleave prediction and output
+      // copies, so the output phase of such requests is accounted as compute.
+      if (instance_state->StateForModel()->ResultCache() != nullptr) {
+        GUARDED_RESPOND_IF_ERROR(
+            responses, r,
+            instance_state->ProcessRequestWithCache(
+                num_of_samples, output_buffer, output_memory_type));
+        if (responses[r] == nullptr) {
+          HCTR_TRITON_LOG(
+              ERROR, "request ", r,
+              ": failed to process request, error response sent");
+          continue;
+        }
+        SET_TIMESTAMP(compute_end_ns);
+      } else if (use_micro_batches) {
+        GUARDED_RESPOND_IF_ERROR(
+            responses, r,
+            instance_state->ProcessRequestInMicroBatches(
+                num_of_samples, output_buffer, output_memory_type,
+                output_memory_type_id));
+        if (responses[r] == nullptr) {
+          HCTR_TRITON_LOG(
+              ERROR, "request ", r,
+              ": failed to process micro-batches, error response sent");
+          continue;
+        }
+        SET_TIMESTAMP(compute_end_ns);
+      } else if (instance_state->CanPredictInto(
+                     output_memory_type, output_memory_type_id)) {
+        // Triton handed out device memory of this instance, so predict
+        // straight into it and skip the copy.
+        RETURN_IF_ERROR(instance_state->ProcessRequest(
+            num_of_samples, reinterpret_cast<float*>(output_buffer)));
+        SET_TIMESTAMP(compute_end_ns);
+      } else {
+        RETURN_IF_ERROR(instance_state->ProcessRequest(num_of_samples));
+        SET_TIMESTAMP(compute_end_ns);
+        GUARDED_RESPOND_IF_ERROR(
+            responses, r,
+            instance_state->CopyPredictions(
+                num_of_samples, output_buffer, 0, output_memory_type));
+        if (responses[r] == nullptr) {
+          HCTR_TRITON_LOG(
+              ERROR, "request ", r,
+              ": failed to copy predictions, error response sent");
+          continue;
+        }
+      }
+      if (topk_index_requested || topk_score_requested) {
+        GUARDED_RESPOND_IF_ERROR(
+            responses, r,
+            instance_state->RespondTopK(
+                response, num_of_samples, output_buffer, output_memory_type,
+                topk_index_requested, topk_score_requested));
+        if (responses[r] == nullptr) {
+          HCTR_TRITON_LOG(
+              ERROR, "request ", r,
+              ": failed to create top-K outputs, error response sent");
+          continue;
+        }
+      }
+      HCTR_TRITON_LOG(VERBOSE, "******Processing request completed!******");
+
+      // Get the prediction execution time (ms)
+      int64_t exe_time = (compute_end_ns - compute_start_ns) / 1000000;
+      HCTR_TRITON_LOG(
+          VERBOSE, "Prediction execution time is ", exe_time, " ms");
     }
 
     // Response parameters we attach some here. mak
@@ -2498,13 +4599,23 @@ TRITONBACKEND_ModelInstanceExecute(
     SET_TIMESTAMP(exec_end_ns);
     max_exec_end_ns = std::max(max_exec_end_ns, exec_end_ns);
 
+    // Requests without requested output skip the compute phases.
+    if (compute_start_ns == 0) {
+      compute_start_ns = compute_end_ns = exec_start_ns;
+    }
+    min_compute_start_ns = std::min(min_compute_start_ns, compute_start_ns);
+    max_compute_end_ns = std::max(max_compute_end_ns, compute_end_ns);
+    instance_state->RecordPhaseLatencies(
+        exec_start_ns, compute_start_ns, compute_end_ns, exec_end_ns,
+        num_of_samples);
+
     // Report statistics for the successful request. For an instance
     // using the CPU we don't associate any device with the
     // statistics, otherwise we associate the instance's device.
     LOG_IF_ERROR(
         TRITONBACKEND_ModelInstanceReportStatistics(
             instance_state->TritonModelInstance(), request, true /* success */,
-            exec_start_ns, exec_start_ns, exec_end_ns, exec_end_ns),
+            exec_start_ns, compute_start_ns, compute_end_ns, exec_end_ns),
         "failed reporting request statistics");
   }
 
@@ -2520,7 +4631,7 @@ TRITONBACKEND_ModelInstanceExecute(
   LOG_IF_ERROR(
       TRITONBACKEND_ModelInstanceReportBatchStatistics(
           instance_state->TritonModelInstance(), total_batch_size,
-          min_exec_start_ns, min_exec_start_ns, max_exec_end_ns,
+          min_exec_start_ns, min_compute_start_ns, max_compute_end_ns,
           max_exec_end_ns),
       "failed reporting batch request statistics");
 
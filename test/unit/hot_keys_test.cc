@@ -0,0 +1,137 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//
+// Checks of reading and writing hot key files for the embedding cache
+// warm-up.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <hot_keys.hpp>
+#include <string>
+#include <unit_test.hpp>
+#include <vector>
+
+using triton::backend::hugectr::HotKey;
+using triton::backend::hugectr::ReadHotKeys;
+using triton::backend::hugectr::WriteHotKeys;
+
+namespace {
+
+// A file in the temporary directory holding 'contents'.
+std::string
+WriteFile(const std::string& name, const std::string& contents)
+{
+  const char* const tmp_dir = std::getenv("TMPDIR");
+  const std::string path =
+      std::string(tmp_dir != nullptr ? tmp_dir : "/tmp") + "/" + name;
+  std::ofstream(path) << contents;
+  return path;
+}
+
+void
+TestOrderAndLimit()
+{
+  const std::string path = WriteFile(
+      "hot_keys_test_order.txt",
+      "# <table> <key> <count>\n"
+      "\n"
+      "0 10 5\n"
+      "0 11\n"
+      "  # indented comment\n"
+      "0 12 7\n"
+      "1 20 1\n"
+      "0 13 5\n"
+      "0 12 3\n"
+      "1 21 2\n");
+  std::vector<std::vector<long long>> hot_keys;
+  std::string error;
+  EXPECT_TRUE(ReadHotKeys(path, 2, 0, &hot_keys, &error));
+  EXPECT_EQ(hot_keys.size(), size_t{2});
+  EXPECT_TRUE((hot_keys[0] == std::vector<long long>{12, 10, 13, 11}));
+  EXPECT_TRUE((hot_keys[1] == std::vector<long long>{21, 20}));
+
+  EXPECT_TRUE(ReadHotKeys(path, 2, 2, &hot_keys, &error));
+  EXPECT_TRUE((hot_keys[0] == std::vector<long long>{12, 10}));
+  EXPECT_TRUE((hot_keys[1] == std::vector<long long>{21, 20}));
+
+  // Tables without hot keys are empty.
+  EXPECT_TRUE(ReadHotKeys(path, 3, 0, &hot_keys, &error));
+  EXPECT_TRUE(hot_keys[2].empty());
+  std::remove(path.c_str());
+}
+
+void
+TestMalformedFiles()
+{
+  std::vector<std::vector<long long>> hot_keys;
+  std::string error;
+  for (const char* contents :
+       {"2 10 1\n", "-1 10 1\n", "0 x 1\n", "0 10 1 extra\n", "zero 10\n",
+        "0\n"}) {
+    const std::string path = WriteFile("hot_keys_test_malformed.txt", contents);
+    error.clear();
+    EXPECT_TRUE(!ReadHotKeys(path, 2, 0, &hot_keys, &error));
+    EXPECT_TRUE(error.find("line 1") != std::string::npos);
+    std::remove(path.c_str());
+  }
+
+  EXPECT_TRUE(!ReadHotKeys(
+      "/nonexistent/hot_keys.txt", 1, 0, &hot_keys, &error));
+  EXPECT_TRUE(error.find("failed to open") != std::string::npos);
+}
+
+void
+TestRoundTrip()
+{
+  const std::string path = WriteFile("hot_keys_test_round_trip.txt", "");
+  const std::vector<std::vector<HotKey>> written = {
+      {{-5, 9}, {7, 4}, {1LL << 40, 4}}, {}, {{3, 0}}};
+  std::string error;
+  EXPECT_TRUE(WriteHotKeys(path, written, &error));
+
+  std::vector<std::vector<long long>> hot_keys;
+  EXPECT_TRUE(ReadHotKeys(path, 3, 0, &hot_keys, &error));
+  EXPECT_TRUE((hot_keys[0] == std::vector<long long>{-5, 7, 1LL << 40}));
+  EXPECT_TRUE(hot_keys[1].empty());
+  EXPECT_TRUE((hot_keys[2] == std::vector<long long>{3}));
+  std::remove(path.c_str());
+
+  EXPECT_TRUE(!WriteHotKeys("/nonexistent/hot_keys.txt", written, &error));
+}
+
+}  // namespace
+
+int
+main()
+{
+  TestOrderAndLimit();
+  TestMalformedFiles();
+  TestRoundTrip();
+  return UNIT_TEST_RESULT();
+}
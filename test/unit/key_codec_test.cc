@@ -0,0 +1,203 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//
+// Checks of the bit-packed CATCOLUMN decoding. Every width is decoded into
+// 64 and 32 bit keys and compared with the keys it was encoded from, in
+// blocks long enough for the AVX2 paths and with the short tails the scalar
+// loops handle.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <key_codec.hpp>
+#include <limits>
+#include <random>
+#include <unit_test.hpp>
+#include <vector>
+
+using triton::backend::hugectr::CountBitpackedKeys;
+using triton::backend::hugectr::DecodeBitpackedKeys;
+using triton::backend::hugectr::kBitpackedBlockHeaderSize;
+using triton::backend::hugectr::kBitpackedMaxBlockKeys;
+
+namespace {
+
+// Append a block of 'width' bit keys relative to 'base'.
+void
+AppendBlock(
+    std::vector<uint8_t>* encoded, const std::vector<uint64_t>& keys,
+    const uint64_t base, const size_t width)
+{
+  const size_t header = encoded->size();
+  encoded->resize(
+      header + kBitpackedBlockHeaderSize + (keys.size() * width + 7) / 8);
+  (*encoded)[header] = static_cast<uint8_t>(keys.size() - 1);
+  (*encoded)[header + 1] = static_cast<uint8_t>(width);
+  std::memcpy(&(*encoded)[header + 2], &base, sizeof(base));
+  uint8_t* const packed = &(*encoded)[header + kBitpackedBlockHeaderSize];
+  for (size_t i = 0; i < keys.size(); ++i) {
+    const uint64_t delta = keys[i] - base;
+    for (size_t b = 0; b < width; ++b) {
+      if ((delta >> b) & 1) {
+        const size_t bit = i * width + b;
+        packed[bit >> 3] |= static_cast<uint8_t>(1u << (bit & 7));
+      }
+    }
+  }
+}
+
+// Random keys within 'width' bits of 'base'.
+std::vector<uint64_t>
+RandomKeys(
+    std::mt19937_64* rng, const size_t count, const uint64_t base,
+    const size_t width)
+{
+  const uint64_t mask = width == 64 ? ~uint64_t{0} : (uint64_t{1} << width) - 1;
+  std::vector<uint64_t> keys(count);
+  for (uint64_t& key : keys) {
+    key = base + ((*rng)() & mask);
+  }
+  return keys;
+}
+
+void
+TestDecodeEveryWidth()
+{
+  std::mt19937_64 rng(7);
+  for (size_t width = 0; width <= 64; ++width) {
+    for (const size_t count : {size_t{1}, size_t{7}, size_t{33},
+                               kBitpackedMaxBlockKeys}) {
+      // Keys of up to 32 bits that also fit into 32 bit keys, and keys far
+      // beyond that range.
+      const uint64_t mask =
+          width == 64 ? ~uint64_t{0} : (uint64_t{1} << width) - 1;
+      const uint64_t base32 =
+          width <= 32 ? std::numeric_limits<uint32_t>::max() - mask : 0;
+      const uint64_t base64 = width < 64 ? (uint64_t{5} << 60) >> width : 0;
+      for (const uint64_t base : {base32, base64}) {
+        const std::vector<uint64_t> keys = RandomKeys(&rng, count, base, width);
+        std::vector<uint8_t> encoded;
+        AppendBlock(&encoded, keys, base, width);
+        AppendBlock(&encoded, keys, base, width);
+
+        size_t num_keys = 0;
+        EXPECT_TRUE(
+            CountBitpackedKeys(encoded.data(), encoded.size(), &num_keys));
+        EXPECT_EQ(num_keys, 2 * count);
+
+        std::vector<uint64_t> keys64(2 * count);
+        EXPECT_TRUE(DecodeBitpackedKeys(
+            encoded.data(), encoded.size(), keys64.data(), keys64.size(),
+            &num_keys));
+        EXPECT_EQ(num_keys, 2 * count);
+        EXPECT_TRUE(std::equal(keys.begin(), keys.end(), keys64.begin()));
+        EXPECT_TRUE(
+            std::equal(keys.begin(), keys.end(), keys64.begin() + count));
+
+        const bool fits = *std::max_element(keys.begin(), keys.end()) <=
+                          std::numeric_limits<uint32_t>::max();
+        std::vector<uint32_t> keys32(2 * count);
+        EXPECT_EQ(
+            DecodeBitpackedKeys(
+                encoded.data(), encoded.size(), keys32.data(), keys32.size(),
+                &num_keys),
+            fits);
+        if (fits) {
+          EXPECT_TRUE(std::equal(keys.begin(), keys.end(), keys32.begin()));
+          EXPECT_TRUE(
+              std::equal(keys.begin(), keys.end(), keys32.begin() + count));
+        }
+      }
+    }
+  }
+}
+
+void
+TestKeyBeyond32Bits()
+{
+  // Only one key in the middle of the block exceeds 32 bits.
+  for (const size_t width : {size_t{12}, size_t{28}, size_t{32}}) {
+    const uint64_t base =
+        std::numeric_limits<uint32_t>::max() - ((uint64_t{1} << 11) - 1);
+    std::vector<uint64_t> keys(kBitpackedMaxBlockKeys, base);
+    keys[100] = base + ((uint64_t{1} << width) - 1);
+    std::vector<uint8_t> encoded;
+    AppendBlock(&encoded, keys, base, width);
+    std::vector<uint32_t> keys32(keys.size());
+    size_t num_keys = 0;
+    EXPECT_TRUE(!DecodeBitpackedKeys(
+        encoded.data(), encoded.size(), keys32.data(), keys32.size(),
+        &num_keys));
+  }
+}
+
+void
+TestMalformedStreams()
+{
+  std::mt19937_64 rng(11);
+  const std::vector<uint64_t> keys = RandomKeys(&rng, 40, 1000, 20);
+  std::vector<uint8_t> encoded;
+  AppendBlock(&encoded, keys, 1000, 20);
+  std::vector<uint64_t> decoded(keys.size());
+  size_t num_keys = 0;
+
+  // Truncated anywhere.
+  for (size_t size = 1; size < encoded.size(); ++size) {
+    EXPECT_TRUE(!CountBitpackedKeys(encoded.data(), size, &num_keys));
+    EXPECT_TRUE(!DecodeBitpackedKeys(
+        encoded.data(), size, decoded.data(), decoded.size(), &num_keys));
+  }
+
+  // Too little room for the keys.
+  EXPECT_TRUE(!DecodeBitpackedKeys(
+      encoded.data(), encoded.size(), decoded.data(), decoded.size() - 1,
+      &num_keys));
+
+  // Wider than 64 bits.
+  encoded[1] = 65;
+  EXPECT_TRUE(!CountBitpackedKeys(encoded.data(), encoded.size(), &num_keys));
+  EXPECT_TRUE(!DecodeBitpackedKeys(
+      encoded.data(), encoded.size(), decoded.data(), decoded.size(),
+      &num_keys));
+
+  // An empty stream holds no keys.
+  num_keys = 1;
+  EXPECT_TRUE(DecodeBitpackedKeys(
+      encoded.data(), 0, decoded.data(), decoded.size(), &num_keys));
+  EXPECT_EQ(num_keys, size_t{0});
+}
+
+}  // namespace
+
+int
+main()
+{
+  TestDecodeEveryWidth();
+  TestKeyBeyond32Bits();
+  TestMalformedStreams();
+  return UNIT_TEST_RESULT();
+}
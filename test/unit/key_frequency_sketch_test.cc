@@ -0,0 +1,156 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//
+// Checks of the key frequency sketch: estimates never fall below the true
+// counts until the sketch ages, the hottest keys of a skewed stream are
+// found, counters saturate and halve, and concurrent adds keep it usable.
+//
+
+#include <climits>
+#include <key_frequency_sketch.hpp>
+#include <thread>
+#include <unit_test.hpp>
+#include <vector>
+
+using triton::backend::hugectr::HotKey;
+using triton::backend::hugectr::KeyFrequencySketch;
+
+namespace {
+
+void
+TestEstimatesBoundCounts()
+{
+  // Key k is added k times, well below the number of adds that ages the
+  // sketch.
+  KeyFrequencySketch sketch(1 << 14, 8);
+  std::vector<long long> keys;
+  for (long long k = 1; k <= 100; ++k) {
+    keys.assign(k, k * 7919);
+    sketch.Add(keys.data(), keys.size());
+  }
+  size_t exact = 0;
+  for (long long k = 1; k <= 100; ++k) {
+    const uint32_t estimate = sketch.Estimate(k * 7919);
+    EXPECT_TRUE(estimate >= k);
+    exact += estimate == k;
+  }
+  // With 2^14 counters for 100 keys, collisions in all four rows are rare.
+  EXPECT_TRUE(exact >= 95);
+  EXPECT_EQ(sketch.Estimate(-1), uint32_t{0});
+}
+
+void
+TestHotKeys()
+{
+  // Keys 0 to 7 are looked up far more often than the 10000 others.
+  KeyFrequencySketch sketch(1 << 16, 8);
+  std::vector<long long> batch;
+  for (int round = 0; round < 50; ++round) {
+    batch.clear();
+    for (long long k = 0; k < 8; ++k) {
+      batch.insert(batch.end(), 20 - k, k);
+    }
+    for (long long k = 0; k < 200; ++k) {
+      batch.push_back(1000 + (round * 200 + k) % 10000);
+    }
+    sketch.Add(batch.data(), batch.size());
+  }
+
+  const std::vector<HotKey> hot_keys = sketch.HotKeys();
+  EXPECT_EQ(hot_keys.size(), size_t{8});
+  for (size_t i = 0; i < hot_keys.size(); ++i) {
+    EXPECT_TRUE(hot_keys[i].key >= 0 && hot_keys[i].key < 8);
+    if (i > 0) {
+      EXPECT_TRUE(hot_keys[i - 1].count >= hot_keys[i].count);
+      EXPECT_TRUE(hot_keys[i - 1].key != hot_keys[i].key);
+    }
+  }
+}
+
+void
+TestSaturationAndAging()
+{
+  // 32 counters age after 320 adds.
+  KeyFrequencySketch sketch(32, 1);
+  std::vector<long long> keys(300, 42);
+  sketch.Add(keys.data(), keys.size());
+  EXPECT_EQ(sketch.Estimate(42), uint32_t{300});
+  keys.assign(20, 42);
+  sketch.Add(keys.data(), keys.size());
+  EXPECT_EQ(sketch.Estimate(42), uint32_t{160});
+
+  // Counters stop at their maximum instead of wrapping around.
+  KeyFrequencySketch large(1 << 20, 1);
+  keys.assign(70000, 5);
+  large.Add(keys.data(), keys.size());
+  EXPECT_EQ(large.Estimate(5), uint32_t{UINT16_MAX});
+
+  // The marker of empty hot key slots is counted, but never a hot key.
+  const long long empty = LLONG_MIN;
+  large.Add(&empty, 1);
+  for (const HotKey& hot_key : large.HotKeys()) {
+    EXPECT_TRUE(hot_key.key != LLONG_MIN);
+  }
+}
+
+void
+TestConcurrentAdds()
+{
+  KeyFrequencySketch sketch(1 << 12, 4);
+  std::vector<std::thread> threads;
+  for (long long t = 0; t < 4; ++t) {
+    threads.emplace_back([&sketch, t]() {
+      std::vector<long long> keys;
+      for (int round = 0; round < 1000; ++round) {
+        keys.assign(8, 1);
+        keys.push_back(100 + t * 1000 + round);
+        sketch.Add(keys.data(), keys.size());
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  // Racing increments may be lost, but key 1 stays by far the hottest.
+  const std::vector<HotKey> hot_keys = sketch.HotKeys();
+  EXPECT_TRUE(!hot_keys.empty());
+  if (!hot_keys.empty()) {
+    EXPECT_EQ(hot_keys[0].key, 1LL);
+  }
+}
+
+}  // namespace
+
+int
+main()
+{
+  TestEstimatesBoundCounts();
+  TestHotKeys();
+  TestSaturationAndAging();
+  TestConcurrentAdds();
+  return UNIT_TEST_RESULT();
+}
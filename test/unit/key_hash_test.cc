@@ -0,0 +1,101 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//
+// Checks of the XXH64 implementation that hashes raw categorical values,
+// against reference digests and across the lengths that take the stripe,
+// 8 byte, 4 byte and single byte paths.
+//
+
+#include <cstring>
+#include <key_hash.hpp>
+#include <string>
+#include <unit_test.hpp>
+#include <vector>
+
+using triton::backend::hugectr::XXHash64;
+
+namespace {
+
+uint64_t
+Hash(const std::string& value, const uint64_t seed = 0)
+{
+  return XXHash64(value.data(), value.size(), seed);
+}
+
+void
+TestReferenceDigests()
+{
+  EXPECT_EQ(Hash(""), 0xEF46DB3751D8E999ULL);
+  EXPECT_EQ(Hash("a"), 0xD24EC4F1A98C6E5BULL);
+  EXPECT_EQ(Hash("abc"), 0x44BC2CF5AD770999ULL);
+  EXPECT_EQ(
+      Hash("Nobody inspects the spammish repetition"), 0xFBCEA83C8A378BF1ULL);
+}
+
+void
+TestAlignmentAndLength()
+{
+  // The same bytes hash alike wherever they are, and every length hashes
+  // differently.
+  std::vector<uint8_t> bytes(200);
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    bytes[i] = static_cast<uint8_t>(i * 37 + 11);
+  }
+  std::vector<uint8_t> shifted(bytes.size() + 8);
+  std::vector<uint64_t> hashes;
+  for (size_t len = 0; len <= 100; ++len) {
+    const uint64_t hash = XXHash64(bytes.data(), len);
+    for (size_t shift = 1; shift < 8; ++shift) {
+      std::memcpy(shifted.data() + shift, bytes.data(), len);
+      EXPECT_EQ(XXHash64(shifted.data() + shift, len), hash);
+    }
+    for (const uint64_t other : hashes) {
+      EXPECT_TRUE(other != hash);
+    }
+    hashes.push_back(hash);
+  }
+}
+
+void
+TestSeed()
+{
+  EXPECT_EQ(XXHash64("abc", 3, 0), Hash("abc"));
+  EXPECT_TRUE(XXHash64("abc", 3, 1) != Hash("abc"));
+  const std::string long_value(64, 'x');
+  EXPECT_TRUE(Hash(long_value, 1) != Hash(long_value));
+}
+
+}  // namespace
+
+int
+main()
+{
+  TestReferenceDigests();
+  TestAlignmentAndLength();
+  TestSeed();
+  return UNIT_TEST_RESULT();
+}
@@ -0,0 +1,149 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//
+// Checks of the per-sample prediction cache: hits, expiry, replacement of a
+// slot by another key, invalidation, and dropped inserts of predictions made
+// with the embeddings of a past generation.
+//
+
+#include <prediction_cache.hpp>
+#include <thread>
+#include <unit_test.hpp>
+#include <vector>
+
+using triton::backend::hugectr::PredictionCache;
+
+namespace {
+
+constexpr uint64_t kTtlNs = 1000;
+
+void
+TestHitAndExpiry()
+{
+  PredictionCache cache(16, sizeof(float), kTtlNs);
+  EXPECT_EQ(cache.value_byte_size(), sizeof(float));
+
+  float value = 0;
+  EXPECT_TRUE(!cache.find(3, 0, &value));
+
+  const float prediction = 0.25f;
+  cache.insert(3, 100, cache.generation(), &prediction);
+  EXPECT_TRUE(cache.find(3, 100, &value));
+  EXPECT_EQ(value, prediction);
+  EXPECT_TRUE(cache.find(3, 100 + kTtlNs - 1, &value));
+  EXPECT_TRUE(!cache.find(3, 100 + kTtlNs, &value));
+  EXPECT_EQ(cache.hits(), uint64_t{2});
+  EXPECT_EQ(cache.misses(), uint64_t{2});
+}
+
+void
+TestSlotReplacement()
+{
+  // Keys 5 and 21 share a slot of a cache with 16 slots.
+  PredictionCache cache(16, sizeof(float), kTtlNs);
+  const float first = 1.0f;
+  const float second = 2.0f;
+  cache.insert(5, 0, cache.generation(), &first);
+  cache.insert(21, 0, cache.generation(), &second);
+  float value = 0;
+  EXPECT_TRUE(!cache.find(5, 0, &value));
+  EXPECT_TRUE(cache.find(21, 0, &value));
+  EXPECT_EQ(value, second);
+}
+
+void
+TestKeyZeroIsNotCachedInitially()
+{
+  // Empty slots hold key 0, but belong to no generation.
+  PredictionCache cache(16, sizeof(float), kTtlNs);
+  float value = 0;
+  EXPECT_TRUE(!cache.find(0, 0, &value));
+}
+
+void
+TestInvalidation()
+{
+  PredictionCache cache(16, 2 * sizeof(float), kTtlNs);
+  const float prediction[2] = {0.5f, 0.75f};
+  const uint64_t generation = cache.generation();
+  cache.insert(7, 0, generation, prediction);
+  cache.invalidate();
+  EXPECT_TRUE(cache.generation() != generation);
+
+  float value[2] = {0, 0};
+  EXPECT_TRUE(!cache.find(7, 0, value));
+
+  // A prediction computed before the invalidation is dropped.
+  cache.insert(7, 0, generation, prediction);
+  EXPECT_TRUE(!cache.find(7, 0, value));
+
+  cache.insert(7, 0, cache.generation(), prediction);
+  EXPECT_TRUE(cache.find(7, 0, value));
+  EXPECT_EQ(value[0], prediction[0]);
+  EXPECT_EQ(value[1], prediction[1]);
+}
+
+void
+TestConcurrentUse()
+{
+  // Every hit returns the prediction inserted for its key.
+  PredictionCache cache(64, sizeof(uint64_t), kTtlNs);
+  std::vector<std::thread> threads;
+  std::vector<int> wrong(4, 0);
+  for (size_t t = 0; t < wrong.size(); ++t) {
+    threads.emplace_back([&cache, &wrong, t]() {
+      for (uint64_t i = 0; i < 20000; ++i) {
+        const uint64_t key = (i * 7 + t) % 256;
+        const uint64_t prediction = key * 3;
+        cache.insert(key, 0, cache.generation(), &prediction);
+        uint64_t value = 0;
+        if (cache.find(key ^ 1, 0, &value) && value != (key ^ 1) * 3) {
+          ++wrong[t];
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (const int w : wrong) {
+    EXPECT_EQ(w, 0);
+  }
+}
+
+}  // namespace
+
+int
+main()
+{
+  TestHitAndExpiry();
+  TestSlotReplacement();
+  TestKeyZeroIsNotCachedInitially();
+  TestInvalidation();
+  TestConcurrentUse();
+  return UNIT_TEST_RESULT();
+}
@@ -0,0 +1,111 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//
+// Checks of the top-K selection against a full sort, with ties, NaN scores
+// and several predictions per sample.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <top_k.hpp>
+#include <unit_test.hpp>
+#include <vector>
+
+using triton::backend::hugectr::SelectTopK;
+
+namespace {
+
+// The reference ranking: a stable sort by decreasing first prediction, with
+// NaN scores last.
+std::vector<int64_t>
+SortedRanking(const std::vector<float>& scores, const int64_t stride)
+{
+  const int64_t num_samples = scores.size() / stride;
+  std::vector<int64_t> order(num_samples);
+  std::iota(order.begin(), order.end(), int64_t{0});
+  std::stable_sort(
+      order.begin(), order.end(), [&scores, stride](int64_t a, int64_t b) {
+        const float score_a = scores[a * stride];
+        const float score_b = scores[b * stride];
+        if (std::isnan(score_b)) {
+          return !std::isnan(score_a);
+        }
+        return !std::isnan(score_a) && score_a > score_b;
+      });
+  return order;
+}
+
+void
+TestAgainstSort()
+{
+  std::mt19937 rng(3);
+  std::vector<int64_t> order;
+  for (const int64_t stride : {1, 3}) {
+    for (const int64_t num_samples : {1, 2, 17, 256}) {
+      std::vector<float> scores(num_samples * stride);
+      for (float& score : scores) {
+        // Few distinct values, so that there are plenty of ties.
+        score = static_cast<float>(rng() % 8) / 8;
+        if (rng() % 16 == 0) {
+          score = std::numeric_limits<float>::quiet_NaN();
+        }
+      }
+      const std::vector<int64_t> expected = SortedRanking(scores, stride);
+      for (int64_t k = 0; k <= num_samples; ++k) {
+        SelectTopK(scores.data(), num_samples, stride, k, &order);
+        EXPECT_EQ(order.size(), static_cast<size_t>(num_samples));
+        EXPECT_TRUE(std::equal(
+            expected.begin(), expected.begin() + k, order.begin()));
+      }
+    }
+  }
+}
+
+void
+TestNegativeAndInfiniteScores()
+{
+  const float inf = std::numeric_limits<float>::infinity();
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  const std::vector<float> scores = {-1.0f, nan, inf, -inf, 0.0f, -inf};
+  std::vector<int64_t> order;
+  SelectTopK(scores.data(), scores.size(), 1, scores.size(), &order);
+  // NaN ranks like -inf, and ties go to the lower index.
+  EXPECT_TRUE((order == std::vector<int64_t>{2, 4, 0, 1, 3, 5}));
+}
+
+}  // namespace
+
+int
+main()
+{
+  TestAgainstSort();
+  TestNegativeAndInfiniteScores();
+  return UNIT_TEST_RESULT();
+}
@@ -0,0 +1,128 @@
+// Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//
+// Checks of the VCSR row offset validation, on tables long enough to take the
+// AVX2 path as well as on the short tails the scalar loop handles.
+//
+
+#include <limits>
+#include <unit_test.hpp>
+#include <vcsr_validator.hpp>
+#include <vector>
+
+using triton::backend::hugectr::FindInvalidRowOffset;
+using triton::backend::hugectr::RowNnz;
+using triton::backend::hugectr::RowOffsetsValid;
+
+namespace {
+
+// Row offsets of 'num_slots' slots holding 0, 1, 2, 0, 1, 2, ... keys.
+std::vector<int>
+MakeRows(const size_t num_slots)
+{
+  std::vector<int> rows(num_slots + 1, 0);
+  for (size_t i = 0; i < num_slots; ++i) {
+    rows[i + 1] = rows[i] + static_cast<int>(i % 3);
+  }
+  return rows;
+}
+
+void
+TestValidRows()
+{
+  for (size_t num_slots = 0; num_slots < 40; ++num_slots) {
+    const std::vector<int> rows = MakeRows(num_slots);
+    EXPECT_TRUE(RowOffsetsValid(rows.data(), rows.size(), 2));
+    EXPECT_EQ(FindInvalidRowOffset(rows.data(), rows.size(), 2), num_slots);
+    if (num_slots >= 3) {
+      EXPECT_TRUE(!RowOffsetsValid(rows.data(), rows.size(), 1));
+      EXPECT_EQ(FindInvalidRowOffset(rows.data(), rows.size(), 1), size_t{2});
+    }
+  }
+  EXPECT_TRUE(RowOffsetsValid(nullptr, 0, 0));
+}
+
+void
+TestInvalidSlotAtEveryPosition()
+{
+  for (size_t num_slots = 1; num_slots < 40; ++num_slots) {
+    for (size_t bad = 0; bad < num_slots; ++bad) {
+      // Too many keys in one slot.
+      std::vector<int> rows = MakeRows(num_slots);
+      for (size_t i = bad + 1; i < rows.size(); ++i) {
+        rows[i] += 3;
+      }
+      EXPECT_TRUE(!RowOffsetsValid(rows.data(), rows.size(), 2));
+      EXPECT_EQ(FindInvalidRowOffset(rows.data(), rows.size(), 2), bad);
+
+      // Decreasing offsets.
+      rows = MakeRows(num_slots);
+      for (size_t i = bad + 1; i < rows.size(); ++i) {
+        rows[i] -= 5;
+      }
+      EXPECT_TRUE(!RowOffsetsValid(rows.data(), rows.size(), 2));
+      EXPECT_EQ(FindInvalidRowOffset(rows.data(), rows.size(), 2), bad);
+    }
+  }
+}
+
+void
+TestExtremeOffsets()
+{
+  constexpr int kMin = std::numeric_limits<int>::min();
+  constexpr int kMax = std::numeric_limits<int>::max();
+
+  // Differences that overflow a signed subtraction.
+  const std::vector<int> rising = {kMin, kMax};
+  EXPECT_EQ(RowNnz(rising.data(), 0), std::numeric_limits<uint32_t>::max());
+  EXPECT_TRUE(!RowOffsetsValid(rising.data(), rising.size(), 1000));
+  EXPECT_EQ(
+      FindInvalidRowOffset(rising.data(), rising.size(), 1000), size_t{0});
+
+  const std::vector<int> falling = {kMax, kMin};
+  EXPECT_EQ(RowNnz(falling.data(), 0), uint32_t{1});
+  EXPECT_TRUE(!RowOffsetsValid(falling.data(), falling.size(), 0));
+
+  // Offsets near the top of the range are fine as long as they grow slowly.
+  std::vector<int> high(20);
+  for (size_t i = 0; i < high.size(); ++i) {
+    high[i] = kMax - static_cast<int>(high.size() - i);
+  }
+  EXPECT_TRUE(RowOffsetsValid(high.data(), high.size(), 1));
+  EXPECT_TRUE(!RowOffsetsValid(high.data(), high.size(), 0));
+}
+
+}  // namespace
+
+int
+main()
+{
+  TestValidRows();
+  TestInvalidSlotAtEveryPosition();
+  TestExtremeOffsets();
+  return UNIT_TEST_RESULT();
+}